@@ -52,26 +52,31 @@
 #include "LunAero.hpp"
 
 /**
- * This function (called from gtk_LunAero.cpp) handles checking the frame during live operation and
+ * This function (called from analysis_loop) handles checking the frame during live operation and
  * processes the LOST_COUNTER
  *
+ * @param frame screenshot from the capture thread
  */
-void cb_framecheck() {
-	printf("getting current frame\n");
-	if (DEBUG_COUT) {
-		LOGGING.open(LOGOUT, std::ios_base::app);
-		LOGGING
-		<< "Time in Milliseconds ="
-		<< std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count()
-		<< std::endl;
-		LOGGING.close();
-	}
-	current_frame();
+void cb_framecheck(const frame_buffer *frame) {
+	LOG_TRACE("Time in Milliseconds ="
+		<< std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+	uint64_t start = log_now();
+	current_frame(frame);
+	metric_time(METRICS.framecheck, start);
+	metric_add(METRICS.framechecks);
 	//~ frame_centroid();
-	if (*val_ptr.LOST_COUNTERaddr == LOST_THRESH) {
-		sem_wait(&LOCK);
-		*val_ptr.ABORTaddr = 1;
-		sem_post(&LOCK);
+}
+
+/**
+ * This function ends the run once the moon has been lost for LOST_THRESH frames in a row.  The capture
+ * and analysis threads both count lost frames, so each passes the count its own increment produced.
+ *
+ * @param count value of LOST_COUNTER after the increment
+ */
+void lost_check(int count) {
+	if (count == LOST_THRESH) {
+		telem_error(TELEM_ERR_LOST, "lost the moon");
+		abort_code();
 	}
 }
 
@@ -83,14 +88,9 @@ void cb_framecheck() {
  */
 void cleanup () {
 	// Placeholder in case we need to clean anything up on exit.
-	if (DEBUG_COUT) {
-		LOGGING.open(LOGOUT, std::ios_base::app);
-		LOGGING
-		<< "killing run" << std::endl;
-		LOGGING.close();
-	}
+	LOG_INFO("killing run");
 	kill_raspivid();
-	usleep(1000000);
+	camera_wait_exit();
 }
 
 /**
@@ -100,23 +100,34 @@ void cleanup () {
  *
  */
 void kill_raspivid () {
-	sem_wait(&LOCK);
 	*val_ptr.STOP_DIRaddr = 3;
-	sem_post(&LOCK);
+	RASPIVID_RUNNING = false;
 	
 	// HACK - This is a filthy hack to get kill the raspivid instance.
-	// Since fork interactions are hard, we will use this for now.
-	char line[1024];
-	FILE *cmd = popen("pidof raspivid", "r");
-	fgets(line, 1024, cmd);
-	pid_t pid = strtoul(line, NULL, 10);
-	pclose(cmd);
-	if (kill(pid, SIGINT) != 0) {
-		if (DEBUG_COUT) {
-			LOGGING.open(LOGOUT, std::ios_base::app);
-			LOGGING
-			<< "ERROR: Unable to kill raspivid" << std::endl;
-			LOGGING.close();
+	// raspivid is started through a shell, so we find it by name for now.
+	pid_t pid = raspivid_pid();
+	// pid 0 would signal our own process group
+	if ((pid == 0) || (kill(pid, SIGINT) != 0)) {
+		LOG_ERROR("ERROR: Unable to kill raspivid");
+	}
+}
+
+/**
+ * This function reads the processor serial number unique to the Raspberry Pi from /proc/cpuinfo into
+ * LUID.  The file is read directly rather than through a shell pipeline so it can run alongside the
+ * other startup steps.
+ */
+void read_luid() {
+	std::ifstream cpuinfo("/proc/cpuinfo");
+	std::string line;
+	while (std::getline(cpuinfo, line)) {
+		if (line.rfind("Serial", 0) == 0) {
+			auto delimiter_pos = line.find(":");
+			if (delimiter_pos != std::string::npos) {
+				LUID = line.substr(delimiter_pos + 1);
+				LUID.erase(std::remove_if(LUID.begin(), LUID.end(), isspace), LUID.end());
+			}
+			return;
 		}
 	}
 }
@@ -124,28 +135,17 @@ void kill_raspivid () {
 /**
  * This funciton creates an ID file to be stored with the recorded video which includes information
  * about the unit the run worked on.  The processor id is stored using the cpuinfo unique to the 
- * Raspberry Pi.
+ * Raspberry Pi, which read_luid must have loaded first.
  *
  * @return status
  */
 int create_id_file() {
 	std::ofstream idfile;
-	char line[1024];
-	FILE *cmd = popen("cat /proc/cpuinfo | grep Serial | cut -d ' ' -f 2", "r");
-	fgets(line, 1024, cmd);
-	pclose(cmd);
-	
-	std::string linestr(line);
-	linestr.erase(std::remove(linestr.begin(), linestr.end(), '\n'), linestr.end());
+	std::string linestr = LUID;
 	IDPATH = FILEPATH + "/" + linestr + ".txt";
 	
-	if (DEBUG_COUT) {
-		LOGGING.open(LOGOUT, std::ios_base::app);
-		LOGGING
-		<< "LUID: " << linestr << std::endl
-		<< "idpath: " << IDPATH << std::endl;
-		LOGGING.close();
-	}
+	LOG_INFO("LUID: " << linestr << std::endl
+		<< "idpath: " << IDPATH);
 	
 	std::string gmt = current_time(1);
 	
@@ -157,20 +157,68 @@ int create_id_file() {
 	<< "UTC : "
 	<< gmt
 	<< std::endl;
+	for (unsigned int i=0; i<DISK_BENCH_OUTPUT.size(); i++) {
+		idfile
+		<< DISK_BENCH_OUTPUT[i]
+		<< std::endl;
+	}
 	idfile.close();
 	
 	return 0;
 }
 
 /**
- * This is a helper funciton which updates the abort code to end the run across all forks.
- *
+ * This is a helper funciton which updates the abort code to end the run across all threads.  The camera
+ * thread, the capture and analysis threads, and the GUI are woken so they do not finish their waits
+ * before noticing.
  *
  */
 void abort_code() {
-	sem_wait(&LOCK);
 	*val_ptr.ABORTaddr = 1;
-	sem_post(&LOCK);
+	CAMERA_QUEUE.push(CAM_REQ_STOP);
+	ANALYSIS_QUEUE.push(ANA_REQ_STOP);
+	frame_wake();
+	gui_notify();
+}
+
+/**
+ * This function ends a headless run on SIGINT or SIGTERM, so LunAero can be stopped with Ctrl-C or by a
+ * service manager.  Only the abort flag is set, since that is safe in a signal handler.  The main loop
+ * then stops the workers.
+ *
+ * @param sig signal received
+ */
+void headless_signal(int sig) {
+	if (val_ptr.ABORTaddr != NULL) {
+		*val_ptr.ABORTaddr = 1;
+	}
+}
+
+/**
+ * This function runs on the main thread in place of the GTK main loop when LunAero is started with
+ * --headless.  It does the work of abort_check: settings changes are picked up and commands from the
+ * command socket are run.  Between settings checks it sleeps on CONTROL_QUEUE, so commands are run as
+ * soon as they arrive.  Frames are checked by the analysis thread, as with the GUI.  The watchdog
+ * watches this loop as it would the GUI.
+ *
+ */
+void headless_loop() {
+	LOG_INFO("running headless, control LunAero through " << CONTROL_SOCKET);
+	startup_step("headless loop", STARTUP_SPAWN);
+	control_request request;
+	while (*val_ptr.ABORTaddr == 0) {
+		wd_beat(WD_GUI, "headless loop");
+		settings_poll();
+		if (CONTROL_QUEUE.pop(request, std::chrono::milliseconds(HEADLESS_POLL_MS))) {
+			control_apply(request);
+			control_dispatch();
+		}
+	}
+	if (*val_ptr.LOST_COUNTERaddr > LOST_THRESH) {
+		LOG_INFO("lost moon, shutting down");
+	} else {
+		LOG_INFO("recieved shutdown command from user");
+	}
 }
 
 /**
@@ -194,219 +242,83 @@ std::string current_time(int gmt) {
 	strftime(buffer, sizeof(buffer), "%Y%m%d%H%M%S", timeinfo);
 	std::string str(buffer);
 
-	if (DEBUG_COUT) {
-		LOGGING.open(LOGOUT, std::ios_base::app);
-		LOGGING
-		<< str << std::endl;
-		LOGGING.close();
-	}
+	LOG_DEBUG(str);
 	
 	return str;
 }
 
 
 /**
- * This function captures the frame from the preview window (a complicated process involving capturing
- * the VC/DISPMANX screenshot, not the X window screensho)t, crops it to ignore the GTK, and determines 
- * how well the moon is centered in the cropped frame.  Priority is given to checking whether the moon
- * is touching the side of the cropped image.  If the edge is not being touched, threshold limited
- * brightness is used to find the center of mass of the bright spot and comparing it to the target
- * location.
- *
+ * This function takes a screenshot of the preview window from the capture thread (see frame_grab),
+ * crops it to ignore the GTK, and determines how well the moon is centered in the cropped frame.
+ * Priority is given to checking whether the moon is touching the side of the cropped image.  If the
+ * edge is not being touched, threshold limited brightness is used to find the center of mass of the
+ * bright spot and comparing it to the target location.  The threshold comes from the histograms of the
+ * frames before this one (see threshold_update), and only the blob of bright pixels taken for the moon
+ * is checked (see blob_label).  Once the moon has been found, only a window around it is thresholded
+ * (see blob_threshold), falling back to the whole region when the moon is not inside it.
  *
+ * @param frame screenshot to check
  */
-void current_frame() {
+void current_frame(const frame_buffer *frame) {
 	
 	// Don't bother if we have already told the program to abort
 	if (*val_ptr.ABORTaddr == 1) {
 		return;
 	}
 	
-	// Run a system check to see if raspivid is running, if not, print a warning
-	FILE* fpidof = popen("pidof raspivid", "r");
-	if (fpidof) {
-		int p=0;
-		if (!(fscanf(fpidof, "%d", &p)>0 && p>0)) {
-			int local_cnt = *val_ptr.LOST_COUNTERaddr;
-			local_cnt = local_cnt + 1;
-			sem_wait(&LOCK);
-			*val_ptr.LOST_COUNTERaddr = local_cnt;
-			sem_post(&LOCK);
-			if (DEBUG_COUT) {
-				LOGGING.open(LOGOUT, std::ios_base::app);
-				LOGGING
-				<< "WARNING: lost moon counter increased to" 
-				<< *val_ptr.LOST_COUNTERaddr 
-				<<  " cycles due to failure to find raspivid" 
-				<< std::endl;
-				LOGGING.close();
-			}
-			pclose(fpidof);
-			return;
-		}
-		pclose(fpidof);
-	} else {
-		int local_cnt = *val_ptr.LOST_COUNTERaddr;
-		local_cnt = local_cnt + 1;
-		sem_wait(&LOCK);
-		*val_ptr.LOST_COUNTERaddr = local_cnt;
-		sem_post(&LOCK);
-		if (DEBUG_COUT) {
-			LOGGING.open(LOGOUT, std::ios_base::app);
-			LOGGING
-			<< "WARNING: lost moon counter increased to " 
-			<< *val_ptr.LOST_COUNTERaddr 
-			<<  " cycles due to failure to find raspivid" 
-			<< std::endl;
-			LOGGING.close();
-		}
-		return;
-	}
-	
-	DISPMANX_DISPLAY_HANDLE_T   display = 0;
-	DISPMANX_MODEINFO_T         info;
-	DISPMANX_RESOURCE_HANDLE_T  resource = 0;
-	VC_IMAGE_TYPE_T             type = VC_IMAGE_RGB888;
-	DISPMANX_TRANSFORM_T	    transform = static_cast <DISPMANX_TRANSFORM_T> (0);
-	VC_RECT_T			        rect;
-	
-	void *image;
-	uint32_t vc_image_ptr;
-	uint32_t screen = 0;
-
-	bcm_host_init();
-
-	// Get display info for the screen we are using.
-	display = vc_dispmanx_display_open( screen );
-	if (vc_dispmanx_display_get_info(display, &info) != 0) {
-		if (DEBUG_COUT) {
-			LOGGING.open(LOGOUT, std::ios_base::app);
-			LOGGING
-			<< "ERROR: failed to get display info" << std::endl;
-			LOGGING.close();
-		}
-		*val_ptr.ABORTaddr = 1;
-	}
+	uint64_t analysis_start = log_now();
 
-	// This holds an image
-	image = calloc( 1, info.width * 3 * info.height );
-	if (!image) {
-		if (DEBUG_COUT) {
-			LOGGING.open(LOGOUT, std::ios_base::app);
-			LOGGING
-			<< "ERROR: failed image assertion" << std::endl;
-			LOGGING.close();
-		}
-		*val_ptr.ABORTaddr = 1;
-	}
-
-	// Create space based on the screen info
-	resource = vc_dispmanx_resource_create( type, info.width, info.height, &vc_image_ptr);
-	if (!resource) {
-		if (DEBUG_COUT) {
-			LOGGING.open(LOGOUT, std::ios_base::app);
-			LOGGING
-			<< "ERROR: failed to create VC Dispmanx Resource" << std::endl;
-			LOGGING.close();
-		}
-		*val_ptr.ABORTaddr = 1;
-	}
-
-	// Take a snapshot of the screen (stored in resource)
-	vc_dispmanx_snapshot(display, resource, transform);
-
-	// Read the rectangular data from resource into the image calloc
-	vc_dispmanx_rect_set(&rect, 0, 0, info.width, info.height);
-	vc_dispmanx_resource_read_data(resource, &rect, image, info.width*3);
-	// TODO - Make this an mmap stored image.
-
-	if (DEBUG_COUT) {
-		LOGGING.open(LOGOUT, std::ios_base::app);
-		LOGGING
-		<< info.width << " x " << info.height << std::endl;
-		LOGGING.close();
-	}
-	std::string imgstr(static_cast<char*>(image), info.width*3*info.height);
+	LOG_TRACE("frame " << frame->seq << " of " << frame->width << " x " << frame->height);
 	
 	int local_height = RVD_HEIGHT - 6;
 	int local_width = RVD_WIDTH - 4;
 	int local_xcorn = RVD_XCORN + 2;
 	int local_ycorn = RVD_YCORN + 3;
 	
-	int matrix[local_height][local_width];
-	int wcnt = 0;
-	int hcnt = 0;
-	int wcnt_prime = 0;
-	int hcnt_prime = 0;
-	for (unsigned int i=0; i<imgstr.size(); i=i+3) {
-		if ((wcnt > (local_xcorn)) && (wcnt < (local_xcorn + local_width + 1))) {
-			if ((hcnt > (local_ycorn - 1)) && (hcnt < (local_ycorn + local_height))) {
-				int out;
-				out = 0.30*(int)imgstr[i] + 0.59*(int)imgstr[i+1] + 0.11*(int)imgstr[i+2];
-				if (out > 25) { // 10% threshold
-					out = 0;
-				} else {
-					out = 1;
-				}
-				matrix[hcnt_prime][wcnt_prime] = out;
-				wcnt_prime += 1;
-				if (wcnt_prime == local_width) {
-					wcnt_prime = 0;
-					hcnt_prime += 1;
-				}
-			}
-		}
-		wcnt += 1;
-		if (wcnt == info.width) {
-			wcnt = 0;
-			hcnt += 1;
-		}
-	}
+	// The grey region is written straight into the shared frame ring, if there is one
+	unsigned char *shared = shm_begin_frame(local_width, local_height, frame->time_ns);
+	// Grey levels of the region, for auto exposure and the threshold of the next frame
+	uint32_t hist[EXPOSURE_LEVELS] = {0};
+	int level = THRESH_LEVEL.load(std::memory_order_relaxed);
+	
+	// Bright spots are kept as runs along each row, which the moments and edges are found from.  Only
+	// the moon is kept, so other bright things in view do not move the motors.
+	blob_stats moon;
+	int others = 0;
+	int windowed = 0;
+	uint64_t blob_start = log_now();
+	int found = blob_search(frame, local_xcorn + 1, local_ycorn, local_width, local_height, level, hist, shared,
+		moon, others, windowed);
+	metric_time(METRICS.blob, blob_start);
+	if (windowed == 1) {
+		metric_add(METRICS.window_frames);
+	} else if (windowed == 2) {
+		LOG_TRACE("moon not within the tracking window, checked the whole frame");
+		metric_add(METRICS.window_fallbacks);
+	}
+	exposure_add(hist);
+	threshold_update(hist);
 	
 	// Optionally, save the image to a file on the disk so we can check that it makes sense
 	if (SAVE_DEBUG_IMAGE) {
-		std::string userenv = std::getenv("USER");
-		std::string filestr = "/media/" + userenv + "/" + DRIVE_NAME + "/out.pbm";
-		FILE *fp = fopen(filestr.c_str(), "wb");
-		//~ fprintf(fp, "P1\n%d %d\n1\n", frmwidth, frmheight);
-		fprintf(fp, "P1\n%d %d\n1\n", local_width, local_height);
-		for (int i=0; i<local_height; i++) {
-			for(int j=0; j<local_width; j++) {
-				if (j == local_width-1) {
-					fprintf(fp, "\n");
-				}
-				fprintf(fp, "%d", matrix[i][j]);
-			}
+		std::string filestr;
+		{
+			// The camera thread moves DEFAULT_FILEPATH when the session changes drives
+			std::lock_guard <std::mutex> lock(FILEPATH_MUTEX);
+			filestr = DEFAULT_FILEPATH + "out.pbm";
 		}
-		fclose(fp);
-	}
-	
-	// Cleanup the VC resources
-	if (vc_dispmanx_resource_delete(resource) != 0) {
-		if (DEBUG_COUT) {
-			LOGGING.open(LOGOUT, std::ios_base::app);
-			LOGGING
-			<< "ERROR: failed to delete vc resource" << std::endl;
-			LOGGING.close();
+		FILE *fp = fopen(filestr.c_str(), "wb");
+		if (fp != NULL) {
+			blob_write_pbm(fp, local_width, local_height);
+			fclose(fp);
 		}
-		*val_ptr.ABORTaddr = 1;
 	}
-	if (vc_dispmanx_display_close(display) != 0) {
-		if (DEBUG_COUT) {
-			LOGGING.open(LOGOUT, std::ios_base::app);
-			LOGGING
-			<< "ERROR: failed to close vc display" << std::endl;
-			LOGGING.close();
-		}
-		*val_ptr.ABORTaddr = 1;
+
+	if (others > 0) {
+		LOG_TRACE("left out " << others << " bright blobs besides the moon");
+		metric_add(METRICS.blobs_rejected, others);
 	}
-	free(image);
-	
-	//Check for bright or dark spots?
-	// Note the weird inversion when we use .pbm format
-	// Bright spots == 0
-	// dark spots == 1
-	int checkval = 0;
 	
 	// Number of points to be "on edge" is 10% of edge
 	int w_thresh = WORK_WIDTH/EDGE_DIVISOR_W;
@@ -417,215 +329,134 @@ void current_frame() {
 	int bottom_edge = 0;
 	int left_edge = 0;
 	int right_edge = 0;
+	blob_edges(local_width, local_height, top_edge, bottom_edge, left_edge, right_edge);
 	
-	for (int j=0; j<local_width; j++) {
-		if (matrix[0][j] == checkval) {
-			top_edge++;
-		}
-		if (matrix[local_height-1][j] == checkval) {
-			bottom_edge++;
-		}
-	}
-	
-	for (int k=0; k<local_height; k++) {
-		if (matrix[k][0] == checkval) {
-			left_edge++;
-		}
-		if (matrix[k][local_width-1] == checkval) {
-			right_edge++;
-		}
-	}
-	
-	// Calculate the centroid using sum.
-	int sumx = 0;
-	int sumy = 0;
-	int mcnt = 0;
-	
-	for (int k=0; k<local_height; k++) {
-		for (int j=0; j<local_width; j++) {
-			if (matrix[k][j] == checkval) {
-				sumx = sumx + j;
-				sumy = sumy + k;
-				mcnt++;
-			}
-		}
-	}
-	if (DEBUG_COUT) {
-		LOGGING.open(LOGOUT, std::ios_base::app);
-		LOGGING
-		<< "sumx " << sumx << " sumy " << sumy << std::endl;
-		LOGGING.close();
-	}
+	int mcnt = moon.area;
+	LOG_TRACE("moon blob of " << mcnt << " pixels in (" << moon.left << ", " << moon.top << ")-(" << moon.right
+		<< ", " << moon.bottom << "), roundness " << moon.roundness);
 	
 	// If nothing is found, return an increment to the moon loss counter
-	if ((sumx == 0) && (sumy == 0)) {
-		int local_cnt = *val_ptr.LOST_COUNTERaddr;
-		local_cnt = local_cnt + 1;
-		sem_wait(&LOCK);
-		*val_ptr.LOST_COUNTERaddr = local_cnt;
-		sem_post(&LOCK);
-		if (DEBUG_COUT) {
-			LOGGING.open(LOGOUT, std::ios_base::app);
-			LOGGING
-			<< "lost moon for " << *val_ptr.LOST_COUNTERaddr <<  " cycles" << std::endl;
-			LOGGING.close();
-		}
+	if (found != 0) {
+		blob_track_reset();
+		int lost = val_ptr.LOST_COUNTERaddr->fetch_add(1) + 1;
+		LOG_TRACE("lost moon for " << lost <<  " cycles");
+		telem_frame(local_width, local_height, mcnt, -1, -1, top_edge, bottom_edge, left_edge, right_edge,
+			lost);
+		shm_publish(mcnt, -1, -1, top_edge, bottom_edge, left_edge, right_edge, lost);
+		analysis_post(frame->time_ns, mcnt, -1, -1, lost);
+		metric_add(METRICS.frames_lost);
+		lost_check(lost);
 	} else {
 		// something was found, reset moon loss counter
-		sem_wait(&LOCK);
 		*val_ptr.LOST_COUNTERaddr = 0;
-		sem_post(&LOCK);
-		if (DEBUG_COUT) {
-			LOGGING.open(LOGOUT, std::ios_base::app);
-			LOGGING
-			<< "Moon found centered at (" << (sumx/mcnt) << ", " << (sumy/mcnt) << ")\n" << std::endl
-			<< "top:bottom::left:right " << top_edge << ":" << bottom_edge << "::" << left_edge
-			<< ":" << right_edge <<std::endl;
-			LOGGING.close();
+		
+		// The centroid is pulled towards the lit side of a crescent, and towards the middle of the frame
+		// when the disk is cut off by its edge.  The centre of a circle fitted to the limb is used instead
+		// when a good one is found.  It is kept within the frame, since -1 means nothing was found.
+		double mx = (double)moon.sumx / moon.area;
+		double my = (double)moon.sumy / moon.area;
+		int cx = moon.sumx/moon.area;
+		int cy = moon.sumy/moon.area;
+		bool fitted = false;
+		limb_circle circle;
+		if (LIMB_FIT) {
+			uint64_t limb_start = log_now();
+			fitted = (limb_fit(local_width, local_height, mx, my, frame->seq, circle) == 0);
+			metric_time(METRICS.limb, limb_start);
+			if (fitted) {
+				LOG_TRACE("limb fit centre (" << circle.x << ", " << circle.y << ") radius " << circle.r
+					<< " quality " << circle.quality << " rms " << circle.rms);
+				metric_add(METRICS.limb_fits);
+				cx = std::min(std::max((int)lround(circle.x), 0), local_width - 1);
+				cy = std::min(std::max((int)lround(circle.y), 0), local_height - 1);
+			}
 		}
+		blob_track(moon, fitted, circle, local_width, local_height);
+		LOG_TRACE("Moon found centered at (" << (cx) << ", " << (cy) << ")\n" << std::endl
+			<< "top:bottom::left:right " << top_edge << ":" << bottom_edge << "::" << left_edge
+			<< ":" << right_edge);
+		telem_frame(local_width, local_height, mcnt, cx, cy, top_edge, bottom_edge, left_edge,
+			right_edge, 0);
+		shm_publish(mcnt, cx, cy, top_edge, bottom_edge, left_edge, right_edge, 0);
+		analysis_post(frame->time_ns, mcnt, cx, cy, 0);
+		METRICS.centroid_error_x.store((cx) - (local_width/2), std::memory_order_relaxed);
+		METRICS.centroid_error_y.store((cy) - (local_height/2), std::memory_order_relaxed);
 		// Report edges only
 		if ((top_edge >= w_thresh) && (bottom_edge < w_thresh)) {
-			if (DEBUG_COUT) {
-				LOGGING.open(LOGOUT, std::ios_base::app);
-				LOGGING
-				<< "+top edge" << std::endl;
-				LOGGING.close();
-			}
+			LOG_TRACE("+top edge");
 		}
 		if ((bottom_edge >= w_thresh) && (top_edge < w_thresh)) {
-			if (DEBUG_COUT) {
-				LOGGING.open(LOGOUT, std::ios_base::app);
-				LOGGING
-				<< "+bottom edge" << std::endl;
-				LOGGING.close();
-			}
+			LOG_TRACE("+bottom edge");
 		}
 		if ((left_edge >= h_thresh) && (right_edge < h_thresh)) {
-			if (DEBUG_COUT) {
-				LOGGING.open(LOGOUT, std::ios_base::app);
-				LOGGING
-				<< "+left edge" << std::endl;
-				LOGGING.close();
-			}
+			LOG_TRACE("+left edge");
 		}
 		if ((left_edge <= h_thresh) && (right_edge > h_thresh)) {
-			if (DEBUG_COUT) {
-				LOGGING.open(LOGOUT, std::ios_base::app);
-				LOGGING
-				<< "+right edge" << std::endl;
-				LOGGING.close();
-			}
+			LOG_TRACE("+right edge");
 		}
 		
-		
-		
+		// A frame which waited too long shows where the moon was, not where it is, so moving on it would
+		// chase the moon past the centre.  Stop until a fresh frame arrives instead.
+		uint64_t age = log_now() - frame->time_ns;
+		if (age > (uint64_t)FRAME_STALE_MS * 1000000) {
+			LOG_DEBUG("frame " << frame->seq << " is " << (age / 1000000) << " ms old, stopping motors");
+			metric_add(METRICS.frames_stale);
+			*val_ptr.STOP_DIRaddr = 3;
+			metric_time(METRICS.analysis, analysis_start);
+			metric_time(METRICS.frame_age, frame->time_ns);
+			return;
+		}
+		LOG_TRACE("acting on frame " << frame->seq << " taken " << (age / 1000000) << " ms ago");
 		
 		// Check if bright spot is near the edge of the frame
 		// If so, move away from that edge
-		// If not or near both edges, use centroid
-		if ((top_edge >= w_thresh) && (bottom_edge < w_thresh)) {
-			if (DEBUG_COUT) {
-				LOGGING.open(LOGOUT, std::ios_base::app);
-				LOGGING
-				<< "detected light on top edge" << std::endl;
-				LOGGING.close();
-			}
+		// If not, near both edges, or the limb was fitted, use the centre
+		if (!fitted && (top_edge >= w_thresh) && (bottom_edge < w_thresh)) {
+			LOG_TRACE("detected light on top edge");
 			mot_up_command();
-		} else if ((bottom_edge >= w_thresh) && (top_edge < w_thresh)) {
-			if (DEBUG_COUT) {
-				LOGGING.open(LOGOUT, std::ios_base::app);
-				LOGGING
-				<< "detected light on bottom edge" << std::endl;
-				LOGGING.close();
-			}
+		} else if (!fitted && (bottom_edge >= w_thresh) && (top_edge < w_thresh)) {
+			LOG_TRACE("detected light on bottom edge");
 			mot_down_command();
 		} else {
-			if (abs((sumy/mcnt)-(local_height/2)) > ((local_height/2)*0.2)) {
-				if (DEBUG_COUT) {
-					LOGGING.open(LOGOUT, std::ios_base::app);
-					LOGGING
-					<< "M_y = " << (sumy/mcnt)-(local_height/2) << std::endl;
-					LOGGING.close();
-				}
-				if (((sumy/mcnt)-(local_height/2)) > 0) {
-					if (DEBUG_COUT) {
-						LOGGING.open(LOGOUT, std::ios_base::app);
-						LOGGING
-						<< "centroid moving to down" << std::endl;
-						LOGGING.close();
-					}
+			if (abs((cy)-(local_height/2)) > ((local_height/2)*0.2)) {
+				LOG_TRACE("M_y = " << (cy)-(local_height/2));
+				if (((cy)-(local_height/2)) > 0) {
+					LOG_TRACE("centroid moving to down");
 					mot_down_command();
 				} else {
-					if (DEBUG_COUT) {
-						LOGGING.open(LOGOUT, std::ios_base::app);
-						LOGGING
-						<< "centroid moving to up" << std::endl;
-						LOGGING.close();
-					}
+					LOG_TRACE("centroid moving to up");
 					mot_up_command();
 				}
 			} else {
-				sem_wait(&LOCK);
-				*val_ptr.STOP_DIRaddr = 2;
-				sem_post(&LOCK);
+				// Add the vertical stop in one step so a stop already waiting for the motor thread is kept
+				val_ptr.STOP_DIRaddr->fetch_or(2);
 			}
 		}
 		
-		if ((left_edge >= h_thresh) && (right_edge < h_thresh)) {
-			if (DEBUG_COUT) {
-				LOGGING.open(LOGOUT, std::ios_base::app);
-				LOGGING
-				<< "detected light on left edge" << std::endl;
-				LOGGING.close();
-			}
+		if (!fitted && (left_edge >= h_thresh) && (right_edge < h_thresh)) {
+			LOG_TRACE("detected light on left edge");
 			mot_left_command();
-		} else if ((left_edge <= h_thresh) && (right_edge > h_thresh)) {
-			if (DEBUG_COUT) {
-				LOGGING.open(LOGOUT, std::ios_base::app);
-				LOGGING
-				<< "detected light on right edge" << std::endl;
-				LOGGING.close();
-			}
+		} else if (!fitted && (left_edge <= h_thresh) && (right_edge > h_thresh)) {
+			LOG_TRACE("detected light on right edge");
 			mot_right_command();
 		} else {
-			if (abs((sumx/mcnt)-(local_width/2)) > ((local_width/2)*0.4)) {
-				if (DEBUG_COUT) {
-					LOGGING.open(LOGOUT, std::ios_base::app);
-					LOGGING
-					<< "M_x = " << (sumx/mcnt)-(local_width/2) << std::endl;
-					LOGGING.close();
-				}
-				if (((sumx/mcnt)-(local_width/2)) > 0) {
-					if (DEBUG_COUT) {
-						LOGGING.open(LOGOUT, std::ios_base::app);
-						LOGGING
-						<< "centroid moving to right" << std::endl;
-						LOGGING.close();
-					}
+			if (abs((cx)-(local_width/2)) > ((local_width/2)*0.4)) {
+				LOG_TRACE("M_x = " << (cx)-(local_width/2));
+				if (((cx)-(local_width/2)) > 0) {
+					LOG_TRACE("centroid moving to right");
 					mot_right_command();
 				} else {
-					if (DEBUG_COUT) {
-						LOGGING.open(LOGOUT, std::ios_base::app);
-						LOGGING
-						<< "centroid moving to left" << std::endl;
-						LOGGING.close();
-					}
+					LOG_TRACE("centroid moving to left");
 					mot_left_command();
 				}
 			} else {
-				// In the case we already need to stop one direction, stop both
-				if (*val_ptr.STOP_DIRaddr == 2) {
-					sem_wait(&LOCK);
-					*val_ptr.STOP_DIRaddr = 3;
-					sem_post(&LOCK);
-				} else {
-					sem_wait(&LOCK);
-					*val_ptr.STOP_DIRaddr = 1;
-					sem_post(&LOCK);
-				}
+				// Add the horizontal stop in one step, so a vertical stop becomes a stop of both
+				val_ptr.STOP_DIRaddr->fetch_or(1);
 			}
 		}
 	}
+	metric_time(METRICS.analysis, analysis_start);
+	metric_time(METRICS.frame_age, frame->time_ns);
 	
 	return;
 }
@@ -633,13 +464,19 @@ void current_frame() {
 /**
  * This function takes the two input strings and uses them to issue a notificaiton alert to the
  * Raspian desktop.  This is a variation of the linux command ``notify-send``, and it requires
- * libnotify-dev installed on the system.
+ * libnotify-dev installed on the system.  A headless run has no desktop, so the alert is written to the
+ * log and the terminal instead.
  *
  * @param input1 The string which should be at the top of the notification
  * @param input2 The string's bottomtext, more descriptive.
  * @return status
  */
 int notify_handler(std::string input1, std::string input2) {
+	if (HEADLESS) {
+		LOG_WARN(input1 << ": " << input2);
+		std::cerr << input1 << ": " << input2 << std::endl;
+		return 0;
+	}
 	notify_init("LunAero");
 	NotifyNotification* n = notify_notification_new (input1.c_str(), input2.c_str(), 0);
 	notify_notification_set_timeout(n, EMG_DUR); // 10 seconds
@@ -652,382 +489,108 @@ int notify_handler(std::string input1, std::string input2) {
 
 /**
  * This function checks the save location properties to determine if the location is acceptable for
- * saving video.  This only has limited capacity to determine the fitness of the drive.  The quality
- * of the save location is determined based on 1) drive is findable 2) valid /proc/mounts file 3)
- * remaining space left on the drive.  Remaining space is calculated based on 1000000*t_s where t_s
- * is the seconds a video will be recorded based on the settings.cfg line RECORD_DURATION.  If the
- * available space is less than this, the program stops with an error.  If it is less than 10 times this
- * value, a warning issued, but the program continues.  Reported free space and available space on the
- * drive is recorded in the log.
+ * saving video.  This only has limited capacity to determine the fitness of the drive.  Each drive in
+ * DRIVE_NAME is checked in order.  The quality of a save location is determined based on 1) drive is
+ * findable 2) valid /proc/mounts file 3) remaining space left on the drive.  Drives given as absolute
+ * paths only need to be an existing directory, so tmpfs or loopback mounts can be used for testing.
+ * Remaining space is forecast from the RPI_BR bitrate using disk_forecast_bytes.  Drives which cannot
+ * hold DISK_MIN_SEGMENT seconds of video, or which cannot write as fast as RPI_BR according to
+ * disk_benchmark, are dropped from DRIVE_LIST.  If no drive is left, the program
+ * stops with an error.  If all drives together will fill within DISK_WARN_TIME seconds, a warning
+ * issued, but the program continues.  Reported free space, available space, and the forecast recording
+ * time on each drive are recorded in the log.
  *
  * @return status
  */
 int startup_disk_check() {
 	
-	std::string userenv = std::getenv("USER");
-	std::string local_path = "/media/" + userenv + "/" + DRIVE_NAME;
-	DEFAULT_FILEPATH = local_path + "/";
-	
-	std::ifstream mountsfile("/proc/mounts", std::ifstream::in);
-	if (!mountsfile.good()) {
-		notify_handler("LunAero Error", "Input stream to /proc/mounts is not valid");
-		return 1;
+	disk_parse_drives();
+	if (DRIVE_LIST.empty()) {
+		notify_handler("LunAero Error", "No drive is given by DRIVE_NAME in settings.cfg");
+		return 3;
 	}
 	
-	int found_mount = 0;
-	std::string line;
-	
-	while (std::getline(mountsfile, line)) {
-		if (line.find(local_path) != std::string::npos) {
+	vector <std::string> usable;
+	int found_any = 0;
+	double total_ttf = 0.;
+	for (unsigned int i=0; i<DRIVE_LIST.size(); i++) {
+		std::string local_path = DRIVE_LIST[i];
+		int found_mount = disk_is_mounted(local_path);
+		if (found_mount < 0) {
+			notify_handler("LunAero Error", "Input stream to /proc/mounts is not valid");
+			return 1;
+		}
+		if ((!found_mount) && (local_path.rfind("/media/", 0) != 0) && std::filesystem::is_directory(local_path)) {
+			DISK_OUTPUT.push_back("WARNING: " + local_path + " is not a mount point, using it as a directory");
 			found_mount = 1;
-			break;
 		}
-	}
-	mountsfile.close();
-	
-	if (found_mount) {
+		if (!found_mount) {
+			DISK_OUTPUT.push_back("WARNING: could not find a drive mounted at " + local_path);
+			continue;
+		}
+		found_any = 1;
+		
 		namespace fs = std::filesystem;
 		fs::space_info tmp = fs::space(local_path);
-		if (tmp.available < (1000000 * std::chrono::duration<double>(RECORD_DURATION).count())) {
-			notify_handler("LunAero Error", "The space on this drive is too low with "
-			+ std::to_string(tmp.available)
-			+ " bytes remaining");
-			return 2;
-		} else if (tmp.available < (10 * 1000000 * std::chrono::duration<double>(RECORD_DURATION).count())) {
-			notify_handler("LunAero Warning", "This drive only has "
-			+ std::to_string(tmp.available)
-			+ " bytes of space remaining.");
-		}
+		double ttf = disk_time_to_full(local_path);
+		DISK_OUTPUT.push_back("Drive: " + local_path);
 		DISK_OUTPUT.push_back("Free space: " + std::to_string(tmp.free));
 		DISK_OUTPUT.push_back("Available space: " + std::to_string(tmp.available));
-		return 0;
-	} else {
-		std::cout << "1" << std::endl;
-		notify_handler("LunAero Error", "Could not find a drive mounted at " + DEFAULT_FILEPATH);
-		return 3;
-	}
-}
-
-/**
- * This function handles the strings and values parsed from the settings.cfg file and assigns them
- * to the global values.
- *
- * @param name String obtained while parsing the settings.cfg file
- * @param value The value associated with name from settings.cfg file
- * @return status
- */
-int parse_checklist(std::string name, std::string value) {
-	// Boolean cases
-	if (name == "DEBUG_COUT"
- 		|| name == "SAVE_DEBUG_IMAGE"
-		) {
-		// Define booleans
-		bool result;
-		if (value == "true" || value == "True" || value == "TRUE") {
-			result = true;
-		} else if (value == "false" || value == "False" || value == "FALSE") {
-			result = false;
-		} else {
-			std::cerr << "Invalid boolean value in settings.cfg item: " << name << std::endl;
-			return 1;
-		}
-		
-		if (name == "DEBUG_COUT") {
-			DEBUG_COUT = result;
-		} else if (name == "SAVE_DEBUG_IMAGE") {
-			SAVE_DEBUG_IMAGE = result;
-		}
-	}
-	// Int cases
-	else if (
-		name == "FONT_MOD"
-		|| name == "EDGE_DIVISOR_W"
-		|| name == "EDGE_DIVISOR_H"
-		|| name == "FRAMECHECK_FREQ"
-		|| name == "MMAL_ERROR_THRESH"
-		|| name == "RPI_FPS"
-		|| name == "RPI_BR"
-		|| name == "SHUT_JUMP"
-		|| name == "SHUT_JUMP_BIG"
-		|| name == "FREQ"
-		|| name == "MIN_DUTY"
-		|| name == "MAX_DUTY"
-		|| name == "BRAKE_DUTY"
-		|| name == "APINP"
-		|| name == "APIN1"
-		|| name == "APIN2"
-		|| name == "BPIN1"
-		|| name == "BPIN2"
-		|| name == "BPINP"
-		|| name == "EMG_DUR"
-		|| name == "LOST_THRESH"
-		|| name == "RAW_BRIGHT_THRESH"
-		) {
-		int result = std::stoi(value);
-		if (name == "FONT_MOD") {
-			FONT_MOD = result;
-		} else if (name == "EDGE_DIVISOR_W") {
-			EDGE_DIVISOR_W = result;
-		} else if (name == "EDGE_DIVISOR_H") {
-			EDGE_DIVISOR_H = result;
-		} else if (name == "FRAMECHECK_FREQ") {
-			FRAMECHECK_FREQ = result;
-		} else if (name == "MMAL_ERROR_THRESH") {
-			MMAL_ERROR_THRESH = result;
-		} else if (name == "RPI_FPS") {
-			RPI_FPS = result;
-		} else if (name == "RPI_BR") {
-			RPI_BR = result;
-		} else if (name == "SHUT_JUMP") {
-			SHUT_JUMP = result;
-		} else if (name == "SHUT_JUMP_BIG") {
-			SHUT_JUMP_BIG = result;
-		} else if (name == "FREQ") {
-			FREQ = result;
-		} else if (name == "MIN_DUTY") {
-			MIN_DUTY = result;
-		} else if (name == "MAX_DUTY") {
-			MAX_DUTY = result;
-		} else if (name == "BRAKE_DUTY") {
-			BRAKE_DUTY = result;
-		} else if (name == "APINP") {
-			APINP = result;
-		} else if (name == "APIN1") {
-			APIN1 = result;
-		} else if (name == "APIN2") {
-			APIN2 = result;
-		} else if (name == "BPIN1") {
-			BPIN1 = result;
-		} else if (name == "BPIN2") {
-			BPIN2 = result;
-		} else if (name == "BPINP") {
-			BPINP = result;
-		} else if (name == "EMG_DUR") {
-			EMG_DUR = result;
-		} else if (name == "LOST_THRESH") {
-			LOST_THRESH = result;
-		} else if (name == "RAW_BRIGHT_THRESH") {
-			RAW_BRIGHT_THRESH = result;
+		DISK_OUTPUT.push_back("Forecast recording time: " + std::to_string((long)ttf) + " s");
+		if (tmp.available < (disk_forecast_bytes(DISK_MIN_SEGMENT) + DISK_RESERVE)) {
+			DISK_OUTPUT.push_back("WARNING: the space on " + local_path + " is too low, skipping it");
+			continue;
 		}
-	}
-	// Double cases
-	else if (
-		name == "RECORD_DURATION"
-		|| name == "LOOSE_WHEEL_DURATION"
-		) {
-		double result = std::stod(value);
-		if (name == "RECORD_DURATION") {
-			RECORD_DURATION = (std::chrono::duration<double>) result;
-		} else if (name == "LOOSE_WHEEL_DURATION") {
-			LOOSE_WHEEL_DURATION = (std::chrono::duration<double>) result;
-		}
-	}
-	// Float cases
-	else if (
-		name == "BRIGHT_THRESH"
-		 ) {
-		float result = std::stof(value);
-		if (name == "BRIGHT_THRESH") {
-			BRIGHT_THRESH = result;
+		if (disk_benchmark(local_path) == 1) {
+			DISK_OUTPUT.push_back("WARNING: " + local_path + " failed the throughput check, skipping it");
+			continue;
 		}
+		usable.push_back(local_path);
+		total_ttf += ttf;
 	}
-	// String cases
-	else if (
-		name == "KV_QUIT"
-		|| name == "KV_RUN"
-		|| name == "KV_LEFT"
-		|| name == "KV_RIGHT"
-		|| name == "KV_UP"
-		|| name == "KV_DOWN"
-		|| name == "KV_STOP"
-		|| name == "KV_REFRESH"
-		|| name == "KV_S_UP_UP"
-		|| name == "KV_S_DOWN_DOWN"
-		|| name == "KV_S_UP"
-		|| name == "KV_S_DOWN"
-		|| name == "KV_ISO"
-		|| name == "RPI_EX"
-		|| name == "DRIVE_NAME"
-		) {
-		if (name == "KV_QUIT") {
-			KV_QUIT = value;
-		} else if (name == "KV_RUN") {
-			KV_RUN = value;
-		} else if (name == "KV_LEFT") {
-			KV_LEFT = value;
-		} else if (name == "KV_RIGHT") {
-			KV_RIGHT = value;
-		} else if (name == "KV_UP") {
-			KV_UP = value;
-		} else if (name == "KV_DOWN") {
-			KV_DOWN = value;
-		} else if (name == "KV_STOP") {
-			KV_STOP = value;
-		} else if (name == "KV_REFRESH") {
-			KV_REFRESH = value;
-		} else if (name == "KV_S_UP_UP") {
-			KV_S_UP_UP = value;
-		} else if (name == "KV_S_DOWN_DOWN") {
-			KV_S_DOWN_DOWN = value;
-		} else if (name == "KV_S_UP") {
-			KV_S_UP = value;
-		} else if (name == "KV_S_DOWN") {
-			KV_S_DOWN = value;
-		} else if (name == "KV_ISO") {
-			KV_ISO = value;
-		} else if (name == "RPI_EX") {
-			RPI_EX = value;
-		} else if (name == "DRIVE_NAME") {
-			DRIVE_NAME = value;
-		}
-	} else {
-		std::cerr << "Did not recognize entry " << name << " in config file, skipping" << std::endl;
-	}
+	
+	if (!found_any) {
+		std::cout << "1" << std::endl;
+		notify_handler("LunAero Error", "Could not find a drive mounted at " + DRIVE_LIST[0]);
+		return 3;
+	} else if (usable.empty()) {
+		notify_handler("LunAero Error", "The space on every drive is too low to record");
+		return 2;
+	} else if (usable.size() < DRIVE_LIST.size()) {
+		notify_handler("LunAero Warning", "Only "
+		+ std::to_string(usable.size())
+		+ " of "
+		+ std::to_string(DRIVE_LIST.size())
+		+ " drives can be used.  Check the log for details.");
+	}
+	if (total_ttf < DISK_WARN_TIME) {
+		notify_handler("LunAero Warning", "The drives only have room for about "
+		+ std::to_string((int)total_ttf / 60)
+		+ " minutes of video.");
+	}
+	DRIVE_LIST = usable;
+	{
+		std::lock_guard <std::mutex> lock(FILEPATH_MUTEX);
+		DEFAULT_FILEPATH = DRIVE_LIST[0] + "/";
+	}
+	DISK_OUTPUT.push_back("Forecast write rate: " + std::to_string((long)disk_forecast_rate()) + " B/s");
+	DISK_OUTPUT.push_back("Forecast session recording time: " + std::to_string((long)total_ttf) + " s");
 	return 0;
 }
 
 /**
- * This function is called to create a default settings config file.  Creates the file in the current
- * working directory as ./settings.cfg.  If the file at that path after writing is smaller than 2kb,
- * this function returns an error status.
+ * This function writes one step of the startup timeline to the log.  Times are milliseconds since
+ * log_init, which is the first thing main does, so steps from every process and thread line up.
  *
- * @return status
+ * @param name name of the startup step
+ * @param start log_now when the step began
  */
-int create_default_config() {
-	std::string config_loc = "./settings.cfg";
-	std::ofstream config_file;
-	config_file.open(config_loc);
-	config_file
-	<< "############# settings #############" << std::endl
-	<< "#                                  #" << std::endl
-	<< "#         part of LunAero_C        #" << std::endl
-	<< "#     Wesley T. Honeycutt, 2020    #" << std::endl
-	<< "#                                  #" << std::endl
-	<< "#   Comment lines with octothorpe  #" << std::endl
-	<< "# Code lines must be \\n terminated #" << std::endl
-	<< "#                                  #" << std::endl
-	<< "####################################" << std::endl << std::endl
-	<< "### General settings" << std::endl << std::endl
-	<< "# Save log with debugging output (prints everything verbose)" << std::endl
-	<< "DEBUG_COUT = true" << std::endl << std::endl
-	<< "# Duration to record video before starting a new one (in seconds)" << std::endl
-	<< "RECORD_DURATION = 1800" << std::endl
-	<< ""
-	<< "# The name given to your external storage drive for videos" << std::endl
-	<< "DRIVE_NAME = MOON1" << std::endl
-	<< ""
-	<< "# Should LunAero save a screenshot from the raspivid output every cycle?" << std::endl
-	<< "# It will be saved to to /your/path/out.ppm" << std::endl
-	<< "SAVE_DEBUG_IMAGE = false" << std::endl << std::endl << std::endl << std::endl << std::endl
-	<< "### Keybindings" << std::endl
-	<< "# If you want to use non-alphabetic keys, check to see what the key value is called before editing." << std::endl << std::endl
-	<< "# Keybinding for quit command" << std::endl
-	<< "KV_QUIT = q" << std::endl << std::endl
-	<< "# Keybinding for beginning the recording/entering automatic mode" << std::endl
-	<< "KV_RUN = Return" << std::endl << std::endl
-	<< "# Keybinding for left manual motor movement." << std::endl
-	<< "KV_LEFT = Left" << std::endl << std::endl
-	<< "# Keybinding for right manual motor movement." << std::endl
-	<< "KV_RIGHT = Right" << std::endl << std::endl
-	<< "# Keybinding for up manual motor movement." << std::endl
-	<< "KV_UP = Up" << std::endl << std::endl
-	<< "# Keybinding for down manual motor movement." << std::endl
-	<< "KV_DOWN = Down" << std::endl << std::endl
-	<< "# Keybinding for motor stop command." << std::endl
-	<< "KV_STOP = space" << std::endl << std::endl
-	<< "# Keybinding for raspivid refresh command." << std::endl
-	<< "KV_REFRESH = z" << std::endl << std::endl
-	<< "# Keybinding for greatly increasing the shutter speed." << std::endl
-	<< "KV_S_UP_UP = g" << std::endl << std::endl
-	<< "# Keybinding for greatly decreasing the shutter speed." << std::endl
-	<< "KV_S_DOWN_DOWN = b" << std::endl << std::endl
-	<< "# Keybinding for increasing the shutter speed." << std::endl
-	<< "KV_S_UP = h" << std::endl << std::endl
-	<< "# Keybinding for decreasing the shutter speed." << std::endl
-	<< "KV_S_DOWN = n" << std::endl << std::endl
-	<< "# Keybinding for cycling the ISO value." << std::endl
-	<< "KV_ISO = i" << std::endl << std::endl << std::endl << std::endl << std::endl
-	<< "### GUI settings" << std::endl << std::endl
-	<< "# Modifier value which effects the font size automatically determined for the GTK window" << std::endl
-	<< "FONT_MOD = 20" << std::endl << std::endl
-	<< "# Number of milliseconds an emergency message should remain on the desktop before disappearing in the" << std::endl
-	<< "# event of certain crash conditions." << std::endl
-	<< "EMG_DUR = 10" << std::endl << std::endl << std::endl << std::endl
-	<< "### Image processing settings" << std::endl << std::endl
-	<< "# Divisor for the number pixels on the top and bottom edges to warrant a move.  Bigger is more sensitive." << std::endl
-	<< "EDGE_DIVISOR_W = 20" << std::endl << std::endl
-	<< "# Divisor for the number pixels on the left and right edges to warrant a move.  Bigger is more sensitive." << std::endl
-	<< "EDGE_DIVISOR_H = 20" << std::endl << std::endl
-	<< "# Frequency which the automatic edge detection should occur.  This is a value roughly in milliseconds," << std::endl
-	<< "# dependent on the cycle time of the processor." << std::endl
-	<< "# WARNING Editing this value changes a bunch of behaviors.  You can touch it, but be careful." 
-	<< std::endl
-	<< "FRAMECHECK_FREQ = 50" << std::endl << std::endl << std::endl << std::endl
-	<< "### Raspivid and Camera settings" << std::endl << std::endl
-	<< "# Number of MMAL errors encountered in a row before LunAero should crash with an error because something" << std::endl
-	<< "# has gone wrong with the hardware." << std::endl
-	<< "MMAL_ERROR_THRESH = 100" << std::endl << std::endl
-	<< "# Recording framerate of the raspivid command" << std::endl
-	<< "RPI_FPS = 30" << std::endl << std::endl
-	<< "# Recording bitrate for raspivid command" << std::endl
-	<< "RPI_BR = 8000000" << std::endl << std::endl
-	<< "# Recording exposure mode for raspivid command.  Use a string from this list:" << std::endl
-	<< "# auto: use automatic exposure mode" << std::endl
-	<< "# night: select setting for night shooting" << std::endl
-	<< "# nightpreview:" << std::endl
-	<< "# backlight: select setting for backlit subject" << std::endl
-	<< "# spotlight:" << std::endl
-	<< "# sports: select setting for sports (fast shutter etc.)" << std::endl
-	<< "# snow: select setting optimised for snowy scenery" << std::endl
-	<< "# beach: select setting optimised for beach" << std::endl
-	<< "# verylong: select setting for long exposures" << std::endl
-	<< "# fixedfps: constrain fps to a fixed value" << std::endl
-	<< "# antishake: antishake mode" << std::endl
-	<< "# fireworks: select setting optimised for fireworks" << std::endl
-	<< "RPI_EX = auto" << std::endl << std::endl
-	<< "# Value to adjust the shutter speed when using up or down buttons." << std::endl
-	<< "SHUT_JUMP = 100" << std::endl << std::endl
-	<< "# Value to adjust the shutter speed when using the up-up or down-down buttons." << std::endl
-	<< "# Should be greater than SHUT_JUMP" << std::endl
-	<< "SHUT_JUMP_BIG = 1000" << std::endl << std::endl
-	<< "# Threshold value for number of cycles the moon is \"lost\" for" << std::endl
-	<< "LOST_THRESH = 30" << std::endl << std::endl << std::endl << std::endl
-	<< "### Motor and Speed settings" << std::endl << std::endl
-	<< "# Number of seconds the left-right motor should force high speed movement to compensate for loose" << std::endl
-	<< "# laser cut gears." << std::endl
-	<< "LOOSE_WHEEL_DURATION = 2" << std::endl << std::endl
-	<< "# PWM operation frequency in Hz" << std::endl
-	<< "FREQ = 10000" << std::endl << std::endl
-	<< "# Minimum allowable PWM duty cycle. Must be integer. Units are percent." << std::endl
-	<< "# This value does not impact the speed during manual mode." << std::endl
-	<< "MIN_DUTY = 20" << std::endl << std::endl
-	<< "# Maximum allowable PWM duty cycle.  Must be integer.  Units are percent." << std::endl
-	<< "# This value does not impact the speed during manual mode." << std::endl
-	<< "MAX_DUTY = 75" << std::endl << std::endl
-	<< "# Duty cycle threshold for slower braking of motors during the run.  Must be integer.  Units are percent." << std::endl
-	<< "# This value does not impact braking during manual mode" << std::endl
-	<< "BRAKE_DUTY = 10" << std::endl << std::endl << std::endl << std::endl
-	<< "### Rasperry Pi GPIO Pin setup" << std::endl << std::endl
-	<< "# Raspberry Pi GPIO pin for motor A Soft PWM.  BCM equivalent of 0 = 17" << std::endl
-	<< "APINP = 0" << std::endl << std::endl
-	<< "# Raspberry Pi GPIO pin for motor A 1 pin.  BCM equivalent of 2 = 27" << std::endl
-	<< "APIN1 = 2" << std::endl << std::endl
-	<< "# Raspberry Pi GPIO pin for motor A 2 pin.  BCM equivalent of 3 = 22" << std::endl
-	<< "APIN2 = 3" << std::endl << std::endl
-	<< "# Raspberry Pi GPIO pin for motor B 1 pin.  BCM equivalent of 12 = 10" << std::endl
-	<< "BPIN1 = 12" << std::endl << std::endl
-	<< "# Raspberry Pi GPIO pin for motor B 2 pin.  BCM equivalent of 13 = 9" << std::endl
-	<< "BPIN2 = 13" << std::endl << std::endl
-	<< "# Raspberry Pi GPIO pin for motor A Soft PWM.  BCM equivalent of 14 = 11" << std::endl
-	<< "BPINP = 14" << std::endl;
-	
-	config_file.close();
-	
-	if (std::filesystem::file_size(config_loc) < 2000) {
-		return 1;
-	} else {
-		return 0;
-	}
+void startup_step(std::string name, uint64_t start) {
+	uint64_t end = log_now();
+	char line[128];
+	snprintf(line, sizeof(line), "startup: %-16s %8.1f ms -> %8.1f ms  (%7.1f ms)", name.c_str(),
+		(start - LOG_EPOCH) / 1e6, (end - LOG_EPOCH) / 1e6, (end - start) / 1e6);
+	LOG_INFO(line);
 }
 
 /**
@@ -1037,13 +600,18 @@ int create_default_config() {
  */
 int main (int argc, char **argv) {
 	
-	if (startup_disk_check()) {
-		return 1;
+	// Log rings must exist before anything is logged or any thread is started
+	log_init();
+	
+	for (int i=1; i<argc; i++) {
+		if (strcmp(argv[i], "--headless") == 0) {
+			HEADLESS = true;
+		}
 	}
 	
 	// Parse config file
-	std::string config_file = "./settings.cfg";
-	std::ifstream cFile (config_file);
+	uint64_t step_start = log_now();
+	std::string config_file = SETTINGS_PATH;
 	if (access(config_file.c_str(), R_OK) < 0) {
 		std::cerr << "WARNING: default settings file is not readable, creating for you." << std::endl;
 		if (create_default_config()) {
@@ -1053,244 +621,187 @@ int main (int argc, char **argv) {
 		}
 		
 	}
-	if (cFile.is_open()) {
-		std::string line;
-		while(getline(cFile, line)){
-			line.erase(std::remove_if(line.begin(), line.end(), isspace), line.end());
-			if(line[0] == '#' || line.empty()) {
-				continue;
-			}
-			auto delimiter_pos = line.find("=");
-			std::string name = line.substr(0, delimiter_pos);
-			std::string value = line.substr(delimiter_pos + 1);
-			if (parse_checklist(name, value)) {
-				return 1;
-			}
-		}
-	}
-	else {
-		notify_handler("LunAero Error", "Couldn't open config file for reading.");
+	if (settings_load(config_file)) {
 		return 1;
 	}
+	startup_step("settings", step_start);
+	
+	// The remaining startup steps do not depend on each other, so the slow drive check runs alongside
+	// the rest.  The disk forecast depends on DRIVE_NAME and RPI_BR, so it starts after parsing.
+	int disk_status = 0;
+	std::thread disk_thread([&disk_status]() {
+		uint64_t start = log_now();
+		disk_status = startup_disk_check();
+		startup_step("disk check", start);
+	});
+	std::thread luid_thread([]() {
+		uint64_t start = log_now();
+		read_luid();
+		startup_step("cpu serial", start);
+	});
+	// Screensaver settings for the raspberry pi
+	std::thread xset_thread([]() {
+		uint64_t start = log_now();
+		if (!HEADLESS) {
+			system("xset -dpms");
+			system("xset s off");
+		}
+		startup_step("xset", start);
+	});
+	// GTK is initialised on the main thread, which later runs the GUI.  Headless runs never touch GTK.
+	step_start = log_now();
+	int screen_status = 0;
+	if (HEADLESS) {
+		screen_status = headless_screen_size();
+	} else {
+		gtk_class::css_string = get_css_string();
+	}
+	startup_step("screen size", step_start);
+	disk_thread.join();
+	luid_thread.join();
+	xset_thread.join();
 	
+	if (disk_status || screen_status) {
+		if (!HEADLESS) {
+			system("xset +dpms");
+			system("xset s on");
+		}
+		return 1;
+	}
 	
 	// Make folder for stuff
+	step_start = log_now();
 	TSBUFF = current_time(0);
+	SESSION_TS = TSBUFF;
 	FILEPATH = DEFAULT_FILEPATH + TSBUFF;
 	mkdir(FILEPATH.c_str(), 0700);
+	MANIFEST_PATH = FILEPATH + "/manifest.txt";
 	
 	if (DEBUG_COUT) {
 		LOGOUT = FILEPATH + "/log.log";
-		LOGGING.open(LOGOUT);
-		LOGGING.close();
+	}
+	if (TELEMETRY) {
+		TELEMOUT = FILEPATH + "/telemetry.lat";
 	}
 	
 	// Add startup disk check messages to log file
-	if (DEBUG_COUT) {
-		LOGGING.open(LOGOUT, std::ios_base::app);
-		LOGGING
-		<< DISK_OUTPUT[0]
-		<< std::endl
-		<< DISK_OUTPUT[1]
-		<< std::endl;
-		LOGGING.close();
+	for (unsigned int i=0; i<DISK_OUTPUT.size(); i++) {
+		LOG_INFO(DISK_OUTPUT[i]);
 	}
 	
-	if (DEBUG_COUT) {
-		LOGGING.open(LOGOUT, std::ios_base::app);
-		LOGGING
-		<< "time: " << TSBUFF << std::endl
-		<< "path: " << FILEPATH << std::endl;
-		LOGGING.close();
+	LOG_INFO("time: " << TSBUFF << std::endl
+		<< "path: " << FILEPATH);
+	
+	// Start the manifest with the drives available to this session
+	std::ofstream manifest;
+	manifest.open(MANIFEST_PATH);
+	for (unsigned int i=0; i<DRIVE_LIST.size(); i++) {
+		manifest << "# drive " << i << ": " << DRIVE_LIST[i] << std::endl;
 	}
-		
-	// Screensaver settings for the raspberry pi
-	system("xset -dpms");
-	system("xset s off");
+	manifest << "# segment\tdrive\tpath\tUTC start" << std::endl;
+	manifest.close();
 	
 	int status = 0;
 	
-	// init SUBS semaphore
-	sem_init(&LOCK, 1, 1);
-	
 	// Make ID file
 	if (create_id_file()) {
-		if (DEBUG_COUT) {
-			LOGGING.open(LOGOUT, std::ios_base::app);
-			LOGGING
-			<< "ERROR: Failed to create ID file" << std::endl;
-			LOGGING.close();
-		}
-	}
-	
-	// Memory values which influence camera commands. Defaults to 0.
-	val_ptr.LOST_COUNTERaddr = (int *)(mmap(NULL, sizeof(int), PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS, -1, 0));
-	val_ptr.ISO_VALaddr = (int *)(mmap(NULL, sizeof(int), PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS, -1, 0));
-	val_ptr.SHUTTER_VALaddr = (int *)(mmap(NULL, sizeof(int), PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS, -1, 0));
-	val_ptr.RUN_MODEaddr = (int *)(mmap(NULL, sizeof(int), PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS, -1, 0));
-	val_ptr.REFRESH_CAMaddr = (int *)(mmap(NULL, sizeof(int), PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS, -1, 0));
-	
-	// Memory values which influence motor commands.
-	val_ptr.HORZ_DIRaddr = (int *)(mmap(NULL, sizeof(int), PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS, -1, 0));
-	val_ptr.VERT_DIRaddr = (int *)(mmap(NULL, sizeof(int), PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS, -1, 0));
-	val_ptr.STOP_DIRaddr = (int *)(mmap(NULL, sizeof(int), PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS, -1, 0));
-	val_ptr.DUTY_Aaddr = (int *)(mmap(NULL, sizeof(int), PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS, -1, 0));
-	val_ptr.DUTY_Baddr = (int *)(mmap(NULL, sizeof(int), PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS, -1, 0));
-	val_ptr.SUBSaddr = (int *)(mmap(NULL, sizeof(int), PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS, -1, 0));
-	
-	// Memory value which tells the program to continue running.
-	val_ptr.ABORTaddr = (int *)(mmap(NULL, sizeof(int), PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS, -1, 0));
-	
-	// Assign initial values to mmap'd variables
+		LOG_ERROR("ERROR: Failed to create ID file");
+	}
+	startup_step("session files", step_start);
+	
+	// Share analysed frames with other programs, sized for the region checked by current_frame
+	step_start = log_now();
+	shm_init(RVD_WIDTH, RVD_HEIGHT);
+	startup_step("frame ring", step_start);
+	
+	// Values shared between threads which influence camera commands. Defaults to 0.
+	val_ptr.LOST_COUNTERaddr = new std::atomic <int> (0);
+	val_ptr.ISO_VALaddr = new std::atomic <int> (0);
+	val_ptr.SHUTTER_VALaddr = new std::atomic <int> (0);
+	val_ptr.RUN_MODEaddr = new std::atomic <int> (0);
+	
+	// Values shared between threads which influence motor commands.
+	val_ptr.HORZ_DIRaddr = new std::atomic <int> (0);
+	val_ptr.VERT_DIRaddr = new std::atomic <int> (0);
+	val_ptr.STOP_DIRaddr = new std::atomic <int> (0);
+	val_ptr.DUTY_Aaddr = new std::atomic <int> (0);
+	val_ptr.DUTY_Baddr = new std::atomic <int> (0);
+	val_ptr.DRIVE_INDEXaddr = new std::atomic <int> (0);
+	val_ptr.PREALLOC_MBaddr = new std::atomic <int> (0);
+	val_ptr.SEGMENTaddr = new std::atomic <int> (0);
+	
+	// Value which tells every thread to continue running.
+	val_ptr.ABORTaddr = new std::atomic <int> (0);
+	
+	// Assign initial values to shared variables
 	*val_ptr.LOST_COUNTERaddr = 0;
 	*val_ptr.ISO_VALaddr = 200;
 	*val_ptr.SHUTTER_VALaddr = 10000;
 	*val_ptr.RUN_MODEaddr = 0;
-	*val_ptr.REFRESH_CAMaddr = 0;
 	*val_ptr.HORZ_DIRaddr = 0;
 	*val_ptr.VERT_DIRaddr = 0;
 	*val_ptr.STOP_DIRaddr = 0;
 	*val_ptr.DUTY_Aaddr = 100;
 	*val_ptr.DUTY_Baddr = 100;
-	*val_ptr.SUBSaddr = 0;
+	*val_ptr.DRIVE_INDEXaddr = 0;
+	*val_ptr.PREALLOC_MBaddr = 0;
+	*val_ptr.SEGMENTaddr = 0;
 	*val_ptr.ABORTaddr = 0;
-	
-	int pid1 = fork();
-	
-	if (pid1 > 0) {
-		// Parent process 1
-		// Prep the GPIO
-		gpio_pin_setup();
-		// Handle motor commands
-		while (*val_ptr.ABORTaddr == 0) {
-			motor_handler();
-			usleep(50000);
-		}
-		// Stop everything
-		final_stop();
-
-		if (DEBUG_COUT) {
-			LOGGING.open(LOGOUT, std::ios_base::app);
-			LOGGING
-			<< "waiting for child exit signal 2" << std::endl;
-			LOGGING.close();
-		}
-		wait(0);
-		if (DEBUG_COUT) {
-			LOGGING.open(LOGOUT, std::ios_base::app);
-			LOGGING
-			<< "caught second wait" << std::endl;
-			LOGGING.close();
-		}
+	disk_use_drive(0);
+	
+	// Start the workers.  The GUI runs on the main thread, where GTK was initialised.
+	STARTUP_SPAWN = log_now();
+	log_start_flusher();
+	settings_watch();
+	if (!HEADLESS) {
+		gui_events_init();
+	}
+	std::thread motor_thread(motor_loop);
+	std::thread camera_thread(camera_loop);
+	std::thread capture_thread(capture_loop);
+	std::thread analysis_thread(analysis_loop);
+	wd_start();
+	metrics_start();
+	control_start();
+	
+	if (HEADLESS) {
+		signal(SIGINT, headless_signal);
+		signal(SIGTERM, headless_signal);
+		headless_loop();
 	} else {
-		// Child process 1
-		int pid2 = fork();
-		if (pid2 > 0) {
-			// Parent Process 2
-			if (DEBUG_COUT) {
-				LOGGING.open(LOGOUT, std::ios_base::app);
-				LOGGING
-				<< "started child proc 2" << std::endl;
-				LOGGING.close();
-			}
-			camera_preview();
-			sem_wait(&LOCK);
-			*val_ptr.RUN_MODEaddr = 0;
-			sem_post(&LOCK);
-			while ((*val_ptr.ABORTaddr == 0) && (*val_ptr.RUN_MODEaddr == 0)) {
-				usleep(50);
-			}
-			sem_wait(&LOCK);
-			*val_ptr.RUN_MODEaddr = 1;
-			sem_post(&LOCK);
-			while ((*val_ptr.ABORTaddr == 0) && (*val_ptr.RUN_MODEaddr == 1)) {
-				auto current_time = std::chrono::system_clock::now();
-				std::chrono::duration<double> elapsed_seconds = current_time-OLD_RECORD_TIME;
-				if (elapsed_seconds > RECORD_DURATION) {
-					if (DEBUG_COUT) {
-						LOGGING.open(LOGOUT, std::ios_base::app);
-						LOGGING
-						<< "refreshing camera" << std::endl;
-						LOGGING.close();
-					}
-					sem_wait(&LOCK);
-					OLD_RECORD_TIME = std::chrono::system_clock::now();
-					*val_ptr.SUBSaddr = 2;
-					sem_post(&LOCK);
-				}
-				// This doesn't have to be super accurate, so only do it every 5 seconds
-				usleep(5000000);
-			}
-			if (DEBUG_COUT) {
-				LOGGING.open(LOGOUT, std::ios_base::app);
-				LOGGING
-				<< "caught abort code: "
-				<< *val_ptr.ABORTaddr
-				<< " run mode: "
-				<< *val_ptr.RUN_MODEaddr
-				<< std::endl;
-				LOGGING.close();
-			}
-			kill_raspivid();
-			
-			if (DEBUG_COUT) {
-				LOGGING.open(LOGOUT, std::ios_base::app);
-				LOGGING
-				<< "waiting for child exit signal 1" << std::endl;
-				LOGGING.close();
-			}
-			wait(0);
-			if (DEBUG_COUT) {
-				LOGGING.open(LOGOUT, std::ios_base::app);
-				LOGGING
-				<< "caught first wait" << std::endl;
-				LOGGING.close();
-			}
-			
-			if (DEBUG_COUT) {
-				LOGGING.open(LOGOUT, std::ios_base::app);
-				LOGGING
-				<< "SIGCHLD camera" << std::endl;
-				LOGGING.close();
-			}
-			exit(SIGCHLD);
-		} else {
-			// child process of 2
-			// Init app
-			if (DEBUG_COUT) {
-				LOGGING.open(LOGOUT, std::ios_base::app);
-				LOGGING
-				<< "preparing app" << std::endl;
-				LOGGING.close();
-			}
-			//~ int LOST_COUNTER = 0;
-			gtk_class::app = gtk_application_new("org.gtk.example", G_APPLICATION_FLAGS_NONE);
-			g_signal_connect(gtk_class::app, "activate", G_CALLBACK (activate), NULL);
-			status = g_application_run(G_APPLICATION(gtk_class::app), argc, argv);
-
-			// Cleanup GTK
-			g_object_unref(gtk_class::app);
-			
-			if (DEBUG_COUT) {
-				LOGGING.open(LOGOUT, std::ios_base::app);
-				LOGGING
-				<< "SIGCHLD gtk" << std::endl;
-				LOGGING.close();
-			}
-			exit(SIGCHLD);
-		}
-	}
-	
-	if (DEBUG_COUT) {
-		LOGGING.open(LOGOUT, std::ios_base::app);
-		LOGGING
-		<< "closing program" << std::endl;
-		LOGGING.close();
-	}
+		LOG_INFO("preparing app");
+		gtk_class::app = gtk_application_new("org.gtk.example", G_APPLICATION_FLAGS_NONE);
+		g_signal_connect(gtk_class::app, "activate", G_CALLBACK (activate), NULL);
+		status = g_application_run(G_APPLICATION(gtk_class::app), argc, argv);
+		
+		// Cleanup GTK
+		g_object_unref(gtk_class::app);
+	}
+	
+	// Closing the window any other way also stops the workers
+	abort_code();
+	camera_thread.join();
+	LOG_INFO("joined camera thread");
+	capture_thread.join();
+	analysis_thread.join();
+	frame_pool_free();
+	LOG_INFO("joined capture and analysis threads");
+	motor_thread.join();
+	LOG_INFO("joined motor thread");
+	wd_stop();
+	metrics_stop();
+	control_stop();
+	shm_close();
+	
+	LOG_INFO("closing program");
+	// Every worker has been joined, so write out the rest of the log
+	log_stop_flusher();
 	
 	// Undo our screensaver settings
-	system("xset +dpms");
-	system("xset s on");
+	if (!HEADLESS) {
+		system("xset +dpms");
+		system("xset s on");
+	}
 	
 	return status;
 }
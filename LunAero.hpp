@@ -28,6 +28,9 @@
 #include <iostream>
 #include <cstdlib>         // provides c++ version of getenv
 #include <chrono>          // provides C++ chrono
+#include <thread>          // provides std::thread
+#include <atomic>          // provides std::atomic
+#include <mutex>           // provides std::mutex
 #include <ctime>           // provides c time funcitons for chrono usage
 #include <vector>
 using std::vector;
@@ -40,24 +43,42 @@ using namespace cv;
 
 // Module specific Includes
 #include <signal.h>        // provides kill signals
-#include <semaphore.h>     // provides sem_init
 #include <stdlib.h>        // provides system
 #include <stdio.h>         // provides popen
-#include <sys/mman.h>      // provides mmap
 #include <sys/stat.h>      // provides mkdir
 #include <sys/types.h>     // provides kill
-#include <sys/wait.h>      // provides wait
 #include <time.h>          // provides time
 #include <unistd.h>        // provides usleep
 #include <filesystem>      // provides filesystem space info
 #include <libnotify/notify.h> // provides notify functions
 
 // User Includes
+#include "log_LunAero.hpp"
+#include "telemetry_LunAero.hpp"
 #include "gtk_LunAero.hpp"
 #include "motors_LunAero.hpp"
+#include "queue_LunAero.hpp"
 #include "camera_LunAero.hpp"
+#include "disk_LunAero.hpp"
+#include "writer_LunAero.hpp"
+#include "settings_LunAero.hpp"
+#include "shm_LunAero.hpp"
+#include "watchdog_LunAero.hpp"
+#include "metrics_LunAero.hpp"
+#include "control_LunAero.hpp"
+#include "analysis_LunAero.hpp"
+#include "exposure_LunAero.hpp"
+#include "limb_LunAero.hpp"
+#include "blob_LunAero.hpp"
 
 
+// Global Defined Constants
+/**
+ * Milliseconds the headless main loop sleeps while there are no frames to check.  Commands from the
+ * command socket wake it straight away.
+ */
+#define HEADLESS_POLL_MS 50
+
 /*
  * Recording duration in seconds.  Customizable from settings.cfg.  Default 1800.
  */
@@ -92,31 +113,33 @@ inline int RVD_YCORN = 0;
  * Divisor for the number pixels on the top and bottom edges to warrant a move.  Customizable from
  * settings.cfg.
  */
-inline int EDGE_DIVISOR_W = 20;
+inline std::atomic<int> EDGE_DIVISOR_W = 20;
 /**
  * Divisor for the number pixels on the left and right edges to warrant a move.  Customizable from
  * settings.cfg.
  */
-inline int EDGE_DIVISOR_H = 20;
+inline std::atomic<int> EDGE_DIVISOR_H = 20;
 /**
- * Brightness value between 0-255 to act as the threshold for raw brightness tests.  Customizable from
- * settings.cfg.
+ * Brightness value between 0-255 to act as the threshold for raw brightness tests.  Auto exposure
+ * counts moon pixels at or above it as clipped.  Customizable from settings.cfg.
  */
-inline int RAW_BRIGHT_THRESH = 240;
+inline std::atomic<int> RAW_BRIGHT_THRESH = 240;
 /**
  * Threshold value for the brightness tests.  Outcome of the brightness tests must be below this value,
  * otherwise the image is deemed "too bright" because the birds might get hidden by the lunar albedo.
+ * Auto exposure shortens the exposure when a larger fraction of the moon than this is clipped.
  * Customizable from settings.cfg
  */
-inline float BRIGHT_THRESH = 0.001;
+inline std::atomic<float> BRIGHT_THRESH = 0.001;
 /**
- * Drive name given to the external video storage drive.  Customizable from settings.cfg.
+ * Drive name given to the external video storage drive.  May be a comma separated list of drive names
+ * or absolute mount points which are filled in order.  Customizable from settings.cfg.
  */
 inline std::string DRIVE_NAME = "MOON1";
 /**
  * Number of cycles the moon is lost for before stopping LunAero.  Customizable from settings.cfg.
  */
-inline int LOST_THRESH = 30;
+inline std::atomic<int> LOST_THRESH = 30;
 /**
  * Milliseconds an emergency messeage should remain on the desktop in event of a crash.  Customizable
  * from settings.cfg
@@ -125,13 +148,15 @@ inline int EMG_DUR = 10000;
 /**
  * Should LunAero save a ppm file of the current raspivid screenshot?
  */
-inline bool SAVE_DEBUG_IMAGE = false;
+inline std::atomic<bool> SAVE_DEBUG_IMAGE = false;
 
 
 inline vector <float> BLUR_BRIGHT;
 
 inline std::string FILEPATH;
 inline std::string DEFAULT_FILEPATH = "";
+// Held while DEFAULT_FILEPATH is changed, and by threads other than the camera thread while reading it
+inline std::mutex FILEPATH_MUTEX;
 inline std::string TSBUFF;
 inline std::string IDPATH = "";
 inline std::chrono::time_point OLD_RECORD_TIME = std::chrono::system_clock::now();
@@ -139,85 +164,99 @@ inline bool DEBUG_COUT = false;
 inline std::string DEBUG_LOG;
 inline vector <std::string> DISK_OUTPUT;
 inline std::string LOGOUT;
-inline std::ofstream LOGGING;
-
-/*
- * Semaphore int to lock processes across forks.  Do not touch.
+/**
+ * Processor serial number of the Raspberry Pi, used to name the ID file.
+ */
+inline std::string LUID = "";
+/**
+ * Run without GTK or X.  Selected by starting LunAero with --headless.  The preview is placed from the
+ * size of the display raspivid draws on, and LunAero is controlled through the command socket.
  */
-inline sem_t LOCK;
+inline bool HEADLESS = false;
+/**
+ * log_now when the worker threads were started, from which the startup steps of each thread are timed.
+ */
+inline uint64_t STARTUP_SPAWN = 0;
 
 /**
- * Struct of addresses used across forks to store important values.  Call these values with
+ * Struct of addresses used across threads to store important values.  Call these values with
  * the prototype: *val_ptr.EXAMPLEaddr.  These are declared inline across cpp files, requiring C++17.
  */
 inline struct val_addresses {
 	/**
 	 * Counter of the number of cycles the moon has been lost.
 	 */
-	volatile int * LOST_COUNTERaddr;
+	std::atomic <int> * LOST_COUNTERaddr;
 	/**
 	 * Value of ISO selected by the user.  Valid values (100, 200, 400, 800)
 	 */
-	volatile int * ISO_VALaddr;
+	std::atomic <int> * ISO_VALaddr;
 	/**
 	 * Value of the shutter speed selected by the user.  Minimum and maximum values are determined by the
 	 * hardware and limited further by code.
 	 */
-	volatile int * SHUTTER_VALaddr;
+	std::atomic <int> * SHUTTER_VALaddr;
 	/**
 	 * Value of the current run mode.  Valid values are 0 for preview/manual mode and 1 for
 	 * recording/automatic mode
 	 */
-	volatile int * RUN_MODEaddr;
-	/**
-	 * Flag to sync abort functions across code forks.  If 0, run.  If 1, abort.
-	 */
-	volatile int * ABORTaddr;
+	std::atomic <int> * RUN_MODEaddr;
 	/**
-	 * Flag to sync camera refreshes across forks.  If 0, do nothing.  If 1, refresh.
+	 * Flag to sync abort functions across threads.  If 0, run.  If 1, abort.
 	 */
-	volatile int * REFRESH_CAMaddr;
+	std::atomic <int> * ABORTaddr;
 	/**
 	 * Horizontal motion to be applied to motor B. Values: 0 = none, 1 = left, 2 = right
 	 */
-	volatile int * HORZ_DIRaddr;
+	std::atomic <int> * HORZ_DIRaddr;
 	/**
 	 * Vertical motion to be applied to motor A.  Values: 0 = none, 1 = up, 2 = down
 	 */
-	volatile int * VERT_DIRaddr;
+	std::atomic <int> * VERT_DIRaddr;
 	/**
 	 * Stop motors selected by this flag.  Values: 0 = none, 1 = horizontal only, 2 = vertical only,
 	 * 3 = both motors.
 	 */
-	volatile int * STOP_DIRaddr;
+	std::atomic <int> * STOP_DIRaddr;
 	/**
 	 * Current duty cycle of motor A.  Valid values 0-100.
 	 */
-	volatile int * DUTY_Aaddr;
+	std::atomic <int> * DUTY_Aaddr;
 	/**
 	 * Current duty cycle of motor B.  Valid values 0-100.
 	 */
-	volatile int * DUTY_Baddr;
+	std::atomic <int> * DUTY_Baddr;
+	/**
+	 * Position in DRIVE_LIST of the drive currently receiving video.
+	 */
+	std::atomic <int> * DRIVE_INDEXaddr;
+	/**
+	 * MiB preallocated for the current segment by the writer which have not been written yet.
+	 */
+	std::atomic <int> * PREALLOC_MBaddr;
 	/**
-	 * Flag for telling the raspivid refresh algorithm if this the original run or subsequent runs being
-	 * refreshed to elicit appropriate behavior.
+	 * Number of video segments started in this run.
 	 */
-	volatile int * SUBSaddr;
+	std::atomic <int> * SEGMENTaddr;
 } val_ptr;
 
 // Declare Function Prototypes
+struct frame_buffer;
 int main (int argc, char **argv);
 int startup_disk_check();
-void cb_framecheck();
+void cb_framecheck(const frame_buffer *frame);
+void lost_check(int count);
 void cleanup();
 void kill_raspivid();
-void current_frame();
+void current_frame(const frame_buffer *frame);
+void read_luid();
 int create_id_file();
+void startup_step(std::string name, uint64_t start);
 std::string current_time(int gmt);
 //void frame_centroid();
 void abort_code();
+void headless_signal(int sig);
+void headless_loop();
 int notify_handler(std::string input1, std::string input2);
-int parse_checklist(std::string name, std::string value);
-int create_default_config();
 
 #endif
@@ -0,0 +1,478 @@
+/*
+ * C_LunAero/analysis_LunAero.cpp - Frame analysis thread functions for LunAero_C
+ * Copyright (C) <2020>  <Wesley T. Honeycutt>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "analysis_LunAero.hpp"
+
+/**
+ * This function allocates the screenshot buffers.  It is called each time recording starts, but only
+ * allocates when the display size has changed, so the buffers are reused for the whole run.
+ *
+ * @param width display width in pixels
+ * @param height display height in pixels
+ * @return status 0 on success, 1 if the buffers could not be allocated
+ */
+int frame_pool_init(int width, int height) {
+	std::lock_guard <std::mutex> lock(FRAME_MUTEX);
+	for (int i=0; i<FRAME_BUFFERS; i++) {
+		frame_buffer *frame = &FRAME_POOL[i];
+		if ((frame->pixels != NULL) && (frame->width == width) && (frame->height == height)) {
+			frame->state = FRAME_FREE;
+			continue;
+		}
+		free(frame->pixels);
+		frame->pixels = static_cast <unsigned char *> (calloc(1, (size_t)width * 3 * height));
+		if (frame->pixels == NULL) {
+			LOG_ERROR("ERROR: failed to allocate screenshot buffers");
+			return 1;
+		}
+		frame->width = width;
+		frame->height = height;
+		frame->state = FRAME_FREE;
+	}
+	return 0;
+}
+
+/**
+ * This function frees the screenshot buffers.  It must only be called once the capture and analysis
+ * threads have stopped.
+ *
+ */
+void frame_pool_free() {
+	std::lock_guard <std::mutex> lock(FRAME_MUTEX);
+	for (int i=0; i<FRAME_BUFFERS; i++) {
+		free(FRAME_POOL[i].pixels);
+		FRAME_POOL[i].pixels = NULL;
+		FRAME_POOL[i].state = FRAME_FREE;
+	}
+}
+
+/**
+ * This function takes a free buffer for the capture thread to fill.
+ *
+ * @return frame buffer to fill, or NULL if every buffer is in use
+ */
+frame_buffer *frame_acquire() {
+	std::lock_guard <std::mutex> lock(FRAME_MUTEX);
+	for (int i=0; i<FRAME_BUFFERS; i++) {
+		if ((FRAME_POOL[i].pixels != NULL) && (FRAME_POOL[i].state == FRAME_FREE)) {
+			FRAME_POOL[i].state = FRAME_FILLING;
+			return &FRAME_POOL[i];
+		}
+	}
+	return NULL;
+}
+
+/**
+ * This function hands a filled buffer to the analysis thread.  Only the newest screenshot is kept, so
+ * one which the analysis thread has not started on yet is dropped in favour of this one.
+ *
+ * @param frame buffer from frame_acquire
+ */
+void frame_submit(frame_buffer *frame) {
+	{
+		std::lock_guard <std::mutex> lock(FRAME_MUTEX);
+		for (int i=0; i<FRAME_BUFFERS; i++) {
+			if (FRAME_POOL[i].state == FRAME_READY) {
+				FRAME_POOL[i].state = FRAME_FREE;
+				metric_add(METRICS.frames_dropped);
+			}
+		}
+		frame->state = FRAME_READY;
+	}
+	FRAME_CV.notify_one();
+}
+
+/**
+ * This function waits for the analysis thread's next screenshot.
+ *
+ * @param timeout longest time to wait
+ * @return frame buffer to analyse, or NULL if none arrived or the run is ending
+ */
+frame_buffer *frame_wait(std::chrono::milliseconds timeout) {
+	std::unique_lock <std::mutex> lock(FRAME_MUTEX);
+	frame_buffer *ready = NULL;
+	FRAME_CV.wait_for(lock, timeout, [&ready]{
+		for (int i=0; i<FRAME_BUFFERS; i++) {
+			if (FRAME_POOL[i].state == FRAME_READY) {
+				ready = &FRAME_POOL[i];
+			}
+		}
+		return (ready != NULL) || (*val_ptr.ABORTaddr != 0);
+	});
+	if ((ready == NULL) || (*val_ptr.ABORTaddr != 0)) {
+		return NULL;
+	}
+	ready->state = FRAME_BUSY;
+	return ready;
+}
+
+/**
+ * This function returns a buffer to the pool once it has been analysed, or if capture failed.
+ *
+ * @param frame buffer from frame_acquire or frame_wait
+ */
+void frame_release(frame_buffer *frame) {
+	std::lock_guard <std::mutex> lock(FRAME_MUTEX);
+	frame->state = FRAME_FREE;
+}
+
+/**
+ * This function wakes the analysis thread so it notices an abort straight away.
+ *
+ */
+void frame_wake() {
+	{
+		std::lock_guard <std::mutex> lock(FRAME_MUTEX);
+	}
+	FRAME_CV.notify_all();
+}
+
+/**
+ * This function creates the timer which paces the capture thread.  The timer runs on the monotonic
+ * clock from an absolute start, so lateness is measured against when each tick was due and not against
+ * when the previous screenshot happened to finish.
+ *
+ * @param first log_now of the first tick
+ * @param period nanoseconds between ticks
+ * @return fd timerfd, or -1 on failure
+ */
+int frame_timer_open(uint64_t first, uint64_t period) {
+	int fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+	if (fd < 0) {
+		LOG_ERROR("ERROR: failed to create the frame timer: " << strerror(errno));
+		return -1;
+	}
+	struct itimerspec spec;
+	spec.it_value.tv_sec = first / 1000000000;
+	spec.it_value.tv_nsec = first % 1000000000;
+	spec.it_interval.tv_sec = period / 1000000000;
+	spec.it_interval.tv_nsec = period % 1000000000;
+	if (timerfd_settime(fd, TFD_TIMER_ABSTIME, &spec, NULL) != 0) {
+		LOG_ERROR("ERROR: failed to start the frame timer: " << strerror(errno));
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+/**
+ * This function opens the DISPMANX display which raspivid draws its preview on, and creates the
+ * resource screenshots are taken into.  Both are kept open while recording, rather than opened for
+ * every screenshot.
+ *
+ * @return status 0 on success, 1 on failure
+ */
+int frame_grab_open() {
+	DISPMANX_MODEINFO_T info;
+	uint32_t vc_image_ptr;
+	
+	bcm_host_init();
+	FRAME_DISPLAY = vc_dispmanx_display_open(0);
+	if (vc_dispmanx_display_get_info(FRAME_DISPLAY, &info) != 0) {
+		LOG_ERROR("ERROR: failed to get display info");
+		telem_error(TELEM_ERR_DISPLAY, "failed to get display info");
+		return 1;
+	}
+	LOG_DEBUG("taking screenshots of " << info.width << " x " << info.height);
+	FRAME_RESOURCE = vc_dispmanx_resource_create(VC_IMAGE_RGB888, info.width, info.height, &vc_image_ptr);
+	if (!FRAME_RESOURCE) {
+		LOG_ERROR("ERROR: failed to create VC Dispmanx Resource");
+		return 1;
+	}
+	return frame_pool_init(info.width, info.height);
+}
+
+/**
+ * This function takes a screenshot of the preview into a buffer.  The DISPMANX screenshot is used, not
+ * the X window screenshot, since raspivid draws its preview straight to the display.
+ *
+ * @param frame buffer from frame_acquire
+ * @return status 0 on success, 1 if raspivid is not running
+ */
+int frame_grab(frame_buffer *frame) {
+	// The camera thread knows if raspivid is running, if not, print a warning
+	if (!RASPIVID_RUNNING) {
+		int lost = val_ptr.LOST_COUNTERaddr->fetch_add(1) + 1;
+		LOG_WARN("WARNING: lost moon counter increased to " 
+			<< lost 
+			<<  " cycles due to failure to find raspivid");
+		telem_error(TELEM_ERR_NO_RASPIVID, "raspivid is not running");
+		lost_check(lost);
+		return 1;
+	}
+	
+	VC_RECT_T rect;
+	frame->time_ns = log_now();
+	vc_dispmanx_snapshot(FRAME_DISPLAY, FRAME_RESOURCE, static_cast <DISPMANX_TRANSFORM_T> (0));
+	vc_dispmanx_rect_set(&rect, 0, 0, frame->width, frame->height);
+	vc_dispmanx_resource_read_data(FRAME_RESOURCE, &rect, frame->pixels, frame->width * 3);
+	metric_time(METRICS.capture, frame->time_ns);
+	return 0;
+}
+
+/**
+ * This function closes the DISPMANX resource and display opened by frame_grab_open.
+ *
+ */
+void frame_grab_close() {
+	if (FRAME_RESOURCE && (vc_dispmanx_resource_delete(FRAME_RESOURCE) != 0)) {
+		LOG_ERROR("ERROR: failed to delete vc resource");
+	}
+	FRAME_RESOURCE = 0;
+	if (FRAME_DISPLAY && (vc_dispmanx_display_close(FRAME_DISPLAY) != 0)) {
+		LOG_ERROR("ERROR: failed to close vc display");
+	}
+	FRAME_DISPLAY = 0;
+}
+
+/**
+ * This function finds the grey level which best splits a histogram into two classes with Otsu's
+ * method, by maximising the variance between the classes.  When the moon and sky are well apart every
+ * level in the gap between them scores the same, so the middle of the gap is taken.
+ *
+ * @param hist count of pixels at each grey level
+ * @param separation receives the share of the total variance explained by the split, between 0 and 1
+ * @return level highest grey level of the dark class
+ */
+int threshold_otsu(const uint32_t *hist, double &separation) {
+	uint64_t total = 0;
+	double sum = 0.;
+	double sum_sq = 0.;
+	for (int i=0; i<THRESH_LEVELS; i++) {
+		total += hist[i];
+		sum += (double)i * hist[i];
+		sum_sq += (double)i * i * hist[i];
+	}
+	separation = 0.;
+	if (total == 0) {
+		return 0;
+	}
+	double mean = sum / total;
+	double variance = (sum_sq / total) - (mean * mean);
+	
+	uint64_t dark = 0;
+	double dark_sum = 0.;
+	double best = 0.;
+	int level = 0;
+	int last = 0;
+	for (int i=0; i<THRESH_LEVELS - 1; i++) {
+		dark += hist[i];
+		dark_sum += (double)i * hist[i];
+		if ((dark == 0) || (dark == total)) {
+			continue;
+		}
+		double w0 = (double)dark / total;
+		double w1 = 1. - w0;
+		double m0 = dark_sum / dark;
+		double m1 = (sum - dark_sum) / (total - dark);
+		double between = w0 * w1 * (m0 - m1) * (m0 - m1);
+		if (between > best) {
+			best = between;
+			level = i;
+			last = i;
+		} else if (between == best) {
+			last = i;
+		}
+	}
+	if (variance > 0.) {
+		separation = best / variance;
+	}
+	return (level + last) / 2;
+}
+
+/**
+ * This function sets the threshold back to MOON_THRESH.  It is called on the analysis thread with the
+ * first frame of each recording.
+ *
+ */
+void threshold_reset() {
+	THRESH_SMOOTHED = MOON_THRESH;
+	THRESH_LEVEL.store(MOON_THRESH, std::memory_order_relaxed);
+}
+
+/**
+ * This function updates the threshold from the histogram of the frame just checked, ready for the next
+ * frame.  The histogram comes out of the same pass over the pixels as the moments, so finding the
+ * threshold never needs a second sweep.  Each frame's Otsu level is blended into a smoothed level, and
+ * the threshold in use only follows once the smoothed level has moved by THRESH_HYSTERESIS, so the
+ * detected disk does not flicker between frames.
+ *
+ * @param hist grey level histogram of the frame
+ * @return level threshold to use for the next frame
+ */
+int threshold_update(const uint32_t *hist) {
+	int level = THRESH_LEVEL.load(std::memory_order_relaxed);
+	if (!THRESH_AUTO) {
+		THRESH_SMOOTHED = MOON_THRESH;
+		THRESH_LEVEL.store(MOON_THRESH, std::memory_order_relaxed);
+		return MOON_THRESH;
+	}
+	double separation;
+	int otsu = threshold_otsu(hist, separation);
+	if (separation < THRESH_MIN_SEPARATION) {
+		return level;
+	}
+	otsu = std::max(otsu, THRESH_MIN.load());
+	THRESH_SMOOTHED += THRESH_SMOOTHING * (otsu - THRESH_SMOOTHED);
+	if (fabs(THRESH_SMOOTHED - level) >= THRESH_HYSTERESIS) {
+		level = (int)lround(THRESH_SMOOTHED);
+		LOG_DEBUG("moon threshold now " << level);
+		THRESH_LEVEL.store(level, std::memory_order_relaxed);
+	}
+	return level;
+}
+
+/**
+ * This function posts the result of a frame check.  The GUI is only woken when the moon is found or
+ * lost, since the status text does not show anything that changes on every frame.
+ *
+ * @param time_ns log_now when the frame was captured
+ * @param area number of bright pixels
+ * @param cx centroid column, or -1 if nothing was found
+ * @param cy centroid row, or -1 if nothing was found
+ * @param lost number of frames in a row the moon has been lost for
+ */
+void analysis_post(uint64_t time_ns, int area, int cx, int cy, int lost) {
+	bool changed;
+	{
+		std::lock_guard <std::mutex> lock(ANALYSIS_MUTEX);
+		changed = ((ANALYSIS_LATEST.lost == 0) != (lost == 0)) || (ANALYSIS_LATEST.frame == 0);
+		ANALYSIS_LATEST.frame += 1;
+		ANALYSIS_LATEST.time_ns = time_ns;
+		ANALYSIS_LATEST.age_ns = log_now() - time_ns;
+		ANALYSIS_LATEST.area = area;
+		ANALYSIS_LATEST.cx = cx;
+		ANALYSIS_LATEST.cy = cy;
+		ANALYSIS_LATEST.lost = lost;
+	}
+	if (changed) {
+		gui_notify();
+	}
+}
+
+/**
+ * This function gets a copy of the newest frame result.
+ *
+ * @return result of the last frame check, with frame 0 if no frame has been checked
+ */
+analysis_result analysis_latest() {
+	std::lock_guard <std::mutex> lock(ANALYSIS_MUTEX);
+	return ANALYSIS_LATEST;
+}
+
+/**
+ * This function runs on the capture thread, the first stage of frame checking.  While recording, a
+ * screenshot is taken on every tick of a FRAMECHECK_FREQ millisecond timer and handed to the analysis
+ * thread, so the next screenshot is already being taken while the last one is analysed.  The lateness
+ * of every tick is recorded.  If a screenshot runs long, the ticks it covered are counted as missed and
+ * the next screenshot is taken straight away, rather than several running back to back to catch up.
+ * While waiting for recording the thread sleeps on ANALYSIS_QUEUE, which the camera thread wakes when
+ * recording starts.
+ *
+ */
+void capture_loop() {
+	log_set_thread(5, 'F');
+	LOG_INFO("started capture thread");
+	analysis_request request;
+	while (*val_ptr.ABORTaddr == 0) {
+		if (*val_ptr.RUN_MODEaddr != 1) {
+			wd_beat(WD_CAPTURE, "waiting for recording");
+			ANALYSIS_QUEUE.pop(request, std::chrono::milliseconds(ANALYSIS_IDLE_MS));
+			continue;
+		}
+		wd_beat(WD_CAPTURE, "opening the display");
+		if (frame_grab_open() != 0) {
+			frame_grab_close();
+			notify_handler("LunAero Error", "Could not take screenshots of the preview.");
+			abort_code();
+			break;
+		}
+		uint64_t period = (uint64_t)FRAMECHECK_FREQ * 1000000;
+		uint64_t first = log_now();
+		int timer = frame_timer_open(first, period);
+		if (timer < 0) {
+			frame_grab_close();
+			notify_handler("LunAero Error", "Could not start the frame timer.");
+			abort_code();
+			break;
+		}
+		uint64_t seq = 0;
+		uint64_t ticks = 0;
+		while ((*val_ptr.ABORTaddr == 0) && (*val_ptr.RUN_MODEaddr == 1)) {
+			wd_beat(WD_CAPTURE, "waiting for the frame timer");
+			uint64_t expirations = 0;
+			if (read(timer, &expirations, sizeof(expirations)) != sizeof(expirations)) {
+				continue;
+			}
+			ticks += expirations;
+			if (expirations > 1) {
+				metric_add(METRICS.frames_missed, expirations - 1);
+				LOG_DEBUG("capture missed " << (expirations - 1) << " frame timer ticks");
+			}
+			metric_time(METRICS.tick_lateness, first + ((ticks - 1) * period));
+			wd_beat(WD_CAPTURE, "taking a screenshot");
+			frame_buffer *frame = frame_acquire();
+			if (frame != NULL) {
+				if (frame_grab(frame) == 0) {
+					frame->seq = ++seq;
+					frame_submit(frame);
+				} else {
+					frame_release(frame);
+				}
+			}
+			wd_progress(WD_CAPTURE);
+		}
+		close(timer);
+		frame_grab_close();
+	}
+	frame_wake();
+	LOG_INFO("stopped capture thread");
+}
+
+/**
+ * This function runs on the analysis thread, the second stage of frame checking.  Each screenshot from
+ * the capture thread is checked as soon as it arrives, on this thread, so a busy GUI no longer delays a
+ * check and a slow check no longer freezes the GUI.  If the analysis falls behind, stale screenshots
+ * are skipped and the newest one is checked.  Checks which take longer than FRAMECHECK_FREQ are counted
+ * as overruns.
+ *
+ */
+void analysis_loop() {
+	log_set_thread(4, 'A');
+	LOG_INFO("started analysis thread");
+	while (*val_ptr.ABORTaddr == 0) {
+		wd_beat(WD_ANALYSIS, (*val_ptr.RUN_MODEaddr == 1) ? "waiting for a frame" : "waiting for recording");
+		frame_buffer *frame = frame_wait(std::chrono::milliseconds(ANALYSIS_IDLE_MS));
+		if (frame == NULL) {
+			continue;
+		}
+		wd_beat(WD_ANALYSIS, "frame check");
+		if (frame->seq == 1) {
+			threshold_reset();
+			blob_track_reset();
+		}
+		uint64_t start = log_now();
+		cb_framecheck(frame);
+		frame_release(frame);
+		if (log_now() - start > (uint64_t)FRAMECHECK_FREQ * 1000000) {
+			metric_add(METRICS.frame_overruns);
+		}
+		wd_progress(WD_ANALYSIS);
+	}
+	LOG_INFO("stopped analysis thread");
+}
@@ -0,0 +1,211 @@
+/*
+ * C_LunAero/analysis_LunAero.hpp - Frame analysis thread for LunAero_C
+ * Copyright (C) <2020>  <Wesley T. Honeycutt>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ANALYSIS_LUNAERO_H
+#define ANALYSIS_LUNAERO_H
+
+// Standard C++ includes
+#include <cerrno>          // provides errno
+#include <atomic>          // provides std::atomic
+#include <chrono>          // provides C++ chrono
+#include <condition_variable> // provides std::condition_variable
+#include <cstdint>         // provides fixed width integers
+#include <cstring>         // provides strerror
+#include <mutex>           // provides std::mutex
+
+// Module specific includes
+#include <sys/timerfd.h>   // provides timerfd
+#include <unistd.h>        // provides read and close
+
+// User Includes
+#include "LunAero.hpp"
+
+// Global Defined Constants
+/**
+ * Milliseconds the analysis thread waits for recording to start before telling the watchdog it is
+ * still alive.
+ */
+#define ANALYSIS_IDLE_MS 1000
+/**
+ * Number of screenshot buffers shared by the capture and analysis threads.  One is being filled, one
+ * is being analysed, and one holds the newest finished screenshot, so capture never waits on analysis.
+ */
+#define FRAME_BUFFERS 3
+/**
+ * Number of grey levels in the histogram the moon threshold is found from.
+ */
+#define THRESH_LEVELS 256
+/**
+ * Smallest share of the grey level variance the threshold must explain to be trusted.  A frame with
+ * no moon, or only haze, has no clear split and leaves the threshold where it was.
+ */
+#define THRESH_MIN_SEPARATION 0.8
+
+/**
+ * Requests sent to the capture thread through ANALYSIS_QUEUE.
+ */
+enum analysis_request {
+	ANA_REQ_START,
+	ANA_REQ_STOP
+};
+
+/**
+ * Owner of a screenshot buffer in FRAME_POOL.
+ */
+enum frame_state {
+	FRAME_FREE,
+	FRAME_FILLING,
+	FRAME_READY,
+	FRAME_BUSY
+};
+
+/**
+ * One screenshot of the preview.  The pixels are allocated once by frame_pool_init and reused for the
+ * whole run.
+ */
+struct frame_buffer {
+	/**
+	 * RGB888 pixels of the whole display.
+	 */
+	unsigned char *pixels;
+	/**
+	 * Size of the display in pixels.
+	 */
+	int width;
+	int height;
+	/**
+	 * log_now when the snapshot was taken, so the age of the result is known when it is acted on.
+	 */
+	uint64_t time_ns;
+	/**
+	 * Number of the screenshot since recording started.
+	 */
+	uint64_t seq;
+	/**
+	 * Owner of the buffer, from frame_state.  Only changed with FRAME_MUTEX held.
+	 */
+	int state;
+};
+
+/**
+ * Result of the analysis of one frame, posted for the GUI and the command socket.  The motors are
+ * commanded by current_frame itself through the val_ptr direction flags.
+ */
+struct analysis_result {
+	/**
+	 * Number of frames analysed since recording started.
+	 */
+	uint64_t frame;
+	/**
+	 * log_now when the frame was captured.
+	 */
+	uint64_t time_ns;
+	/**
+	 * Nanoseconds from the capture of the frame until its analysis finished.
+	 */
+	uint64_t age_ns;
+	/**
+	 * Number of pixels bright enough to be part of the moon.
+	 */
+	int area;
+	/**
+	 * Centroid of the moon in the region of interest, or -1 if nothing was found.
+	 */
+	int cx;
+	int cy;
+	/**
+	 * Number of frames in a row the moon has been lost for.
+	 */
+	int lost;
+};
+
+/**
+ * Frequency in milliseconds to check the frame for moon centering.  Customizable from settings.cfg
+ */
+inline int FRAMECHECK_FREQ = 50;
+/**
+ * Oldest a frame may be, in milliseconds from its screenshot, for the motors to be moved on it.  Older
+ * frames stop the motors instead.  Customizable from settings.cfg
+ */
+inline std::atomic<int> FRAME_STALE_MS = 250;
+/**
+ * Should the grey level which separates the moon from the sky be found from each frame?  If not,
+ * MOON_THRESH is always used.  Customizable from settings.cfg
+ */
+inline std::atomic<bool> THRESH_AUTO = true;
+/**
+ * Grey level between 0-255 above which a pixel is part of the moon, used when THRESH_AUTO is off and
+ * at the start of each recording.  Customizable from settings.cfg
+ */
+inline std::atomic<int> MOON_THRESH = 25;
+/**
+ * Lowest grey level the automatic threshold may choose, so sensor noise in a dark sky is never taken
+ * for the moon.  Customizable from settings.cfg
+ */
+inline std::atomic<int> THRESH_MIN = 10;
+/**
+ * Weight of each new frame in the smoothed threshold, between 0 and 1.  Customizable from settings.cfg
+ */
+inline std::atomic<float> THRESH_SMOOTHING = 0.2;
+/**
+ * Grey levels the smoothed threshold must move by before the threshold in use follows it.
+ * Customizable from settings.cfg
+ */
+inline std::atomic<int> THRESH_HYSTERESIS = 4;
+
+/**
+ * Requests for the analysis thread.
+ */
+inline msg_queue <analysis_request> ANALYSIS_QUEUE;
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+
+// Global Variables - Not "private" but not necessary to define for Doxygen
+inline std::mutex ANALYSIS_MUTEX;
+inline analysis_result ANALYSIS_LATEST = {0, 0, 0, 0, -1, -1, 0};
+inline frame_buffer FRAME_POOL[FRAME_BUFFERS];
+inline std::mutex FRAME_MUTEX;
+inline std::condition_variable FRAME_CV;
+inline DISPMANX_DISPLAY_HANDLE_T FRAME_DISPLAY = 0;
+inline DISPMANX_RESOURCE_HANDLE_T FRAME_RESOURCE = 0;
+inline double THRESH_SMOOTHED = 25.;
+inline std::atomic <int> THRESH_LEVEL{25};
+
+#endif /* DOXYGEN_SHOULD_SKIP_THIS */
+
+// Function Prototypes
+int frame_pool_init(int width, int height);
+void frame_pool_free();
+frame_buffer *frame_acquire();
+void frame_submit(frame_buffer *frame);
+frame_buffer *frame_wait(std::chrono::milliseconds timeout);
+void frame_release(frame_buffer *frame);
+void frame_wake();
+int frame_timer_open(uint64_t first, uint64_t period);
+int frame_grab_open();
+int frame_grab(frame_buffer *frame);
+void frame_grab_close();
+int threshold_otsu(const uint32_t *hist, double &separation);
+void threshold_reset();
+int threshold_update(const uint32_t *hist);
+void analysis_post(uint64_t time_ns, int area, int cx, int cy, int lost);
+analysis_result analysis_latest();
+void capture_loop();
+void analysis_loop();
+
+#endif
@@ -0,0 +1,236 @@
+/*
+ * C_LunAero/bench_LunAero.cpp - Frame analysis benchmark for LunAero_C
+ * Copyright (C) <2020>  <Wesley T. Honeycutt>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * lunaero-bench times the frame analysis of current_frame on made up screenshots: a moon drifting across
+ * a noisy sky with a streetlight in view.  The same frames are checked once with the whole preview
+ * searched every frame and once with the tracking window, and the time per frame of each is printed.
+ * No camera or display is needed, so it can be run on the Pi while nothing else is.
+ *
+ * Build with
+ *   make bench
+ *
+ * Usage
+ *   lunaero-bench [--frames N] [--screen WIDTH HEIGHT] [--radius R] [--speed PIXELS]
+ *
+ *   --frames    frames checked in each mode (default 1000)
+ *   --screen    size of the display, which sets the preview as LunAero does (default 1920 1080)
+ *   --radius    radius of the moon in pixels (default 60)
+ *   --speed     pixels the moon drifts each frame (default 2)
+ */
+
+#include "blob_LunAero.hpp"
+#include "limb_LunAero.hpp"
+
+/**
+ * This function stands in for the one in LunAero.cpp, which the log module names its files with.
+ *
+ * @param gmt plus or minus tmz gmt
+ * @return str the current time formatted as a string
+ */
+std::string current_time(int gmt) {
+	time_t rawtime = time(NULL);
+	char buffer[80];
+	strftime(buffer, sizeof(buffer), "%Y%m%d%H%M%S", (gmt > 0) ? gmtime(&rawtime) : localtime(&rawtime));
+	return buffer;
+}
+
+/**
+ * Timings of one mode.
+ */
+struct bench_result {
+	std::vector<double> us;
+	int found;
+	int windowed;
+	int fallbacks;
+	double error;
+};
+
+/**
+ * This function draws a disk onto the screenshot, brighter towards its middle like the moon.
+ *
+ * @param frame screenshot
+ * @param x centre column on the display
+ * @param y centre row on the display
+ * @param r radius
+ * @param grey brightness at the limb
+ */
+void bench_disk(frame_buffer &frame, double x, double y, double r, int grey) {
+	for (int k=std::max((int)(y - r), 0); k<=std::min((int)(y + r) + 1, frame.height - 1); k++) {
+		for (int j=std::max((int)(x - r), 0); j<=std::min((int)(x + r) + 1, frame.width - 1); j++) {
+			double d2 = ((j - x) * (j - x)) + ((k - y) * (k - y));
+			if (d2 <= r * r) {
+				unsigned char *px = &frame.pixels[(((size_t)k * frame.width) + j) * 3];
+				int v = std::min(grey + (int)(40. * (1. - (d2 / (r * r)))), 255);
+				px[0] = v;
+				px[1] = v;
+				px[2] = v;
+			}
+		}
+	}
+}
+
+/**
+ * This function checks every frame of a run as current_frame does: finds the moon, counts the edges,
+ * fits the limb, and sets the tracking window.
+ *
+ * @param sky screenshot of the sky without the moon
+ * @param screen_w width of the display
+ * @param screen_h height of the display
+ * @param frames number of frames
+ * @param radius radius of the moon
+ * @param speed pixels the moon drifts each frame
+ * @param windowed true to use the tracking window
+ * @return result timings
+ */
+bench_result bench_run(const std::vector<unsigned char> &sky, int screen_w, int screen_h, int frames,
+		double radius, double speed, bool windowed) {
+	int local_height = RVD_HEIGHT - 6;
+	int local_width = RVD_WIDTH - 4;
+	int local_xcorn = RVD_XCORN + 2;
+	int local_ycorn = RVD_YCORN + 3;
+	std::vector<unsigned char> pixels(sky);
+	frame_buffer frame = {pixels.data(), screen_w, screen_h, 0, 0, 0};
+	TRACK_WINDOW = windowed;
+	blob_track_reset();
+	bench_result result = {{}, 0, 0, 0, 0.};
+	double x = local_xcorn + (local_width / 3.);
+	double y = local_ycorn + (local_height / 2.);
+	double dx = speed;
+	double dy = speed / 3.;
+	for (int i=0; i<frames; i++) {
+		// Drift the moon, bouncing off the sides of the preview
+		if ((x + dx < local_xcorn + radius) || (x + dx > local_xcorn + local_width - radius)) {
+			dx = -dx;
+		}
+		if ((y + dy < local_ycorn + radius) || (y + dy > local_ycorn + local_height - radius)) {
+			dy = -dy;
+		}
+		// Restore the sky under the old moon before drawing the new one
+		int r = radius + 2;
+		for (int k=std::max((int)y - r, 0); k<=std::min((int)y + r, screen_h - 1); k++) {
+			size_t at = (((size_t)k * screen_w) + std::max((int)x - r, 0)) * 3;
+			size_t len = (std::min((int)x + r, screen_w - 1) - std::max((int)x - r, 0) + 1) * 3;
+			std::copy(sky.begin() + at, sky.begin() + at + len, pixels.begin() + at);
+		}
+		x += dx;
+		y += dy;
+		bench_disk(frame, x, y, radius, 150);
+		frame.seq = i + 1;
+
+		auto start = std::chrono::steady_clock::now();
+		uint32_t hist[EXPOSURE_LEVELS] = {0};
+		blob_stats moon;
+		int others = 0;
+		int mode = 0;
+		int found = blob_search(&frame, local_xcorn + 1, local_ycorn, local_width, local_height, MOON_THRESH,
+			hist, NULL, moon, others, mode);
+		if (found == 0) {
+			int top, bottom, left, right;
+			blob_edges(local_width, local_height, top, bottom, left, right);
+			limb_circle circle;
+			bool fitted = (limb_fit(local_width, local_height, (double)moon.sumx / moon.area,
+				(double)moon.sumy / moon.area, frame.seq, circle) == 0);
+			blob_track(moon, fitted, circle, local_width, local_height);
+			double cx = fitted ? circle.x : (double)moon.sumx / moon.area;
+			double cy = fitted ? circle.y : (double)moon.sumy / moon.area;
+			double ex = cx - (x - local_xcorn - 1);
+			double ey = cy - (y - local_ycorn);
+			result.error = std::max(result.error, sqrt((ex * ex) + (ey * ey)));
+			result.found++;
+		} else {
+			blob_track_reset();
+		}
+		result.us.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now()
+			- start).count());
+		result.windowed += (mode == 1);
+		result.fallbacks += (mode == 2);
+	}
+	return result;
+}
+
+/**
+ * This function prints the timings of one mode.
+ *
+ * @param name name of the mode
+ * @param result timings
+ */
+void bench_print(const char *name, bench_result result) {
+	std::vector<double> &us = result.us;
+	std::sort(us.begin(), us.end());
+	double sum = 0.;
+	for (double t : us) {
+		sum += t;
+	}
+	printf("%-8s mean %8.1f us  median %8.1f us  p99 %8.1f us  found %d/%zu  windowed %d  fallbacks %d"
+		"  max error %.2f px\n", name, sum / us.size(), us[us.size() / 2], us[(us.size() * 99) / 100],
+		result.found, us.size(), result.windowed, result.fallbacks, result.error);
+}
+
+int main(int argc, char **argv) {
+	int frames = 1000;
+	int screen_w = 1920;
+	int screen_h = 1080;
+	double radius = 60.;
+	double speed = 2.;
+	for (int i=1; i<argc; i++) {
+		std::string arg = argv[i];
+		if ((arg == "--frames") && (i + 1 < argc)) {
+			frames = atoi(argv[++i]);
+		} else if ((arg == "--screen") && (i + 2 < argc)) {
+			screen_w = atoi(argv[++i]);
+			screen_h = atoi(argv[++i]);
+		} else if ((arg == "--radius") && (i + 1 < argc)) {
+			radius = atof(argv[++i]);
+		} else if ((arg == "--speed") && (i + 1 < argc)) {
+			speed = atof(argv[++i]);
+		} else {
+			std::cerr << "usage: " << argv[0] << " [--frames N] [--screen WIDTH HEIGHT] [--radius R] [--speed PIXELS]"
+			<< std::endl;
+			return 2;
+		}
+	}
+
+	// Place the preview as LunAero does (see camera_LunAero)
+	WORK_WIDTH = screen_w;
+	WORK_HEIGHT = screen_h;
+	RVD_HEIGHT = WORK_HEIGHT/2;
+	RVD_WIDTH = WORK_WIDTH/2;
+	RVD_XCORN = (WORK_WIDTH/2)-(WORK_WIDTH/4);
+	RVD_YCORN = (WORK_HEIGHT/2);
+	if ((frames < 1) || (radius < LIMB_MIN_RADIUS) || (2 * radius + 8 > RVD_HEIGHT)) {
+		std::cerr << "ERROR: the moon must fit in the preview, and at least one frame is needed" << std::endl;
+		return 2;
+	}
+
+	// A dark, noisy sky with a streetlight near the corner of the preview
+	std::vector<unsigned char> sky((size_t)screen_w * screen_h * 3);
+	uint64_t state = 1;
+	for (size_t i=0; i<sky.size(); i++) {
+		state = (state * 6364136223846793005ull) + 1442695040888963407ull;
+		sky[i] = 4 + ((state >> 33) % 12);
+	}
+	frame_buffer lamp = {sky.data(), screen_w, screen_h, 0, 0, 0};
+	bench_disk(lamp, RVD_XCORN + 20, RVD_YCORN + 20, 6, 200);
+
+	printf("screen %d x %d, preview %d x %d, moon radius %.0f px, %.1f px per frame, %d frames\n", screen_w,
+		screen_h, RVD_WIDTH - 4, RVD_HEIGHT - 6, radius, speed, frames);
+	bench_print("full", bench_run(sky, screen_w, screen_h, frames, radius, speed, false));
+	bench_print("window", bench_run(sky, screen_w, screen_h, frames, radius, speed, true));
+	return 0;
+}
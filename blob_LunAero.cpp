@@ -0,0 +1,424 @@
+/*
+ * C_LunAero/blob_LunAero.cpp - Run length mask and connected components for LunAero_C
+ * Copyright (C) <2020>  <Wesley T. Honeycutt>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "blob_LunAero.hpp"
+
+/**
+ * This function finds the root run of the blob a run belongs to, shortening the path as it goes.
+ *
+ * @param run index in BLOB_RUNS
+ * @return root index of the root run
+ */
+int blob_find(int run) {
+	while (BLOB_RUNS[run].parent != run) {
+		BLOB_RUNS[run].parent = BLOB_RUNS[BLOB_RUNS[run].parent].parent;
+		run = BLOB_RUNS[run].parent;
+	}
+	return run;
+}
+
+/**
+ * This function joins the blobs of two runs.
+ *
+ * @param a index in BLOB_RUNS
+ * @param b index in BLOB_RUNS
+ */
+void blob_union(int a, int b) {
+	a = blob_find(a);
+	b = blob_find(b);
+	if (a < b) {
+		BLOB_RUNS[b].parent = a;
+	} else if (b < a) {
+		BLOB_RUNS[a].parent = b;
+	}
+}
+
+/**
+ * This function starts the runs of a new frame.  The vectors keep their capacity between frames, so
+ * they only allocate while the sky gets busier.
+ */
+void blob_begin() {
+	BLOB_RUNS.clear();
+	BLOB_ROW = -1;
+	BLOB_ROW_START = 0;
+	BLOB_PREV_START = 0;
+}
+
+/**
+ * This function adds one run of bright pixels, as the threshold stage finds it, and joins it to the
+ * runs of the row above which it touches, diagonals included (union-find on run lengths).  Runs must
+ * arrive in row order, and left to right within a row, so the whole mask is labelled in the same pass
+ * that thresholds it.
+ *
+ * @param y row of the run
+ * @param x0 first column of the run
+ * @param x1 last column of the run
+ */
+void blob_add_run(int y, int x0, int x1) {
+	int index = BLOB_RUNS.size();
+	if (y != BLOB_ROW) {
+		// Only the row directly above can touch this one
+		BLOB_PREV_START = (y == BLOB_ROW + 1) ? BLOB_ROW_START : index;
+		BLOB_ROW_START = index;
+		BLOB_ROW = y;
+	}
+	BLOB_RUNS.push_back({y, x0, x1, index});
+	for (int q=BLOB_PREV_START; q<BLOB_ROW_START; q++) {
+		if (BLOB_RUNS[q].x1 < x0 - 1) {
+			// Later runs in this row start further right, so they cannot touch this run either
+			BLOB_PREV_START = q + 1;
+			continue;
+		}
+		if (BLOB_RUNS[q].x0 > x1 + 1) {
+			break;
+		}
+		blob_union(index, q);
+	}
+}
+
+/**
+ * This function splits the bright pixels of the frame into connected blobs and keeps only the moon.
+ * Streetlights, aircraft, the edge of the GTK window, and hot pixels would otherwise pull the centroid,
+ * or trip the edge counts into a full motor move.  The moments and bounding box of each blob are found
+ * from its runs alone, so the cost follows the number of rows rather than pixels.  The blob with the
+ * largest area times roundness is taken as the moon, and its runs are copied to BLOB_MOON for the edge
+ * counts and limb fit.
+ *
+ * @param width width of the region
+ * @param height height of the region
+ * @param filter if false, every run is kept and counted as the moon
+ * @param moon receives the moments of the moon
+ * @param others receives the number of other blobs left out
+ * @return status 0 if the moon was found, 1 if no blob of BLOB_MIN_AREA was found
+ */
+int blob_label(int width, int height, bool filter, blob_stats &moon, int &others) {
+	// Sum the moments of each blob on its root run, or of the whole frame on the first run
+	int runs = BLOB_RUNS.size();
+	BLOB_STATS.assign(runs, blob_stats {0, 0, 0, 0, 0, width, -1, height, -1, 0.});
+	for (int i=0; i<runs; i++) {
+		const blob_run &run = BLOB_RUNS[i];
+		blob_stats &stats = BLOB_STATS[filter ? blob_find(i) : 0];
+		uint64_t n = run.x1 - run.x0 + 1;
+		uint64_t a = run.x0;
+		uint64_t b = run.x1;
+		stats.area += n;
+		stats.sumx += (a + b) * n / 2;
+		stats.sumy += n * run.y;
+		stats.sumxx += ((b * (b + 1) * (2 * b + 1)) - (a * (a - 1) * (2 * a - 1))) / 6;
+		stats.sumyy += n * run.y * run.y;
+		stats.left = std::min(stats.left, run.x0);
+		stats.right = std::max(stats.right, run.x1);
+		stats.top = std::min(stats.top, run.y);
+		stats.bottom = std::max(stats.bottom, run.y);
+	}
+
+	// Choose the largest and roundest blob
+	int best = -1;
+	double best_score = 0.;
+	int blobs = 0;
+	for (int i=0; i<runs; i++) {
+		if ((filter && (BLOB_RUNS[i].parent != i)) || (!filter && (i > 0))) {
+			continue;
+		}
+		blob_stats &stats = BLOB_STATS[i];
+		blobs++;
+		double area = stats.area;
+		double spread = (stats.sumxx - ((double)stats.sumx * stats.sumx / area))
+			+ (stats.sumyy - ((double)stats.sumy * stats.sumy / area));
+		stats.roundness = (spread > 0.) ? std::min(1., (area * area) / (2. * M_PI * spread)) : 1.;
+		if (!filter) {
+			best = i;
+		} else if ((stats.area >= (uint64_t)BLOB_MIN_AREA) && (area * stats.roundness > best_score)) {
+			best_score = area * stats.roundness;
+			best = i;
+		}
+	}
+	others = (best < 0) ? blobs : blobs - 1;
+
+	// Keep the runs of the moon, indexed by row
+	BLOB_MOON.clear();
+	BLOB_ROWS.assign(height + 1, 0);
+	int row = 0;
+	for (int i=0; i<runs; i++) {
+		if ((best < 0) || (filter && (blob_find(i) != best))) {
+			continue;
+		}
+		while (row <= BLOB_RUNS[i].y) {
+			BLOB_ROWS[row++] = BLOB_MOON.size();
+		}
+		BLOB_MOON.push_back(BLOB_RUNS[i]);
+	}
+	while (row <= height) {
+		BLOB_ROWS[row++] = BLOB_MOON.size();
+	}
+	if (best < 0) {
+		moon = blob_stats {0, 0, 0, 0, 0, 0, 0, 0, 0, 0.};
+		return 1;
+	}
+	moon = BLOB_STATS[best];
+	return 0;
+}
+
+/**
+ * This function counts the pixels of the moon on each edge of the region, from its runs.
+ *
+ * @param width width of the region
+ * @param height height of the region
+ * @param top receives the bright pixels in the top row
+ * @param bottom receives the bright pixels in the bottom row
+ * @param left receives the bright pixels in the left column
+ * @param right receives the bright pixels in the right column
+ */
+void blob_edges(int width, int height, int &top, int &bottom, int &left, int &right) {
+	top = 0;
+	bottom = 0;
+	left = 0;
+	right = 0;
+	for (int i=BLOB_ROWS[0]; i<BLOB_ROWS[1]; i++) {
+		top += BLOB_MOON[i].x1 - BLOB_MOON[i].x0 + 1;
+	}
+	for (int i=BLOB_ROWS[height - 1]; i<BLOB_ROWS[height]; i++) {
+		bottom += BLOB_MOON[i].x1 - BLOB_MOON[i].x0 + 1;
+	}
+	for (const blob_run &run : BLOB_MOON) {
+		if (run.x0 == 0) {
+			left++;
+		}
+		if (run.x1 == width - 1) {
+			right++;
+		}
+	}
+}
+
+/**
+ * This function writes every run of the frame as a plain .pbm image, bright spots 0, for checking the
+ * threshold by eye.
+ *
+ * @param fp open file
+ * @param width width of the region
+ * @param height height of the region
+ */
+void blob_write_pbm(FILE *fp, int width, int height) {
+	fprintf(fp, "P1\n%d %d\n1\n", width, height);
+	size_t i = 0;
+	for (int k=0; k<height; k++) {
+		int j = 0;
+		for (; (i < BLOB_RUNS.size()) && (BLOB_RUNS[i].y == k); i++) {
+			for (; j<BLOB_RUNS[i].x0; j++) {
+				fputc('1', fp);
+			}
+			for (; j<=BLOB_RUNS[i].x1; j++) {
+				fputc('0', fp);
+			}
+		}
+		for (; j<width; j++) {
+			fputc('1', fp);
+		}
+		fputc('\n', fp);
+	}
+}
+
+/**
+ * This function sets a window to the whole region of interest.
+ *
+ * @param width width of the region
+ * @param height height of the region
+ * @param win receives the window
+ */
+void blob_window_full(int width, int height, blob_window &win) {
+	win = {0, 0, width - 1, height - 1};
+}
+
+/**
+ * This function sets a window to a box grown by a margin on each side, kept within the region of
+ * interest.
+ *
+ * @param left first column of the box
+ * @param top first row of the box
+ * @param right last column of the box
+ * @param bottom last row of the box
+ * @param margin pixels to grow the box by
+ * @param width width of the region
+ * @param height height of the region
+ * @param win receives the window
+ */
+void blob_window_around(int left, int top, int right, int bottom, int margin, int width, int height,
+		blob_window &win) {
+	win.left = std::max(left - margin, 0);
+	win.top = std::max(top - margin, 0);
+	win.right = std::min(right + margin, width - 1);
+	win.bottom = std::min(bottom + margin, height - 1);
+}
+
+/**
+ * This function checks whether the moon reaches the border of a window, other than where the window
+ * meets the border of the region.  Such a moon may carry on outside the window, so the window cannot
+ * be trusted to have seen all of it.
+ *
+ * @param moon moments and extent of the moon
+ * @param win window it was found in
+ * @param width width of the region
+ * @param height height of the region
+ * @return touches true if the moon reaches the border of the window
+ */
+bool blob_window_touches(const blob_stats &moon, const blob_window &win, int width, int height) {
+	return ((moon.left <= win.left) && (win.left > 0)) || ((moon.top <= win.top) && (win.top > 0))
+		|| ((moon.right >= win.right) && (win.right < width - 1))
+		|| ((moon.bottom >= win.bottom) && (win.bottom < height - 1));
+}
+
+/**
+ * This function thresholds a window of the region of interest in a screenshot into runs of bright
+ * pixels (see blob_add_run), and counts its grey levels.  Only the pixels inside the window are read,
+ * so once the moon is being tracked the cost follows the size of the moon rather than of the preview.
+ * If the region is also shared with other programs, every row of the region is still converted to grey
+ * for them.
+ *
+ * @param frame screenshot
+ * @param x_origin column of the screenshot where the region starts
+ * @param y_origin row of the screenshot where the region starts
+ * @param width width of the region
+ * @param height height of the region
+ * @param win part of the region to threshold
+ * @param level grey level above which a pixel is bright
+ * @param hist grey level histogram of the window, added to
+ * @param shared grey copy of the whole region, or NULL
+ */
+void blob_threshold(const frame_buffer *frame, int x_origin, int y_origin, int width, int height,
+		const blob_window &win, int level, uint32_t *hist, unsigned char *shared) {
+	blob_begin();
+	// The screenshot may be smaller than the region expects
+	int rows = std::min(height, frame->height - y_origin);
+	int cols = std::min(width, frame->width - x_origin);
+	int right = std::min(win.right, cols - 1);
+	for (int k=0; k<rows; k++) {
+		const unsigned char *rgb = &frame->pixels[(((size_t)(y_origin + k) * frame->width) + x_origin) * 3];
+		if (shared) {
+			for (int j=0; j<cols; j++) {
+				const unsigned char *px = &rgb[j * 3];
+				shared[(k * width) + j] = (77*px[0] + 150*px[1] + 29*px[2]) >> 8;
+			}
+		}
+		if ((k < win.top) || (k > win.bottom)) {
+			continue;
+		}
+		int run_start = -1;
+		for (int j=win.left; j<=right; j++) {
+			const unsigned char *px = &rgb[j * 3];
+			unsigned char grey = (77*px[0] + 150*px[1] + 29*px[2]) >> 8;
+			hist[grey] += 1;
+			if (grey > level) {
+				if (run_start < 0) {
+					run_start = j;
+				}
+			} else if (run_start >= 0) {
+				blob_add_run(k, run_start, j - 1);
+				run_start = -1;
+			}
+		}
+		if (run_start >= 0) {
+			blob_add_run(k, run_start, right);
+		}
+	}
+}
+
+/**
+ * This function finds the moon in a screenshot.  Once the moon has been found, only the tracking window
+ * around it is thresholded (see blob_track).  If the moon is not in the window, or runs off its border,
+ * the whole region is checked again, so a moon which jumped is found on the same frame.
+ *
+ * @param frame screenshot
+ * @param x_origin column of the screenshot where the region starts
+ * @param y_origin row of the screenshot where the region starts
+ * @param width width of the region
+ * @param height height of the region
+ * @param level grey level above which a pixel is bright
+ * @param hist receives the grey level histogram of the part of the region checked
+ * @param shared grey copy of the whole region, or NULL
+ * @param moon receives the moments of the moon
+ * @param others receives the number of other blobs left out
+ * @param windowed receives 0 if the whole region was checked, 1 if only the window was, or 2 if the
+ * window missed the moon and the whole region was checked after it
+ * @return status 0 if the moon was found, 1 if not
+ */
+int blob_search(const frame_buffer *frame, int x_origin, int y_origin, int width, int height, int level,
+		uint32_t *hist, unsigned char *shared, blob_stats &moon, int &others, int &windowed) {
+	blob_window win;
+	blob_window_full(width, height, win);
+	windowed = (TRACK_WINDOW && BLOB_TRACKING) ? 1 : 0;
+	if (windowed == 1) {
+		win = BLOB_TRACK_WINDOW;
+	}
+	while (true) {
+		std::fill(hist, hist + EXPOSURE_LEVELS, 0);
+		blob_threshold(frame, x_origin, y_origin, width, height, win, level, hist, shared);
+		int found = blob_label(width, height, BLOB_FILTER, moon, others);
+		if (windowed != 1) {
+			return found;
+		}
+		if ((found == 0) && !blob_window_touches(moon, win, width, height)) {
+			// Shrink a margin which was widened back towards TRACK_MARGIN
+			BLOB_TRACK_MARGIN = std::max(BLOB_TRACK_MARGIN - (BLOB_TRACK_MARGIN / 8), TRACK_MARGIN.load());
+			return found;
+		}
+		// The moon moved further than the margin, so allow for more next time
+		BLOB_TRACK_MARGIN = std::min(std::max(BLOB_TRACK_MARGIN, TRACK_MARGIN.load()) * 2, std::max(width, height));
+		blob_window_full(width, height, win);
+		windowed = 2;
+		// The shared copy is already whole
+		shared = NULL;
+	}
+}
+
+/**
+ * This function sets the tracking window for the next frame around the moon just found, grown by the
+ * tracking margin.  When a circle was fitted to the limb, the window covers the whole disk rather than
+ * just its lit part.
+ *
+ * @param moon moments and extent of the moon
+ * @param fitted true if circle was fitted to the limb
+ * @param circle circle fitted to the limb
+ * @param width width of the region
+ * @param height height of the region
+ */
+void blob_track(const blob_stats &moon, bool fitted, const limb_circle &circle, int width, int height) {
+	int left = moon.left;
+	int top = moon.top;
+	int right = moon.right;
+	int bottom = moon.bottom;
+	if (fitted) {
+		left = std::min(left, (int)floor(circle.x - circle.r));
+		top = std::min(top, (int)floor(circle.y - circle.r));
+		right = std::max(right, (int)ceil(circle.x + circle.r));
+		bottom = std::max(bottom, (int)ceil(circle.y + circle.r));
+	}
+	blob_window_around(left, top, right, bottom, std::max(BLOB_TRACK_MARGIN, TRACK_MARGIN.load()), width, height,
+		BLOB_TRACK_WINDOW);
+	BLOB_TRACKING = true;
+}
+
+/**
+ * This function forgets the tracking window, so the next frame is checked in full, and sets the
+ * margin back to TRACK_MARGIN.  It is called on the analysis thread with the first frame of each
+ * recording, and whenever the moon is lost.
+ *
+ */
+void blob_track_reset() {
+	BLOB_TRACKING = false;
+	BLOB_TRACK_MARGIN = TRACK_MARGIN;
+}
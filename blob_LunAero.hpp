@@ -0,0 +1,143 @@
+/*
+ * C_LunAero/blob_LunAero.hpp - Run length mask and connected component headers for LunAero_C
+ * Copyright (C) <2020>  <Wesley T. Honeycutt>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef BLOB_LUNAERO_H
+#define BLOB_LUNAERO_H
+
+// Standard C++ includes
+#include <algorithm>       // provides std::min
+#include <cmath>           // provides M_PI, floor, and ceil
+#include <cstdint>         // provides fixed width integers
+#include <cstdio>          // provides FILE
+#include <vector>
+
+// User Includes
+#include "LunAero.hpp"
+
+struct frame_buffer;
+struct limb_circle;
+
+/**
+ * One run of bright pixels in a row of the thresholded region, from x0 to x1 inclusive.
+ */
+struct blob_run {
+	int y;
+	int x0;
+	int x1;
+	/**
+	 * Index of the parent run in the union-find forest.  A run which is its own parent is the root of
+	 * its blob.
+	 */
+	int parent;
+};
+
+/**
+ * Moments and extent of one connected blob of bright pixels.
+ */
+struct blob_stats {
+	uint64_t area;
+	uint64_t sumx;
+	uint64_t sumy;
+	uint64_t sumxx;
+	uint64_t sumyy;
+	/**
+	 * Bounding box, inclusive.
+	 */
+	int left;
+	int right;
+	int top;
+	int bottom;
+	/**
+	 * Area squared over the area a disk with the same second moments would need, between 0 and 1.  A
+	 * filled disk scores 1, a line or a sliver close to 0.
+	 */
+	double roundness;
+};
+
+/**
+ * Part of the region of interest to threshold, inclusive.
+ */
+struct blob_window {
+	int left;
+	int top;
+	int right;
+	int bottom;
+};
+
+/**
+ * Should only the largest and roundest blob of bright pixels be tracked as the moon?  If not, every
+ * bright pixel counts.  Customizable from settings.cfg.
+ */
+inline std::atomic<bool> BLOB_FILTER = true;
+/**
+ * Smallest blob in pixels which may be the moon.  Smaller blobs are hot pixels, stars, or noise, and a
+ * frame with nothing larger counts as the moon being lost.  Customizable from settings.cfg.
+ */
+inline std::atomic<int> BLOB_MIN_AREA = 20;
+/**
+ * Once the moon is found, should the next frame only be checked in a window around it?  If the moon is
+ * not found in the window, or touches its border, the whole frame is checked again.  Customizable from
+ * settings.cfg.
+ */
+inline std::atomic<bool> TRACK_WINDOW = true;
+/**
+ * Pixels between the moon and the border of the tracking window.  It should cover how far the moon
+ * moves between frames.  The margin is doubled each time the moon is not found inside the window, and
+ * shrinks back to this while it is.  Customizable from settings.cfg.
+ */
+inline std::atomic<int> TRACK_MARGIN = 24;
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+
+// Global Variables - Not "private" but not necessary to define for Doxygen
+// Every run of the frame, in row order, as the threshold stage emits them
+inline std::vector <blob_run> BLOB_RUNS;
+inline std::vector <blob_stats> BLOB_STATS;
+// Runs of the moon only, in row order, with the first run of each row indexed by BLOB_ROWS
+inline std::vector <blob_run> BLOB_MOON;
+inline std::vector <int> BLOB_ROWS;
+inline int BLOB_ROW = -1;
+inline int BLOB_ROW_START = 0;
+inline int BLOB_PREV_START = 0;
+// Window the next frame is checked in, when BLOB_TRACKING, and the margin it was grown by
+inline blob_window BLOB_TRACK_WINDOW;
+inline bool BLOB_TRACKING = false;
+inline int BLOB_TRACK_MARGIN = 0;
+
+#endif /* DOXYGEN_SHOULD_SKIP_THIS */
+
+// Function Prototypes
+int blob_find(int run);
+void blob_union(int a, int b);
+void blob_begin();
+void blob_add_run(int y, int x0, int x1);
+int blob_label(int width, int height, bool filter, blob_stats &moon, int &others);
+void blob_edges(int width, int height, int &top, int &bottom, int &left, int &right);
+void blob_write_pbm(FILE *fp, int width, int height);
+void blob_window_full(int width, int height, blob_window &win);
+void blob_window_around(int left, int top, int right, int bottom, int margin, int width, int height,
+	blob_window &win);
+bool blob_window_touches(const blob_stats &moon, const blob_window &win, int width, int height);
+void blob_threshold(const frame_buffer *frame, int x_origin, int y_origin, int width, int height,
+	const blob_window &win, int level, uint32_t *hist, unsigned char *shared);
+int blob_search(const frame_buffer *frame, int x_origin, int y_origin, int width, int height, int level,
+	uint32_t *hist, unsigned char *shared, blob_stats &moon, int &others, int &windowed);
+void blob_track(const blob_stats &moon, bool fitted, const limb_circle &circle, int width, int height);
+void blob_track_reset();
+
+#endif
@@ -21,28 +21,20 @@
 /**
  * This function confirms that there is enought space on the output drive for a new video to be saved.
  * While this is similar to LunAero.cpp/startup_disk_check, it only checks the available space rather
- * than the drive integrity.  And, it does not predictively check for low hard drive space for future
- * videos.  If the check fails, a positive status is returned and the program ends.
+ * than the drive integrity.  The drive must hold at least DISK_MIN_SEGMENT seconds of video at the
+ * forecast rate, since disk_plan_segment shortens the last segment to fit.  If the check fails, a
+ * positive status is returned and the program ends.
  *
  * @return status
  */
 int confirm_filespace() {
-	if (DEBUG_COUT) {
-		LOGGING.open(LOGOUT, std::ios_base::app);
-		LOGGING
-		<< "Confirming filespace" << std::endl;
-		LOGGING.close();
-	}
+	LOG_INFO("Confirming filespace");
+	disk_sync_drive();
 	namespace fs = std::filesystem;
 	fs::space_info tmp = fs::space(DEFAULT_FILEPATH);
-	if (tmp.available < (1000000 * std::chrono::duration<double>(RECORD_DURATION).count())) {
-		if (DEBUG_COUT) {
-			LOGGING.open(LOGOUT, std::ios_base::app);
-			LOGGING
-			<< "ERROR: The space on this drive is too low with "
-			<< tmp.available << " bytes remaining, exiting." << std::endl;
-			LOGGING.close();
-		}
+	if (tmp.available < (disk_forecast_bytes(DISK_MIN_SEGMENT) + DISK_RESERVE)) {
+		LOG_ERROR("ERROR: The space on this drive is too low with "
+			<< tmp.available << " bytes remaining, exiting.");
 		return 1;
 	}
 	return 0;
@@ -53,63 +45,39 @@ int confirm_filespace() {
  * of the raspivid program caused by quick successive stops and starts.  Originally, on these restarts,
  * the MMAL may fail for a few microseconds after a shutdown since something had not finished clearing
  * in the background (black magic).  This simply handles a few failures before deciding that the MMAL
- * device is not actually connected and ending the program.
+ * device is not actually connected and ending the program.  The log is read once camera_wait_ready
+ * finds raspivid has finished starting, rather than after a fixed delay.
  *
  * @return status
  */
 int confirm_mmal_safety(int error_cnt) {
-	if (DEBUG_COUT) {
-		LOGGING.open(LOGOUT, std::ios_base::app);
-		LOGGING
-		<< "mmal safety count: " << error_cnt << std::endl;
-		LOGGING.close();
-	}
+	LOG_DEBUG("mmal safety count: " << error_cnt);
+	wd_beat(WD_CAMERA, "checking for MMAL errors");
 	// If the retry attempts are way too high, don't even bother
 	if (error_cnt > MMAL_ERROR_THRESH) {
-		if (DEBUG_COUT) {
-			LOGGING.open(LOGOUT, std::ios_base::app);
-			LOGGING
-			<< "ERROR: LunAero detected repeating MMAL problems.  Exiting" << std::endl;
-			LOGGING.close();
-		}
+		LOG_ERROR("ERROR: LunAero detected repeating MMAL problems.  Exiting");
+		telem_error(TELEM_ERR_MMAL, "repeating MMAL problems");
 		kill_raspivid();
-		sem_wait(&LOCK);
-		*val_ptr.ABORTaddr = 1;
-		sem_post(&LOCK);
+		abort_code();
 		return 101;
 	}
 	// source_command == 1 for preview, 2 for recording
-	usleep(1000000);
+	camera_wait_ready();
 	std::string str_mmal = "mmal:";
-	std::ifstream file("/tmp/raspivid.log");
+	std::ifstream file(CAMERA_LOG);
 	if (file.is_open()) {
 		std::string line;
 		while (std::getline(file, line)) {
-			if (DEBUG_COUT) {
-				LOGGING.open(LOGOUT, std::ios_base::app);
-				LOGGING
-				<< line << std::endl;
-				LOGGING.close();
-			}
+			LOG_DEBUG(line);
 			if (line.find(str_mmal) != std::string::npos) {
-				if (DEBUG_COUT) {
-					LOGGING.open(LOGOUT, std::ios_base::app);
-					LOGGING
-					<< "WARNING: LunAero detected an MMAL problem with raspivid.  Retrying" << std::endl;
-					LOGGING.close();
-				}
+				LOG_WARN("WARNING: LunAero detected an MMAL problem with raspivid.  Retrying");
+				telem_camera(TELEM_CAM_MMAL, error_cnt, 0);
+				metric_add(METRICS.mmal_errors);
 				if (error_cnt > MMAL_ERROR_THRESH) {
-					sem_wait(&LOCK);
-					*val_ptr.ABORTaddr = 1;
-					sem_post(&LOCK);
+					abort_code();
 				} else {
 					// Alternate kill method if "pidof" doesn't work right
-					if (DEBUG_COUT) {
-						LOGGING.open(LOGOUT, std::ios_base::app);
-						LOGGING
-						<< "attempting killall" << std::endl;
-						LOGGING.close();
-					}
+					LOG_INFO("attempting killall");
 					std::string commandstring = "killall raspivid";
 					system(commandstring.c_str());
 				}
@@ -127,44 +95,134 @@ int confirm_mmal_safety(int error_cnt) {
 	return 0;
 }
 
+/**
+ * This function finds the process ID of the running raspivid.
+ *
+ * @return pid process ID of raspivid, or 0 if it is not running
+ */
+pid_t raspivid_pid() {
+	char line[1024] = {0};
+	FILE *cmd = popen("pidof raspivid", "r");
+	if (cmd == NULL) {
+		return 0;
+	}
+	if (fgets(line, 1024, cmd) == NULL) {
+		pclose(cmd);
+		return 0;
+	}
+	pclose(cmd);
+	return strtoul(line, NULL, 10);
+}
+
+/**
+ * This function waits for a newly launched raspivid to finish starting.  raspivid prints its setup
+ * messages, including any MMAL failures, to CAMERA_LOG in one burst.  Once the log has stopped growing
+ * for CAMERA_SETTLE_MS, or an MMAL message appears, there is nothing more to wait for.  The wait never
+ * exceeds CAMERA_WAIT_MS.
+ *
+ * @return status 0 if raspivid settled, 1 if the wait timed out
+ */
+int camera_wait_ready() {
+	auto start = std::chrono::steady_clock::now();
+	auto changed = start;
+	off_t last_size = -1;
+	while (std::chrono::steady_clock::now() - start < std::chrono::milliseconds(CAMERA_WAIT_MS)) {
+		struct stat info;
+		if (stat(CAMERA_LOG, &info) == 0) {
+			if (info.st_size != last_size) {
+				last_size = info.st_size;
+				changed = std::chrono::steady_clock::now();
+				std::ifstream file(CAMERA_LOG);
+				std::string line;
+				while (std::getline(file, line)) {
+					if (line.find("mmal:") != std::string::npos) {
+						return 0;
+					}
+				}
+			} else if ((last_size > 0)
+				&& (std::chrono::steady_clock::now() - changed >= std::chrono::milliseconds(CAMERA_SETTLE_MS))) {
+				return 0;
+			}
+		}
+		usleep(CAMERA_POLL_US);
+	}
+	LOG_DEBUG("raspivid did not settle within " << CAMERA_WAIT_MS << " ms");
+	return 1;
+}
+
+/**
+ * This function waits for raspivid to exit after it has been signalled, so the camera is free for the
+ * next instance.  The wait never exceeds CAMERA_WAIT_MS.
+ *
+ * @return status 0 if raspivid exited, 1 if the wait timed out
+ */
+int camera_wait_exit() {
+	auto start = std::chrono::steady_clock::now();
+	while (std::chrono::steady_clock::now() - start < std::chrono::milliseconds(CAMERA_WAIT_MS)) {
+		if (raspivid_pid() == 0) {
+			return 0;
+		}
+		usleep(CAMERA_POLL_US);
+	}
+	LOG_DEBUG("raspivid did not exit within " << CAMERA_WAIT_MS << " ms");
+	return 1;
+}
+
 /**
  * This functions ties together multiple functions to 1) confirm_filespace 2) confirm_mmal_safety 3)
- * execute the command constructed by command_cam_start.
+ * execute the command constructed by command_cam_start.  The previous segment is closed first so its
+ * unused preallocation is returned before the filespace is confirmed, which selects the drive the
+ * segment is written to.  The output of raspivid is handed to writer_start as soon as it launches so
+ * the encoder never waits on the pipe.  Once raspivid is running, the segment is added to the session
+ * manifest.
  *
  *
  */
 void camera_start() {
-	if (DEBUG_COUT) {
-		LOGGING.open(LOGOUT, std::ios_base::app);
-		LOGGING
-		<< "\n\nNOW RECORDING\n\nPATH: " << FILEPATH << std::endl;
-		LOGGING.close();
+	writer_finish();
+	if (confirm_filespace()) {
+		abort_code();
+		return;
 	}
+	
+	LOG_INFO("\n\nNOW RECORDING\n\nPATH: " << FILEPATH);
 	// Call preview of camera
 	std::string commandstring = "";
 	commandstring = command_cam_start();
 	
-	if (confirm_filespace()) {
-		sem_wait(&LOCK);
-		*val_ptr.ABORTaddr = 1;
-		sem_post(&LOCK);
-		usleep(1000000);
-		return;
-	}
-	
 	int mmal_safety_outcome = 1;
 	
 	while (mmal_safety_outcome) {
-		system(commandstring.c_str());
+		unlink(CAMERA_LOG);
+		FILE *pipe = popen(commandstring.c_str(), "r");
+		if ((pipe == NULL) || writer_start(pipe, FILEPATH + "/" + TSBUFF + "outA.h264")) {
+			if (pipe != NULL) {
+				kill_raspivid();
+				pclose(pipe);
+			}
+			notify_handler("LunAero Error", "Could not start writing the video.");
+			abort_code();
+			return;
+		}
 		mmal_safety_outcome = confirm_mmal_safety(mmal_safety_outcome);
-		usleep(1000000);
+		if (mmal_safety_outcome) {
+			// raspivid has already been killed, so the empty segment can be closed
+			writer_finish();
+			camera_wait_exit();
+		}
 	}
+	RASPIVID_RUNNING = true;
+	disk_manifest_add(TSBUFF + "outA.h264");
+	telem_camera(TELEM_CAM_RECORD, DISK_LOCAL_INDEX, 0);
+	*val_ptr.SEGMENTaddr += 1;
+	gui_notify();
 	return;
 }
 
 /**
  * This command starts the preview screen using raspivid.  The command is constructed based on
- * command_cam_preview and the MMAL integrity is checked with mmal_safety_outcome.
+ * command_cam_preview and the MMAL integrity is checked with mmal_safety_outcome.  A failed attempt is
+ * retried as soon as the old raspivid has exited.
  *
  *
  */
@@ -176,13 +234,67 @@ void camera_preview() {
 	int mmal_safety_outcome = 1;
 	
 	while (mmal_safety_outcome) {
+		unlink(CAMERA_LOG);
 		system(commandstring.c_str());
 		mmal_safety_outcome = confirm_mmal_safety(mmal_safety_outcome);
-		usleep(1000000);
+		if (mmal_safety_outcome) {
+			camera_wait_exit();
+		}
 	}
+	RASPIVID_RUNNING = true;
+	telem_camera(TELEM_CAM_PREVIEW, 0, 0);
 	return;
 }
 
+/**
+ * This function places the raspivid preview window, and so the region current_frame analyses, in the
+ * screen area given by WORK_WIDTH and WORK_HEIGHT.  The RVD_ globals are defined here.
+ *
+ */
+void preview_geometry() {
+	// Calculate the estimated size of a Raspivid window
+	RVD_HEIGHT = WORK_HEIGHT/2;
+	RVD_WIDTH = WORK_WIDTH/2;
+	if ((RVD_WIDTH/RVD_HEIGHT) != (16/9)) {
+		if ((RVD_WIDTH/RVD_HEIGHT) > (16/9)) {
+			RVD_WIDTH = RVD_HEIGHT * 16/9;
+		} else {
+			RVD_HEIGHT = RVD_WIDTH * 9/16;
+		}
+	}
+	LOG_DEBUG("Est Raspivid preview W: " << RVD_WIDTH << " x H: " << RVD_HEIGHT);
+	// Calculate the Raspivid preview corner
+	RVD_XCORN = (WORK_WIDTH/2)-(WORK_WIDTH/4);
+	RVD_YCORN = (WORK_HEIGHT/2);
+	LOG_DEBUG("Raspivid corner X: " << RVD_XCORN << " x Y: " << RVD_YCORN);
+}
+
+/**
+ * This function measures the screen for a headless run, where GTK and X are never started.  The size is
+ * read from the DISPMANX display which raspivid draws its preview on and current_frame takes its
+ * screenshots from, so the analysed region is placed the same way with or without a monitor.
+ *
+ * @return status 0 if the display was measured, 1 if there is no display to capture from
+ */
+int headless_screen_size() {
+	bcm_host_init();
+	DISPMANX_DISPLAY_HANDLE_T display = vc_dispmanx_display_open(0);
+	DISPMANX_MODEINFO_T info;
+	if ((display == 0) || (vc_dispmanx_display_get_info(display, &info) != 0)) {
+		LOG_ERROR("ERROR: failed to get display info for the headless preview");
+		if (display != 0) {
+			vc_dispmanx_display_close(display);
+		}
+		return 1;
+	}
+	vc_dispmanx_display_close(display);
+	WORK_WIDTH = info.width;
+	WORK_HEIGHT = info.height;
+	LOG_DEBUG("headless display W: " << WORK_WIDTH << " x H: " << WORK_HEIGHT);
+	preview_geometry();
+	return 0;
+}
+
 /**
  * This function constructs the command string to call a raspivid preview.  The size of the mini screen
  * determined by other functions and used to construct the window.
@@ -212,19 +324,14 @@ std::string command_cam_preview() {
 	+ ","
 	+ std::to_string(RVD_HEIGHT)
 	+ " > /tmp/raspivid.log 2>&1 &";
-	if (DEBUG_COUT) {
-		LOGGING.open(LOGOUT, std::ios_base::app);
-		LOGGING
-		<< "Using the command: " << commandstring << std::endl;
-		LOGGING.close();
-	}
+	LOG_INFO("Using the command: " << commandstring);
 	return commandstring;
 }
 
 /**
  * This function constructs the command string to call a raspivid recording and preview window.  The 
  * size of the mini screen determined by other functions and used to construct the preview window.  The
- * save location of the video is determined by the current timestamp.
+ * video is sent to stdout for writer_start, which saves it under the current timestamp.
  *
  * @return commandstring the constructed command formatted as a string
  */
@@ -250,17 +357,8 @@ std::string command_cam_start() {
 	+ std::to_string(RVD_WIDTH)
 	+ ","
 	+ std::to_string(RVD_HEIGHT)
-	+ " -o "
-	+ FILEPATH
-	+ "/"
-	+ TSBUFF
-	+ "outA.h264 > /tmp/raspivid.log 2>&1 &";
-	if (DEBUG_COUT) {
-		LOGGING.open(LOGOUT, std::ios_base::app);
-		LOGGING
-		<< "Using the command: " << commandstring << std::endl;
-		LOGGING.close();
-	}
+	+ " -o - 2> /tmp/raspivid.log";
+	LOG_INFO("Using the command: " << commandstring);
 	
 	return commandstring;
 }
@@ -311,44 +409,138 @@ void write_video_id() {
  */
 void first_record() {
 	kill_raspivid();
-	sem_wait(&LOCK);
-	//~ *val_ptr.RUN_MODEaddr = 1;
+	camera_wait_exit();
 	*val_ptr.DUTY_Aaddr = 20;
 	*val_ptr.DUTY_Baddr = 20;
-	sem_post(&LOCK);
 	camera_start();
-	if (DEBUG_COUT) {
-		LOGGING.open(LOGOUT, std::ios_base::app);
-		LOGGING
-		<< "-----------------\nRECORDING STARTED\n-----------------\n" << std::endl;
-		LOGGING.close();
-	}
+	LOG_INFO("-----------------\nRECORDING STARTED\n-----------------\n");
 }
 
 /**
  * This helper function kills raspivid and starts recording for each video restart subsequent to the
- * initial recording.
+ * initial recording.  The new recording starts as soon as the old raspivid has released the camera.
  *
  *
  */
 void reset_record() {
+	metric_add(METRICS.camera_restarts);
 	kill_raspivid();
-	usleep(1000000);
+	camera_wait_exit();
 	camera_start();
 }
 
 /**
  * This helper function is called by a GTK button and is used to kill the existing preview window and
- * replace it with a new window based on the latest ISO/Shutter values.
+ * replace it with a new window based on the latest ISO/Shutter values.  The camera thread does the
+ * work, so the GUI is not held up while raspivid restarts.
  *
  *
  */
 void refresh_camera() {
-	kill_raspivid();
-	sem_wait(&LOCK);
-	*val_ptr.REFRESH_CAMaddr = 1;
-	sem_post(&LOCK);
+	CAMERA_QUEUE.push(CAM_REQ_REFRESH);
+}
+
+/**
+ * This function runs on the camera thread, which owns raspivid and the segment writer.  The preview is
+ * started first, then requests from the GUI are taken from CAMERA_QUEUE.  Once recording, the drive is
+ * checked every CAMERA_MONITOR_MS and a new segment is started when disk_monitor_check asks for one or
+ * CAM_REQ_ROTATE is received.
+ * When the run is aborted, raspivid is stopped and the last segment is closed before the thread exits.
+ *
+ */
+void camera_loop() {
+	log_set_thread(1, 'C');
+	LOG_INFO("started camera thread");
+	wd_beat(WD_CAMERA, "starting preview");
 	camera_preview();
+	startup_step("camera preview", STARTUP_SPAWN);
+	startup_step("preview ready", LOG_EPOCH);
+	*val_ptr.RUN_MODEaddr = 0;
+	telem_mode();
+	gui_notify();
+	
+	camera_request request;
+	while (*val_ptr.ABORTaddr == 0) {
+		wd_beat(WD_CAMERA, "waiting for requests");
+		bool received = CAMERA_QUEUE.pop(request, std::chrono::milliseconds(CAMERA_MONITOR_MS));
+		if ((*val_ptr.ABORTaddr != 0) || (received && (request == CAM_REQ_STOP))) {
+			break;
+		}
+		if (!received) {
+			// Catch a raspivid which has exited on its own
+			RASPIVID_RUNNING = (raspivid_pid() != 0);
+		}
+		if (received && (request == CAM_REQ_REFRESH || request == CAM_REQ_RESTART)
+			&& (*val_ptr.RUN_MODEaddr == 0)) {
+			wd_beat(WD_CAMERA, "restarting preview");
+			metric_add(METRICS.camera_restarts);
+			telem_camera(TELEM_CAM_REFRESH, 0, 0);
+			kill_raspivid();
+			camera_wait_exit();
+			camera_preview();
+		} else if (received && (request == CAM_REQ_RESTART) && (*val_ptr.RUN_MODEaddr == 1)) {
+			// The watchdog killed raspivid to free this thread, so start a new segment
+			wd_beat(WD_CAMERA, "restarting recording");
+			OLD_RECORD_TIME = std::chrono::system_clock::now();
+			disk_plan_segment();
+			exposure_update();
+			reset_record();
+		} else if (received && (request == CAM_REQ_RECORD) && (*val_ptr.RUN_MODEaddr == 0)) {
+			wd_beat(WD_CAMERA, "starting recording");
+			// Plan the first segment before starting it, so it is written to the drive and for the length
+			// planned, as with every later segment.  The GUI has already checked for room with
+			// disk_has_room, so this only refuses a headless request or a drive which just filled.
+			if (disk_plan_segment() == 2) {
+				telem_error(TELEM_ERR_DISK_FULL, "the drive is full");
+				notify_handler("LunAero Warning", "The drive is full.  Recording was not started.");
+				gui_notify();
+				continue;
+			}
+			exposure_reset();
+			first_record();
+			*val_ptr.RUN_MODEaddr = 1;
+			telem_mode();
+			gui_notify();
+			ANALYSIS_QUEUE.push(ANA_REQ_START);
+			OLD_RECORD_TIME = std::chrono::system_clock::now();
+		} else if (((!received) || (request == CAM_REQ_ROTATE)) && (*val_ptr.RUN_MODEaddr == 1)) {
+			wd_beat(WD_CAMERA, "checking the drive");
+			auto current_time = std::chrono::system_clock::now();
+			std::chrono::duration<double> elapsed_seconds = current_time-OLD_RECORD_TIME;
+			int disk_status = disk_monitor_check(elapsed_seconds);
+			if (received) {
+				// A new segment was asked for, so start one now unless the drive is already full
+				LOG_INFO("segment rotation requested");
+				disk_status = (disk_status == 2) ? 2 : 1;
+			}
+			if (disk_status == 1) {
+				if (disk_plan_segment() == 2) {
+					disk_status = 2;
+				}
+			}
+			if (disk_status == 1) {
+				LOG_INFO("refreshing camera");
+				OLD_RECORD_TIME = std::chrono::system_clock::now();
+				exposure_update();
+				reset_record();
+			} else if (disk_status == 2) {
+				// The final segment is complete, close it cleanly before the drive fills
+				LOG_INFO("final segment complete, the drive is full");
+				telem_error(TELEM_ERR_DISK_FULL, "the drive is full");
+				notify_handler("LunAero Warning", "The drive is full.  Recording stopped cleanly.");
+				abort_code();
+			}
+		}
+	}
+	LOG_INFO("caught abort code: "
+		<< *val_ptr.ABORTaddr
+		<< " run mode: "
+		<< *val_ptr.RUN_MODEaddr);
+	telem_mode();
+	
+	// Close the last segment once raspivid has stopped writing to it
+	cleanup();
+	writer_finish();
 }
 
 /**
@@ -359,20 +551,12 @@ void refresh_camera() {
  */
 void shutter_up() {
 	if (*val_ptr.SHUTTER_VALaddr < 32901) {
-		sem_wait(&LOCK);
 		*val_ptr.SHUTTER_VALaddr = *val_ptr.SHUTTER_VALaddr + SHUT_JUMP;
-		sem_post(&LOCK);
 	} else {
-		sem_wait(&LOCK);
 		*val_ptr.SHUTTER_VALaddr = 33000;
-		sem_post(&LOCK);
-	}
-	if (DEBUG_COUT) {
-		LOGGING.open(LOGOUT, std::ios_base::app);
-		LOGGING
-		<< "SHUTTER_VAL: " << *val_ptr.SHUTTER_VALaddr << std::endl;
-		LOGGING.close();
 	}
+	LOG_INFO("SHUTTER_VAL: " << *val_ptr.SHUTTER_VALaddr);
+	gui_notify();
 }
 
 /**
@@ -383,20 +567,12 @@ void shutter_up() {
  */
 void shutter_down() {
 	if (*val_ptr.SHUTTER_VALaddr > 110) {
-		sem_wait(&LOCK);
 		*val_ptr.SHUTTER_VALaddr = *val_ptr.SHUTTER_VALaddr - SHUT_JUMP;
-		sem_post(&LOCK);
 	} else {
-		sem_wait(&LOCK);
 		*val_ptr.SHUTTER_VALaddr = 10;
-		sem_post(&LOCK);
-	}
-	if (DEBUG_COUT) {
-		LOGGING.open(LOGOUT, std::ios_base::app);
-		LOGGING
-		<< "SHUTTER_VAL: " << *val_ptr.SHUTTER_VALaddr << std::endl;
-		LOGGING.close();
 	}
+	LOG_INFO("SHUTTER_VAL: " << *val_ptr.SHUTTER_VALaddr);
+	gui_notify();
 }
 
 /**
@@ -407,20 +583,12 @@ void shutter_down() {
  */
 void shutter_up_up() {
 	if (*val_ptr.SHUTTER_VALaddr < 32001) {
-		sem_wait(&LOCK);
 		*val_ptr.SHUTTER_VALaddr = *val_ptr.SHUTTER_VALaddr + SHUT_JUMP_BIG;
-		sem_post(&LOCK);
 	} else {
-		sem_wait(&LOCK);
 		*val_ptr.SHUTTER_VALaddr = 33000;
-		sem_post(&LOCK);
-	}
-	if (DEBUG_COUT) {
-		LOGGING.open(LOGOUT, std::ios_base::app);
-		LOGGING
-		<< "SHUTTER_VAL: \n" << *val_ptr.SHUTTER_VALaddr << std::endl;
-		LOGGING.close();
 	}
+	LOG_INFO("SHUTTER_VAL: \n" << *val_ptr.SHUTTER_VALaddr);
+	gui_notify();
 }
 
 /**
@@ -431,20 +599,12 @@ void shutter_up_up() {
  */
 void shutter_down_down() {
 	if (*val_ptr.SHUTTER_VALaddr > 1010) {
-		sem_wait(&LOCK);
 		*val_ptr.SHUTTER_VALaddr = *val_ptr.SHUTTER_VALaddr - SHUT_JUMP_BIG;
-		sem_post(&LOCK);
 	} else {
-		sem_wait(&LOCK);
 		*val_ptr.SHUTTER_VALaddr = 10;
-		sem_post(&LOCK);
-	}
-	if (DEBUG_COUT) {
-		LOGGING.open(LOGOUT, std::ios_base::app);
-		LOGGING
-		<< "SHUTTER_VAL: " << *val_ptr.SHUTTER_VALaddr << std::endl;
-		LOGGING.close();
 	}
+	LOG_INFO("SHUTTER_VAL: " << *val_ptr.SHUTTER_VALaddr);
+	gui_notify();
 }
 
 /**
@@ -455,26 +615,14 @@ void shutter_down_down() {
  */
 void iso_cycle() {
 	if (*val_ptr.ISO_VALaddr == 200) {
-		sem_wait(&LOCK);
 		*val_ptr.ISO_VALaddr = 400;
-		sem_post(&LOCK);
 	} else if (*val_ptr.ISO_VALaddr == 400) {
-		sem_wait(&LOCK);
 		*val_ptr.ISO_VALaddr = 800;
-		sem_post(&LOCK);
 	} else if (*val_ptr.ISO_VALaddr == 800) {
-		sem_wait(&LOCK);
 		*val_ptr.ISO_VALaddr = 100;
-		sem_post(&LOCK);
 	} else if (*val_ptr.ISO_VALaddr == 100) {
-		sem_wait(&LOCK);
 		*val_ptr.ISO_VALaddr = 200;
-		sem_post(&LOCK);
-	}
-	if (DEBUG_COUT) {
-		LOGGING.open(LOGOUT, std::ios_base::app);
-		LOGGING
-		<< "ISO_VAL: " << *val_ptr.ISO_VALaddr << std::endl;
-		LOGGING.close();
 	}
+	LOG_INFO("ISO_VAL: " << *val_ptr.ISO_VALaddr);
+	gui_notify();
 }
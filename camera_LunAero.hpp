@@ -26,10 +26,57 @@
 // Module specific includes
 #include <gtk/gtk.h>       // provides GTK3
 #include <fstream>         // provides ifstream
+#include <sys/stat.h>      // provides stat
 
 // User Includes
 #include "LunAero.hpp"
 
+// Global Defined Constants
+/**
+ * Path raspivid writes its messages to.  MMAL problems and startup progress are read from here.
+ */
+#define CAMERA_LOG "/tmp/raspivid.log"
+/**
+ * Microseconds between checks while waiting for raspivid to start or stop.
+ */
+#define CAMERA_POLL_US 20000
+/**
+ * Milliseconds the raspivid log must stay unchanged before the camera is taken to be running.  raspivid
+ * prints its setup messages in one burst, so a quiet log means setup is finished.
+ */
+#define CAMERA_SETTLE_MS 200
+/**
+ * Longest time in milliseconds to wait for raspivid to start or stop.  This was the fixed delay used
+ * before waiting was based on what raspivid reports.
+ */
+#define CAMERA_WAIT_MS 1000
+/**
+ * Milliseconds between checks of the drive while recording.  This doesn't have to be super accurate.
+ */
+#define CAMERA_MONITOR_MS 5000
+
+/**
+ * Requests sent to the camera thread through CAMERA_QUEUE.
+ */
+enum camera_request {
+	CAM_REQ_REFRESH,
+	CAM_REQ_RECORD,
+	CAM_REQ_RESTART,
+	CAM_REQ_ROTATE,
+	CAM_REQ_STOP
+};
+
+/**
+ * Requests for the camera thread.  Only the camera thread starts and stops raspivid.
+ */
+inline msg_queue <camera_request> CAMERA_QUEUE;
+/**
+ * Set by the camera thread once raspivid has started, and cleared as soon as raspivid is told to stop.
+ * The camera thread also checks that raspivid is still running every CAMERA_MONITOR_MS.  frame_grab
+ * reads this rather than looking for raspivid itself.
+ */
+inline std::atomic<bool> RASPIVID_RUNNING{false};
+
 /**
  * Threshold of MMAL errors encountered sequentially before ending the run.  Customizable from
  * settings.cfg
@@ -50,16 +97,21 @@ inline std::string RPI_EX = "auto";
 /**
  * Shutter speed increase and decrease when using the up or down buttons.  Customziable from settings.cfg
  */
-inline int SHUT_JUMP = 100;
+inline std::atomic<int> SHUT_JUMP = 100;
 /**
  * Large shutter speed increase and decrease when using the up_up or down_down buttons.  Customizable
  * from settings.cfg
  */
-inline int SHUT_JUMP_BIG = 1000;
+inline std::atomic<int> SHUT_JUMP_BIG = 1000;
 
 // Function Prototypes
+void preview_geometry();
+int headless_screen_size();
 int confirm_filespace();
 int confirm_mmal_safety(int error_cnt);
+pid_t raspivid_pid();
+int camera_wait_ready();
+int camera_wait_exit();
 void camera_preview();
 void camera_start();
 std::string command_cam_start();
@@ -73,6 +125,7 @@ void shutter_down();
 void shutter_up_up();
 void shutter_down_down();
 void reset_record();
+void camera_loop();
 
 
 #endif
@@ -0,0 +1,390 @@
+/*
+ * C_LunAero/control_LunAero.cpp - Command socket functions for LunAero_C
+ * Copyright (C) <2020>  <Wesley T. Honeycutt>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * The command socket takes one command per line and answers each with one line starting with "ok" or
+ * "error".  Commands are
+ *   up, down, left, right, stop     move or stop the motors (preview only)
+ *   shutter +|-|++|--|VALUE         change the shutter speed like the buttons, or set it (preview only)
+ *   iso [VALUE]                     cycle the ISO like the button, or set it (preview only)
+ *   refresh                         restart the preview with the new camera values (preview only)
+ *   record                          start recording
+ *   rotate                          close the current segment and start a new one (recording only)
+ *   abort                           end the run, same as the Exit button
+ *   state                           current values as key=value pairs
+ *   help                            list the commands
+ * lunaero-ctl sends these from the command line or from a script.
+ */
+
+#include "control_LunAero.hpp"
+
+/**
+ * This function describes the running state of LunAero for the state command.  Only values which are
+ * shared between threads as atomics, and the last result of the analysis thread, are read, so the
+ * control thread never races the workers.
+ *
+ * @return state space separated key=value pairs
+ */
+std::string control_state() {
+	analysis_result result = analysis_latest();
+	std::string state;
+	state = "run_mode=" + std::to_string(*val_ptr.RUN_MODEaddr)
+		+ " headless=" + std::to_string(HEADLESS)
+		+ " abort=" + std::to_string(*val_ptr.ABORTaddr)
+		+ " shutter=" + std::to_string(*val_ptr.SHUTTER_VALaddr)
+		+ " iso=" + std::to_string(*val_ptr.ISO_VALaddr)
+		+ " lost=" + std::to_string(*val_ptr.LOST_COUNTERaddr)
+		+ " horz=" + std::to_string(*val_ptr.HORZ_DIRaddr)
+		+ " vert=" + std::to_string(*val_ptr.VERT_DIRaddr)
+		+ " stop=" + std::to_string(*val_ptr.STOP_DIRaddr)
+		+ " duty_a=" + std::to_string(*val_ptr.DUTY_Aaddr)
+		+ " duty_b=" + std::to_string(*val_ptr.DUTY_Baddr)
+		+ " drive=" + std::to_string(*val_ptr.DRIVE_INDEXaddr)
+		+ " segment=" + std::to_string(*val_ptr.SEGMENTaddr)
+		+ " framechecks=" + std::to_string(METRICS.framechecks.load(std::memory_order_relaxed))
+		+ " moon_area=" + std::to_string(result.area)
+		+ " moon_x=" + std::to_string(result.cx)
+		+ " moon_y=" + std::to_string(result.cy)
+		+ " frame_age_ms=" + std::to_string(result.age_ns / 1000000)
+		+ " threshold=" + std::to_string(THRESH_LEVEL.load(std::memory_order_relaxed))
+		+ " centroid_error_x=" + std::to_string(METRICS.centroid_error_x.load(std::memory_order_relaxed))
+		+ " centroid_error_y=" + std::to_string(METRICS.centroid_error_y.load(std::memory_order_relaxed))
+		+ " disk_time_to_full=" + std::to_string(METRICS.disk_time_to_full.load(std::memory_order_relaxed));
+	return state;
+}
+
+/**
+ * This function handles one line from the command socket.  The command is checked against the run mode
+ * the same way the keys are, then queued for control_dispatch and the GUI is woken to run it.  abort is
+ * the exception and is run straight away, so a unit can still be stopped if the GUI thread is stuck.
+ *
+ * @param line command without the trailing newline
+ * @return reply line starting with "ok" or "error", without a newline
+ */
+std::string control_command(std::string line) {
+	std::istringstream words(line);
+	std::string command;
+	std::string arg;
+	words >> command >> arg;
+	bool preview = (*val_ptr.RUN_MODEaddr == 0);
+	control_request request = {CTL_STOP, 0};
+
+	if (command.empty()) {
+		return "error empty command";
+	} else if (command == "help") {
+		return "ok up down left right stop shutter iso refresh record rotate abort state help";
+	} else if (command == "state") {
+		return "ok " + control_state();
+	} else if ((command == "abort") || (command == "quit")) {
+		abort_code();
+		return "ok aborting";
+	} else if (*val_ptr.ABORTaddr != 0) {
+		return "error LunAero is shutting down";
+	} else if ((command == "up") || (command == "down") || (command == "left") || (command == "right")
+		|| (command == "stop")) {
+		if (!preview) {
+			return "error the motors are automatic while recording";
+		}
+		if (command == "up") {
+			request.action = CTL_UP;
+		} else if (command == "down") {
+			request.action = CTL_DOWN;
+		} else if (command == "left") {
+			request.action = CTL_LEFT;
+		} else if (command == "right") {
+			request.action = CTL_RIGHT;
+		}
+	} else if (command == "shutter") {
+		if (!preview) {
+			return "error the shutter can only be changed in preview";
+		}
+		if (arg == "+") {
+			request.action = CTL_SHUTTER_UP;
+		} else if (arg == "-") {
+			request.action = CTL_SHUTTER_DOWN;
+		} else if (arg == "++") {
+			request.action = CTL_SHUTTER_UP_UP;
+		} else if (arg == "--") {
+			request.action = CTL_SHUTTER_DOWN_DOWN;
+		} else {
+			char *end = NULL;
+			long value = strtol(arg.c_str(), &end, 10);
+			if (arg.empty() || (*end != '\0') || (value < 10) || (value > 33000)) {
+				return "error shutter takes +, -, ++, --, or a value from 10 to 33000";
+			}
+			request.action = CTL_SHUTTER_SET;
+			request.value = value;
+		}
+	} else if (command == "iso") {
+		if (!preview) {
+			return "error the ISO can only be changed in preview";
+		}
+		if (arg.empty()) {
+			request.action = CTL_ISO_CYCLE;
+		} else if ((arg == "100") || (arg == "200") || (arg == "400") || (arg == "800")) {
+			request.action = CTL_ISO_SET;
+			request.value = std::stoi(arg);
+		} else {
+			return "error iso takes 100, 200, 400, or 800";
+		}
+	} else if (command == "refresh") {
+		if (!preview) {
+			return "error the camera can only be refreshed in preview";
+		}
+		request.action = CTL_REFRESH;
+	} else if (command == "record") {
+		if (!preview) {
+			return "error already recording";
+		}
+		request.action = CTL_RECORD;
+	} else if (command == "rotate") {
+		if (preview) {
+			return "error not recording";
+		}
+		request.action = CTL_ROTATE;
+	} else {
+		return "error unknown command \"" + command + "\", try help";
+	}
+	CONTROL_QUEUE.push(request);
+	gui_notify();
+	return "ok";
+}
+
+/**
+ * This function runs one queued action with the function behind the matching button or key.
+ *
+ * @param request action taken from CONTROL_QUEUE
+ */
+void control_apply(control_request request) {
+	bool preview = (*val_ptr.RUN_MODEaddr == 0);
+	switch (request.action) {
+		case CTL_UP:
+			if (preview) {
+				mot_up_command();
+			}
+			break;
+		case CTL_DOWN:
+			if (preview) {
+				mot_down_command();
+			}
+			break;
+		case CTL_LEFT:
+			if (preview) {
+				mot_left_command();
+			}
+			break;
+		case CTL_RIGHT:
+			if (preview) {
+				mot_right_command();
+			}
+			break;
+		case CTL_STOP:
+			if (preview) {
+				mot_stop_command();
+			}
+			break;
+		case CTL_SHUTTER_UP:
+			shutter_up();
+			break;
+		case CTL_SHUTTER_DOWN:
+			shutter_down();
+			break;
+		case CTL_SHUTTER_UP_UP:
+			shutter_up_up();
+			break;
+		case CTL_SHUTTER_DOWN_DOWN:
+			shutter_down_down();
+			break;
+		case CTL_SHUTTER_SET:
+			*val_ptr.SHUTTER_VALaddr = request.value;
+			LOG_INFO("SHUTTER_VAL: " << *val_ptr.SHUTTER_VALaddr);
+			gui_notify();
+			break;
+		case CTL_ISO_CYCLE:
+			iso_cycle();
+			break;
+		case CTL_ISO_SET:
+			*val_ptr.ISO_VALaddr = request.value;
+			LOG_INFO("ISO_VAL: " << *val_ptr.ISO_VALaddr);
+			gui_notify();
+			break;
+		case CTL_REFRESH:
+			if (preview) {
+				refresh_camera();
+			}
+			break;
+		case CTL_RECORD:
+			if (preview && HEADLESS) {
+				// There is no window to change, and the camera thread ignores repeat requests
+				CAMERA_QUEUE.push(CAM_REQ_RECORD);
+			} else if (preview) {
+				first_record_killer(NULL);
+			}
+			break;
+		case CTL_ROTATE:
+			if (!preview) {
+				CAMERA_QUEUE.push(CAM_REQ_ROTATE);
+			}
+			break;
+	}
+}
+
+/**
+ * This function runs every action waiting in CONTROL_QUEUE.  It is called from the GUI loop, so actions
+ * from the command socket run on the same thread as the buttons.  headless_loop calls it in a headless
+ * run.
+ *
+ */
+void control_dispatch() {
+	control_request request;
+	while (CONTROL_QUEUE.pop(request, std::chrono::milliseconds(0))) {
+		control_apply(request);
+	}
+}
+
+/**
+ * This function sends a reply line to a client.  MSG_NOSIGNAL keeps a client which has already hung up
+ * from raising SIGPIPE and ending LunAero.
+ *
+ * @param fd connected client socket
+ * @param reply line to send, without the newline
+ * @return status 0 if the whole line was sent
+ */
+static int control_send(int fd, std::string reply) {
+	reply += "\n";
+	size_t done = 0;
+	while (done < reply.size()) {
+		ssize_t ret = send(fd, reply.data() + done, reply.size() - done, MSG_NOSIGNAL);
+		if (ret <= 0) {
+			return 1;
+		}
+		done += ret;
+	}
+	return 0;
+}
+
+/**
+ * This function runs on the control thread.  Up to CONTROL_CLIENTS clients may be connected at once, and
+ * each may send any number of commands before hanging up.  Every complete line is answered in order.
+ *
+ */
+void control_loop() {
+	std::vector <int> clients;
+	std::vector <std::string> pending;
+	while (*val_ptr.ABORTaddr == 0) {
+		std::vector <struct pollfd> pfds;
+		pfds.push_back({(clients.size() < CONTROL_CLIENTS) ? CONTROL_FD : -1, POLLIN, 0});
+		for (int fd : clients) {
+			pfds.push_back({fd, POLLIN, 0});
+		}
+		if (poll(pfds.data(), pfds.size(), CONTROL_POLL_MS) <= 0) {
+			continue;
+		}
+		// Clients are checked from the back so a closed one can be removed in place
+		for (int i=(int)clients.size()-1; i>=0; i--) {
+			if (pfds[i + 1].revents == 0) {
+				continue;
+			}
+			char buffer[CONTROL_LINE_MAX];
+			ssize_t got = read(clients[i], buffer, sizeof(buffer));
+			bool drop = (got <= 0);
+			if (got > 0) {
+				pending[i].append(buffer, got);
+			}
+			size_t newline;
+			while ((!drop) && ((newline = pending[i].find('\n')) != std::string::npos)) {
+				std::string line = pending[i].substr(0, newline);
+				pending[i].erase(0, newline + 1);
+				if ((!line.empty()) && (line.back() == '\r')) {
+					line.pop_back();
+				}
+				std::string reply = control_command(line);
+				LOG_INFO("control: \"" << line << "\" -> " << reply);
+				drop = (control_send(clients[i], reply) != 0);
+			}
+			if ((!drop) && (pending[i].size() >= CONTROL_LINE_MAX)) {
+				control_send(clients[i], "error line too long");
+				drop = true;
+			}
+			if (drop) {
+				close(clients[i]);
+				clients.erase(clients.begin() + i);
+				pending.erase(pending.begin() + i);
+			}
+		}
+		if (pfds[0].revents & POLLIN) {
+			int fd = accept4(CONTROL_FD, NULL, NULL, SOCK_CLOEXEC);
+			if (fd >= 0) {
+				clients.push_back(fd);
+				pending.push_back("");
+			}
+		}
+	}
+	for (int fd : clients) {
+		close(fd);
+	}
+}
+
+/**
+ * This function opens the command socket at CONTROL_SOCKET and starts the control thread.  A socket left
+ * by an earlier run is replaced.  The socket is only reachable by the user running LunAero.
+ *
+ * @return status 0 if commands are taken or CONTROL_SOCKET is empty
+ */
+int control_start() {
+	if (CONTROL_SOCKET.empty()) {
+		return 0;
+	}
+	struct sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if (CONTROL_SOCKET.size() >= sizeof(addr.sun_path)) {
+		LOG_WARN("WARNING: CONTROL_SOCKET path is too long, commands are not taken");
+		return 1;
+	}
+	strcpy(addr.sun_path, CONTROL_SOCKET.c_str());
+	unlink(CONTROL_SOCKET.c_str());
+	CONTROL_FD = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if ((CONTROL_FD < 0) || (bind(CONTROL_FD, (struct sockaddr *)&addr, sizeof(addr)) != 0)
+		|| (chmod(CONTROL_SOCKET.c_str(), 0600) != 0) || (listen(CONTROL_FD, CONTROL_CLIENTS) != 0)) {
+		LOG_WARN("WARNING: could not open " << CONTROL_SOCKET << ", commands are not taken");
+		if (CONTROL_FD >= 0) {
+			close(CONTROL_FD);
+		}
+		CONTROL_FD = -1;
+		return 1;
+	}
+	CONTROL_THREAD = std::thread(control_loop);
+	LOG_INFO("taking commands on " << CONTROL_SOCKET);
+	return 0;
+}
+
+/**
+ * This function stops the control thread once the run is aborted and removes the socket.
+ *
+ */
+void control_stop() {
+	if (CONTROL_THREAD.joinable()) {
+		CONTROL_THREAD.join();
+	}
+	if (CONTROL_FD >= 0) {
+		close(CONTROL_FD);
+		unlink(CONTROL_SOCKET.c_str());
+		CONTROL_FD = -1;
+	}
+}
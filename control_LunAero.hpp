@@ -0,0 +1,114 @@
+/*
+ * C_LunAero/control_LunAero.hpp - Command socket for LunAero_C
+ * Copyright (C) <2020>  <Wesley T. Honeycutt>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CONTROL_LUNAERO_H
+#define CONTROL_LUNAERO_H
+
+// Standard C++ includes
+#include <string>
+#include <sstream>         // provides istringstream
+#include <vector>
+
+// Module specific includes
+#include <poll.h>          // provides poll
+#include <sys/stat.h>      // provides chmod
+#include <sys/socket.h>    // provides socket
+#include <sys/un.h>        // provides sockaddr_un
+#include <unistd.h>        // provides read and write
+
+// User Includes
+#include "LunAero.hpp"
+
+// Global Defined Constants
+/**
+ * Most clients connected to the command socket at once.  Further connections wait until one closes.
+ */
+#define CONTROL_CLIENTS 4
+/**
+ * Longest command line in bytes.  A client sending a longer line is disconnected.
+ */
+#define CONTROL_LINE_MAX 256
+/**
+ * Milliseconds the control thread waits for a command before checking for an abort.
+ */
+#define CONTROL_POLL_MS 250
+
+/**
+ * Actions which can be requested through the command socket.  Each one runs the same function as the
+ * matching button or key.
+ */
+enum control_action {
+	CTL_UP,
+	CTL_DOWN,
+	CTL_LEFT,
+	CTL_RIGHT,
+	CTL_STOP,
+	CTL_SHUTTER_UP,
+	CTL_SHUTTER_DOWN,
+	CTL_SHUTTER_UP_UP,
+	CTL_SHUTTER_DOWN_DOWN,
+	CTL_SHUTTER_SET,
+	CTL_ISO_CYCLE,
+	CTL_ISO_SET,
+	CTL_REFRESH,
+	CTL_RECORD,
+	CTL_ROTATE
+};
+
+/**
+ * An action taken from the command socket, waiting to be run on the GUI thread.
+ */
+struct control_request {
+	control_action action;
+	/**
+	 * Value for CTL_SHUTTER_SET and CTL_ISO_SET.
+	 */
+	int value;
+};
+
+/**
+ * Path of the Unix socket LunAero takes commands on.  Empty to only allow control from the GUI.
+ * Customizable from settings.cfg.
+ */
+inline std::string CONTROL_SOCKET = "/tmp/lunaero-control.sock";
+
+/**
+ * Actions from the command socket.  They are run by control_dispatch on the GUI thread, where the
+ * buttons and keys run theirs, so a command and a button press can never race.  In a headless run the
+ * main thread runs them from headless_loop.
+ */
+inline msg_queue <control_request> CONTROL_QUEUE;
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+
+// Global Variables - Not "private" but not necessary to define for Doxygen
+inline int CONTROL_FD = -1;
+inline std::thread CONTROL_THREAD;
+
+#endif /* DOXYGEN_SHOULD_SKIP_THIS */
+
+// Function Prototypes
+std::string control_state();
+std::string control_command(std::string line);
+void control_apply(control_request request);
+void control_dispatch();
+void control_loop();
+int control_start();
+void control_stop();
+
+#endif
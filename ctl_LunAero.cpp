@@ -0,0 +1,165 @@
+/*
+ * C_LunAero/ctl_LunAero.cpp - Command socket client for LunAero_C
+ * Copyright (C) <2020>  <Wesley T. Honeycutt>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * lunaero-ctl sends commands to a running LunAero through its command socket, so a unit can be
+ * operated over SSH or from a script without a screen or keyboard.  It only depends on the standard
+ * library and POSIX.
+ *
+ * Build with
+ *   make ctl
+ *
+ * Usage
+ *   lunaero-ctl [--socket PATH] COMMAND [ARG]
+ *   lunaero-ctl [--socket PATH] < script
+ *
+ *   --socket   CONTROL_SOCKET from settings.cfg, default /tmp/lunaero-control.sock
+ *
+ * With a command on the command line it is sent and the reply printed.  Otherwise one command is read
+ * from each line of stdin and the replies are printed in order.  Lines starting with # are skipped.
+ * Run "lunaero-ctl help" for the list of commands.
+ *
+ * The exit status is 0 if every command was accepted, 1 if any was refused, and 2 if LunAero could not
+ * be reached.
+ */
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+/**
+ * Default path of the command socket, matching CONTROL_SOCKET in settings.cfg.
+ */
+#define CTL_DEFAULT_SOCKET "/tmp/lunaero-control.sock"
+
+/**
+ * This function connects to the command socket.
+ *
+ * @param path path of the socket
+ * @return fd connected socket, or -1 on failure
+ */
+int ctl_connect(const std::string &path) {
+	struct sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if (path.size() >= sizeof(addr.sun_path)) {
+		std::cerr << "lunaero-ctl: socket path is too long" << std::endl;
+		return -1;
+	}
+	strcpy(addr.sun_path, path.c_str());
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0) {
+		perror("lunaero-ctl: socket");
+		return -1;
+	}
+	if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+		std::cerr << "lunaero-ctl: could not connect to " << path << ": " << strerror(errno)
+			<< "\nIs LunAero running?" << std::endl;
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+/**
+ * This function sends one command and waits for its reply line.
+ *
+ * @param fd connected socket
+ * @param command command without a newline
+ * @param reply filled with the reply without its newline
+ * @return status 0 if a reply was read, 1 if the connection was lost
+ */
+int ctl_send(int fd, const std::string &command, std::string &reply) {
+	std::string line = command + "\n";
+	size_t done = 0;
+	while (done < line.size()) {
+		ssize_t ret = send(fd, line.data() + done, line.size() - done, MSG_NOSIGNAL);
+		if (ret <= 0) {
+			return 1;
+		}
+		done += ret;
+	}
+	reply.clear();
+	char c;
+	while (true) {
+		ssize_t ret = read(fd, &c, 1);
+		if (ret <= 0) {
+			return 1;
+		}
+		if (c == '\n') {
+			return 0;
+		}
+		reply += c;
+	}
+}
+
+int main(int argc, char **argv) {
+	std::string path = CTL_DEFAULT_SOCKET;
+	std::string command;
+	for (int i=1; i<argc; i++) {
+		std::string arg = argv[i];
+		if ((arg == "--socket") && (i + 1 < argc)) {
+			path = argv[++i];
+		} else if ((arg == "-h") || (arg == "--help")) {
+			std::cout << "usage: lunaero-ctl [--socket PATH] [COMMAND [ARG]]" << std::endl;
+			return 0;
+		} else {
+			command += (command.empty() ? "" : " ") + arg;
+		}
+	}
+
+	int fd = ctl_connect(path);
+	if (fd < 0) {
+		return 2;
+	}
+	int status = 0;
+	std::string reply;
+	if (!command.empty()) {
+		if (ctl_send(fd, command, reply)) {
+			std::cerr << "lunaero-ctl: LunAero closed the connection" << std::endl;
+			close(fd);
+			return 2;
+		}
+		std::cout << reply << std::endl;
+		status = (reply.compare(0, 2, "ok") == 0) ? 0 : 1;
+	} else {
+		std::string line;
+		while (std::getline(std::cin, line)) {
+			if (line.empty() || (line[0] == '#')) {
+				continue;
+			}
+			if (ctl_send(fd, line, reply)) {
+				std::cerr << "lunaero-ctl: LunAero closed the connection" << std::endl;
+				close(fd);
+				return 2;
+			}
+			std::cout << reply << std::endl;
+			if (reply.compare(0, 2, "ok") != 0) {
+				status = 1;
+			}
+		}
+	}
+	close(fd);
+	return status;
+}
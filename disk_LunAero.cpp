@@ -0,0 +1,489 @@
+/*
+ * C_LunAero/disk_LunAero.cpp - Storage monitoring functions for LunAero_C
+ * Copyright (C) <2020>  <Wesley T. Honeycutt>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "disk_LunAero.hpp"
+
+/**
+ * This function converts one entry of the DRIVE_NAME list into a mount point.  A plain name refers to
+ * a drive automounted at /media/$USER/NAME, or under the name of the account running LunAero if USER is
+ * not set.  An absolute path is used as given, which allows tmpfs or loopback mounts to stand in for USB
+ * drives.
+ *
+ * @param entry one comma separated item from DRIVE_NAME
+ * @return path the mount point of the drive without a trailing slash
+ */
+std::string disk_drive_path(std::string entry) {
+	if (entry[0] == '/') {
+		while ((entry.size() > 1) && (entry.back() == '/')) {
+			entry.pop_back();
+		}
+		return entry;
+	}
+	// USER is not set when started from a service, so fall back to the account running LunAero
+	const char *user = std::getenv("USER");
+	if (user == NULL) {
+		struct passwd *account = getpwuid(getuid());
+		user = (account != NULL) ? account->pw_name : "";
+	}
+	return "/media/" + std::string(user) + "/" + entry;
+}
+
+/**
+ * This function splits the comma separated DRIVE_NAME setting into DRIVE_LIST, keeping the order given
+ * by the user.
+ *
+ */
+void disk_parse_drives() {
+	DRIVE_LIST.clear();
+	std::string::size_type start = 0;
+	while (start <= DRIVE_NAME.size()) {
+		std::string::size_type end = DRIVE_NAME.find(',', start);
+		if (end == std::string::npos) {
+			end = DRIVE_NAME.size();
+		}
+		std::string entry = DRIVE_NAME.substr(start, end - start);
+		if (!entry.empty()) {
+			DRIVE_LIST.push_back(disk_drive_path(entry));
+		}
+		start = end + 1;
+	}
+}
+
+/**
+ * This function checks /proc/mounts to determine if a path is a mount point.
+ *
+ * @param path mount point to look for
+ * @return status 1 if mounted, 0 if not mounted, -1 if /proc/mounts could not be read
+ */
+int disk_is_mounted(std::string path) {
+	std::ifstream mountsfile("/proc/mounts", std::ifstream::in);
+	if (!mountsfile.good()) {
+		return -1;
+	}
+	std::string line;
+	while (std::getline(mountsfile, line)) {
+		// Second field of each line is the mount point
+		std::string::size_type first = line.find(' ');
+		if (first == std::string::npos) {
+			continue;
+		}
+		std::string::size_type second = line.find(' ', first + 1);
+		if (line.substr(first + 1, second - first - 1) == path) {
+			mountsfile.close();
+			return 1;
+		}
+	}
+	mountsfile.close();
+	return 0;
+}
+
+/**
+ * This function points DEFAULT_FILEPATH and FILEPATH at a drive from DRIVE_LIST and creates the session
+ * folder on it if needed.  The shared DRIVE_INDEXaddr is not touched here, see disk_plan_segment.
+ *
+ * @param index position of the drive in DRIVE_LIST
+ */
+void disk_use_drive(int index) {
+	DISK_LOCAL_INDEX = index;
+	{
+		std::lock_guard <std::mutex> lock(FILEPATH_MUTEX);
+		DEFAULT_FILEPATH = DRIVE_LIST[index] + "/";
+	}
+	FILEPATH = DEFAULT_FILEPATH + SESSION_TS;
+	mkdir(FILEPATH.c_str(), 0700);
+	LOG_INFO("using drive " << index << " path: " << FILEPATH);
+}
+
+/**
+ * This function is called before FILEPATH is used.  If the session has been moved to a different drive
+ * through DRIVE_INDEXaddr, the local paths are updated to match.
+ *
+ */
+void disk_sync_drive() {
+	if (*val_ptr.DRIVE_INDEXaddr != DISK_LOCAL_INDEX) {
+		disk_use_drive(*val_ptr.DRIVE_INDEXaddr);
+	}
+}
+
+/**
+ * This function appends a segment to the session manifest with the drive it was written to and the UTC
+ * time it was started.
+ *
+ * @param segment file name of the segment
+ */
+void disk_manifest_add(std::string segment) {
+	std::ofstream manifest;
+	manifest.open(MANIFEST_PATH, std::ios_base::app);
+	manifest
+	<< segment << "\t"
+	<< DISK_LOCAL_INDEX << "\t"
+	<< FILEPATH << "\t"
+	<< current_time(1)
+	<< std::endl;
+	manifest.close();
+}
+
+/**
+ * This function calculates the nominal rate in bytes per second at which raspivid fills the drive.  It
+ * is based on the RPI_BR bitrate in settings.cfg with a small allowance for encoder overshoot.
+ *
+ * @return rate nominal write rate in bytes per second
+ */
+double disk_nominal_rate() {
+	return (RPI_BR / 8.) * DISK_OVERHEAD;
+}
+
+/**
+ * This function returns the write rate used for forecasts.  Once the monitor has measured the growth of
+ * the current segment at least twice, the measured rate is used.  Before that, the nominal rate from
+ * disk_nominal_rate is used.
+ *
+ * @return rate forecast write rate in bytes per second
+ */
+double disk_forecast_rate() {
+	if ((DISK_RATE_SAMPLES >= 2) && (DISK_RATE > 0.)) {
+		return DISK_RATE;
+	}
+	return disk_nominal_rate();
+}
+
+/**
+ * This function forecasts the number of bytes needed to record for a number of seconds at the current
+ * forecast rate.
+ *
+ * @param seconds recording time to forecast
+ * @return bytes forecast bytes needed
+ */
+double disk_forecast_bytes(double seconds) {
+	return disk_forecast_rate() * seconds;
+}
+
+/**
+ * This function reads the number of bytes available to an unprivileged user at a path using statvfs.
+ *
+ * @param path any path on the drive of interest
+ * @return available bytes available, or 0 if the drive could not be read
+ */
+unsigned long long disk_available(std::string path) {
+	struct statvfs vfs;
+	if (statvfs(path.c_str(), &vfs) != 0) {
+		LOG_ERROR("ERROR: statvfs failed on " << path);
+		return 0;
+	}
+	return (unsigned long long)vfs.f_bavail * (unsigned long long)vfs.f_frsize;
+}
+
+/**
+ * This function forecasts the number of seconds of video which can still be written to the drive before
+ * it fills, keeping DISK_RESERVE bytes free.
+ *
+ * @param path any path on the drive of interest
+ * @return seconds forecast time until the drive is full
+ */
+double disk_time_to_full(std::string path) {
+	double usable = (double)disk_available(path) - DISK_RESERVE;
+	if (usable < 0.) {
+		return 0.;
+	}
+	return usable / disk_forecast_rate();
+}
+
+/**
+ * This function checks that a drive the session may still move to has room for DISK_MIN_SEGMENT seconds
+ * of video.  It only reads the drives, so the GUI can call it before asking the camera thread to record.
+ * Nothing has been recorded yet, so the nominal rate is used.
+ *
+ * @return status 0 if a segment can be started, 1 if every drive is full
+ */
+int disk_has_room() {
+	for (int i=*val_ptr.DRIVE_INDEXaddr; i<(int)DRIVE_LIST.size(); i++) {
+		double usable = (double)disk_available(DRIVE_LIST[i]) - DISK_RESERVE;
+		if (usable / disk_nominal_rate() >= DISK_MIN_SEGMENT) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+/**
+ * This function reports the bytes the segment writer has preallocated on the current drive but not yet
+ * filled.  The preallocation already counts against the free space of the drive, so it is added back
+ * when forecasting how much video the current drive can still hold.
+ *
+ * @return bytes preallocated but not yet written
+ */
+double disk_prealloc_bytes() {
+	return (double)*val_ptr.PREALLOC_MBaddr * WRITER_BLOCK;
+}
+
+/**
+ * This function finds the most recently modified h264 segment in a directory and reports its size.
+ *
+ * @param dirpath directory holding the video segments
+ * @param newest filled with the path of the newest segment
+ * @param size filled with the size of the newest segment in bytes
+ * @return status 0 if a segment was found
+ */
+int disk_segment_size(std::string dirpath, std::string &newest, unsigned long long &size) {
+	namespace fs = std::filesystem;
+	std::error_code ec;
+	fs::file_time_type newest_time;
+	int found = 0;
+	for (const auto &entry : fs::directory_iterator(dirpath, ec)) {
+		if (entry.path().extension() != ".h264") {
+			continue;
+		}
+		fs::file_time_type mtime = fs::last_write_time(entry.path(), ec);
+		if (ec) {
+			continue;
+		}
+		if ((!found) || (mtime > newest_time)) {
+			newest_time = mtime;
+			newest = entry.path().string();
+			found = 1;
+		}
+	}
+	if (!found) {
+		return 1;
+	}
+	size = fs::file_size(newest, ec);
+	if (ec) {
+		return 1;
+	}
+	return 0;
+}
+
+/**
+ * This function plans the length and drive of the segment about to be recorded.  Starting from the
+ * current drive, the first drive in DRIVE_LIST with room for a full RECORD_DURATION segment is chosen.
+ * If no drive has room for a full segment, the roomiest remaining drive is used and the segment is
+ * shortened so that it is closed cleanly by LunAero before the drive fills, and it is flagged as the
+ * final segment.  If not even DISK_MIN_SEGMENT seconds fit, no segment should be started.  The chosen
+ * drive is shared with the other threads through DRIVE_INDEXaddr.
+ *
+ * @return status 0 for a full segment, 1 for a shortened final segment, 2 if there is no room
+ */
+int disk_plan_segment() {
+	disk_sync_drive();
+	int best = DISK_LOCAL_INDEX;
+	double fits = -1.;
+	for (int i=DISK_LOCAL_INDEX; i<(int)DRIVE_LIST.size(); i++) {
+		double drive_fits = disk_time_to_full(DRIVE_LIST[i]);
+		if (i == DISK_LOCAL_INDEX) {
+			drive_fits += disk_prealloc_bytes() / disk_forecast_rate();
+		}
+		if (drive_fits >= std::chrono::duration<double>(RECORD_DURATION).count()) {
+			best = i;
+			fits = drive_fits;
+			break;
+		}
+		if (drive_fits > fits) {
+			best = i;
+			fits = drive_fits;
+		}
+	}
+	if (best != DISK_LOCAL_INDEX) {
+		LOG_INFO("spilling over from " << DRIVE_LIST[DISK_LOCAL_INDEX] << " to " << DRIVE_LIST[best]);
+		*val_ptr.DRIVE_INDEXaddr = best;
+		disk_use_drive(best);
+	}
+	SEGMENT_DURATION = RECORD_DURATION;
+	SEGMENT_FINAL = false;
+	if (fits < DISK_MIN_SEGMENT) {
+		SEGMENT_DURATION = (std::chrono::duration<double>) 0.;
+		SEGMENT_FINAL = true;
+		LOG_ERROR("ERROR: only " << fits << " s of video fit on the drive, not starting a new segment");
+		return 2;
+	} else if (fits < std::chrono::duration<double>(RECORD_DURATION).count()) {
+		SEGMENT_DURATION = (std::chrono::duration<double>) fits;
+		SEGMENT_FINAL = true;
+		LOG_WARN("WARNING: planning final segment of " << fits << " s before the drive fills");
+		notify_handler("LunAero Warning", "The drive is nearly full.  Recording will stop in "
+		+ std::to_string((int)fits / 60)
+		+ " minutes.");
+		return 1;
+	}
+	LOG_INFO("planned segment of " << SEGMENT_DURATION.count() << " s, " << fits
+		<< " s of video fit on the drive");
+	return 0;
+}
+
+/**
+ * This function is called periodically while recording.  It measures the real write rate from the
+ * growth of the newest segment, forecasts the time until the drive fills, warns the user once when that
+ * time drops below DISK_WARN_TIME, and shortens the current segment if it would not fit.  It then
+ * reports whether the planned segment has finished.
+ *
+ * @param elapsed seconds since the current segment was started
+ * @return status 0 to keep recording, 1 to start the next segment, 2 to stop after the final segment
+ */
+int disk_monitor_check(std::chrono::duration<double> elapsed) {
+	disk_sync_drive();
+	
+	// Measure the write rate of the current segment
+	std::string newest;
+	unsigned long long size = 0;
+	auto now = std::chrono::steady_clock::now();
+	if (disk_segment_size(FILEPATH, newest, size) == 0) {
+		std::chrono::duration<double> dt = now - DISK_LAST_SAMPLE;
+		if ((newest == DISK_LAST_FILE) && (size >= DISK_LAST_SIZE) && (dt.count() > 0.)) {
+			double sample = (size - DISK_LAST_SIZE) / dt.count();
+			if (DISK_RATE_SAMPLES == 0) {
+				DISK_RATE = sample;
+			} else {
+				DISK_RATE = (DISK_RATE_ALPHA * sample) + ((1. - DISK_RATE_ALPHA) * DISK_RATE);
+			}
+			DISK_RATE_SAMPLES += 1;
+		}
+		DISK_LAST_FILE = newest;
+		DISK_LAST_SIZE = size;
+		DISK_LAST_SAMPLE = now;
+	}
+
+	// Forecast the time until the drive is full, and until every remaining drive is full
+	double ttf = disk_time_to_full(DEFAULT_FILEPATH) + (disk_prealloc_bytes() / disk_forecast_rate());
+	double session_ttf = ttf;
+	for (int i=DISK_LOCAL_INDEX+1; i<(int)DRIVE_LIST.size(); i++) {
+		session_ttf += disk_time_to_full(DRIVE_LIST[i]);
+	}
+	METRICS.disk_time_to_full.store((int64_t)session_ttf, std::memory_order_relaxed);
+	LOG_DEBUG("disk rate: " << disk_forecast_rate() << " B/s time to full: " << ttf << " s session: "
+		<< session_ttf << " s");
+	if ((session_ttf < DISK_WARN_TIME) && (!DISK_WARNED)) {
+		DISK_WARNED = true;
+		LOG_WARN("WARNING: the drives are forecast to fill in " << session_ttf << " s");
+		notify_handler("LunAero Warning", "The drives are forecast to fill in "
+		+ std::to_string((int)session_ttf / 60)
+		+ " minutes.");
+	}
+
+	// Shorten the current segment if the rest of it will not fit.  It is only the final segment if no
+	// later drive has room to continue the session.
+	std::chrono::duration<double> remaining = SEGMENT_DURATION - elapsed;
+	if (ttf < remaining.count()) {
+		SEGMENT_DURATION = elapsed + (std::chrono::duration<double>) ttf;
+		SEGMENT_FINAL = true;
+		for (int i=DISK_LOCAL_INDEX+1; i<(int)DRIVE_LIST.size(); i++) {
+			if (disk_time_to_full(DRIVE_LIST[i]) >= DISK_MIN_SEGMENT) {
+				SEGMENT_FINAL = false;
+				break;
+			}
+		}
+		LOG_WARN("WARNING: shortening " << (SEGMENT_FINAL ? "final " : "") << "segment to "
+			<< SEGMENT_DURATION.count() << " s");
+	}
+
+	if (elapsed >= SEGMENT_DURATION) {
+		if (SEGMENT_FINAL) {
+			return 2;
+		}
+		return 1;
+	}
+	return 0;
+}
+
+/**
+ * This function measures whether a drive can keep up with the encoder before recording starts.  It writes
+ * DISK_BENCH_MB of data in DISK_BENCH_BLOCK sized blocks to a scratch file in the target directory,
+ * forcing each block to the device with fdatasync, and records the latency of every block.  The
+ * sustained throughput is compared to the nominal recording rate.  A drive slower than the bitrate is
+ * refused.  A drive slower than DISK_BENCH_HEADROOM times the bitrate, or whose 99th percentile block
+ * latency is longer than the encoder takes to produce a block, gets a warning since raspivid drops
+ * frames when writes stall.  The results are stored in DISK_OUTPUT and DISK_BENCH_OUTPUT.
+ *
+ * @param path directory on the drive to test
+ * @return status 0 if the drive is fast enough, 1 if it should be refused, 2 if the benchmark failed
+ */
+int disk_benchmark(std::string path) {
+	if (DISK_BENCH_MB <= 0) {
+		return 0;
+	}
+	std::string benchpath = path + "/.lunaero_bench.tmp";
+	int fd = open(benchpath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+	if (fd < 0) {
+		DISK_OUTPUT.push_back("WARNING: could not open " + benchpath + " for the storage benchmark");
+		return 2;
+	}
+	
+	// Fill the block with a pattern rather than zeros so nothing along the way can shortcut it
+	vector <char> block(DISK_BENCH_BLOCK);
+	for (unsigned int i=0; i<block.size(); i++) {
+		block[i] = (char)((i * 2654435761u) >> 24);
+	}
+	
+	vector <double> latency;
+	int status = 0;
+	auto start = std::chrono::steady_clock::now();
+	for (int i=0; i<DISK_BENCH_MB; i++) {
+		auto t0 = std::chrono::steady_clock::now();
+		ssize_t written = 0;
+		while (written < DISK_BENCH_BLOCK) {
+			ssize_t ret = write(fd, block.data() + written, DISK_BENCH_BLOCK - written);
+			if (ret <= 0) {
+				status = 2;
+				break;
+			}
+			written += ret;
+		}
+		if ((status != 0) || (fdatasync(fd) != 0)) {
+			status = 2;
+			break;
+		}
+		std::chrono::duration<double, std::milli> dt = std::chrono::steady_clock::now() - t0;
+		latency.push_back(dt.count());
+	}
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+	close(fd);
+	unlink(benchpath.c_str());
+	if ((status != 0) || latency.empty()) {
+		DISK_OUTPUT.push_back("WARNING: the storage benchmark could not write to " + path);
+		return 2;
+	}
+	
+	// Sustained throughput and tail latency
+	double throughput = ((double)latency.size() * DISK_BENCH_BLOCK) / elapsed.count();
+	std::sort(latency.begin(), latency.end());
+	double p99 = latency[(latency.size() * 99) / 100];
+	double worst = latency.back();
+	double required = disk_nominal_rate();
+	double budget = (DISK_BENCH_BLOCK / required) * 1000.;
+	
+	std::string line = "Benchmark " + path + ": "
+	+ std::to_string((long)throughput) + " B/s sustained, p99 block latency "
+	+ std::to_string((int)p99) + " ms, max " + std::to_string((int)worst) + " ms, need "
+	+ std::to_string((long)required) + " B/s";
+	DISK_OUTPUT.push_back(line);
+	DISK_BENCH_OUTPUT.push_back(line);
+	
+	if (throughput < required) {
+		DISK_OUTPUT.push_back("ERROR: " + path + " is too slow to record at RPI_BR");
+		notify_handler("LunAero Error", path + " only writes "
+		+ std::to_string((long)throughput / 1000)
+		+ " kB/s, slower than the recording bitrate.");
+		return 1;
+	}
+	if ((throughput < (DISK_BENCH_HEADROOM * required)) || (p99 > budget)) {
+		DISK_OUTPUT.push_back("WARNING: " + path + " has little headroom for RPI_BR, expect dropped frames");
+		notify_handler("LunAero Warning", path + " may be too slow.  Writes "
+		+ std::to_string((long)throughput / 1000)
+		+ " kB/s with stalls up to "
+		+ std::to_string((int)worst)
+		+ " ms.");
+	}
+	return 0;
+}
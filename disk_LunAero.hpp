@@ -0,0 +1,138 @@
+/*
+ * C_LunAero/disk_LunAero.hpp - Storage monitoring headers for LunAero_C
+ * Copyright (C) <2020>  <Wesley T. Honeycutt>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DISK_LUNAERO_H
+#define DISK_LUNAERO_H
+
+// Standard C++ includes
+#include <string>
+#include <iostream>
+#include <chrono>          // provides C++ chrono
+
+// Module specific includes
+#include <sys/statvfs.h>   // provides statvfs
+#include <filesystem>      // provides directory iteration
+#include <fcntl.h>         // provides open
+#include <unistd.h>        // provides write and fdatasync
+#include <pwd.h>           // provides getpwuid
+
+// User Includes
+#include "LunAero.hpp"
+
+// Global Defined Constants
+/**
+ * Size in bytes of each block written by the storage benchmark (1 MiB).
+ */
+#define DISK_BENCH_BLOCK 1048576
+/**
+ * Multiplier applied to the nominal bitrate when forecasting space.  Covers encoder overshoot on busy
+ * frames and the raw h264 stream overhead.
+ */
+#define DISK_OVERHEAD 1.10
+/**
+ * Bytes which must always remain free on the drive for the log, ID file, and the poll interval of the
+ * monitor (64 MiB).
+ */
+#define DISK_RESERVE 67108864.
+/**
+ * Weight given to the newest sample when updating the measured write rate.
+ */
+#define DISK_RATE_ALPHA 0.3
+
+/**
+ * Number of seconds before the drive is forecast to fill at which LunAero warns the user.  Customizable
+ * from settings.cfg.
+ */
+inline std::atomic<int> DISK_WARN_TIME = 1800;
+/**
+ * Shortest segment in seconds worth recording when the drive is nearly full.  Customizable from
+ * settings.cfg.
+ */
+inline int DISK_MIN_SEGMENT = 60;
+/**
+ * Mebibytes written by the startup storage benchmark on each drive.  Set to 0 to skip the benchmark.
+ * Customizable from settings.cfg.
+ */
+inline int DISK_BENCH_MB = 32;
+/**
+ * Factor by which the measured drive throughput should exceed the recording bitrate.  Drives slower
+ * than the bitrate are refused, drives slower than this multiple of it produce a warning.  Customizable
+ * from settings.cfg.
+ */
+inline float DISK_BENCH_HEADROOM = 2.0;
+/**
+ * Results of the startup storage benchmark, copied into the ID file.
+ */
+inline vector <std::string> DISK_BENCH_OUTPUT;
+/**
+ * Ordered list of drive mount points parsed from DRIVE_NAME.  Segments spill over to the next drive in
+ * this list when the current one fills.
+ */
+inline vector <std::string> DRIVE_LIST;
+/**
+ * Timestamp naming the session folder created on each drive.
+ */
+inline std::string SESSION_TS = "";
+/**
+ * Path of the manifest recording which drive holds each segment.  Kept in the session folder of the
+ * first drive, next to the log and ID file.
+ */
+inline std::string MANIFEST_PATH = "";
+/**
+ * Planned length of the segment currently being recorded.  This is RECORD_DURATION unless the drive
+ * cannot hold a full segment.
+ */
+inline std::chrono::duration<double> SEGMENT_DURATION = (std::chrono::duration<double>) 1800.;
+/**
+ * Set when the current segment has been planned as the last one which fits on the drive.
+ */
+inline bool SEGMENT_FINAL = false;
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+
+// Global Variables - Not "private" but not necessary to define for Doxygen
+inline double DISK_RATE = 0.;
+inline int DISK_RATE_SAMPLES = 0;
+inline std::string DISK_LAST_FILE = "";
+inline unsigned long long DISK_LAST_SIZE = 0;
+inline std::chrono::time_point DISK_LAST_SAMPLE = std::chrono::steady_clock::now();
+inline bool DISK_WARNED = false;
+inline int DISK_LOCAL_INDEX = -1;
+
+#endif /* DOXYGEN_SHOULD_SKIP_THIS */
+
+// Function Prototypes
+std::string disk_drive_path(std::string entry);
+void disk_parse_drives();
+int disk_is_mounted(std::string path);
+void disk_use_drive(int index);
+void disk_sync_drive();
+void disk_manifest_add(std::string segment);
+double disk_nominal_rate();
+double disk_forecast_rate();
+double disk_forecast_bytes(double seconds);
+unsigned long long disk_available(std::string path);
+double disk_time_to_full(std::string path);
+int disk_has_room();
+double disk_prealloc_bytes();
+int disk_segment_size(std::string dirpath, std::string &newest, unsigned long long &size);
+int disk_plan_segment();
+int disk_benchmark(std::string path);
+int disk_monitor_check(std::chrono::duration<double> elapsed);
+
+#endif
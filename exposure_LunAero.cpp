@@ -0,0 +1,155 @@
+/*
+ * C_LunAero/exposure_LunAero.cpp - Auto exposure for LunAero_C
+ * Copyright (C) <2020>  <Wesley T. Honeycutt>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "exposure_LunAero.hpp"
+
+/**
+ * This function adds the grey level histogram of one checked frame to the histogram of the current
+ * segment.  It is called from current_frame on the analysis thread.
+ *
+ * @param hist count of region of interest pixels at each grey level
+ */
+void exposure_add(const uint32_t *hist) {
+	std::lock_guard <std::mutex> lock(EXPOSURE_MUTEX);
+	for (int i=0; i<EXPOSURE_LEVELS; i++) {
+		EXPOSURE_HIST[i] += hist[i];
+	}
+}
+
+/**
+ * This function empties the histogram of the current segment.
+ *
+ */
+void exposure_reset() {
+	std::lock_guard <std::mutex> lock(EXPOSURE_MUTEX);
+	for (int i=0; i<EXPOSURE_LEVELS; i++) {
+		EXPOSURE_HIST[i] = 0;
+	}
+}
+
+/**
+ * This function finds the grey level of the bright limb, the level which EXPOSURE_LIMB_QUANTILE of
+ * the disk pixels are darker than.
+ *
+ * @param hist histogram of a segment
+ * @param disk number of pixels at or above EXPOSURE_DISK_MIN
+ * @return level grey level of the limb
+ */
+int exposure_limb(const uint64_t *hist, uint64_t disk) {
+	uint64_t below = (uint64_t)(disk * EXPOSURE_LIMB_QUANTILE);
+	uint64_t count = 0;
+	for (int i=EXPOSURE_DISK_MIN; i<EXPOSURE_LEVELS; i++) {
+		count += hist[i];
+		if (count > below) {
+			return i;
+		}
+	}
+	return EXPOSURE_LEVELS - 1;
+}
+
+/**
+ * This function chooses the shutter and ISO for the next segment from the histogram of the last one.
+ * If more than BRIGHT_THRESH of the disk is at or above RAW_BRIGHT_THRESH the exposure is cut by
+ * EXPOSURE_CLIP_STEP.  Otherwise it is scaled to bring the bright limb to AE_TARGET.  The exposure is
+ * then split into the lowest ISO within AE_ISO_MIN and AE_ISO_MAX which reaches it with a shutter no
+ * longer than AE_SHUTTER_MAX, since a higher ISO only adds noise.
+ *
+ * @param hist histogram of a segment
+ * @param shutter shutter used for the segment in microseconds
+ * @param iso ISO used for the segment
+ * @param new_shutter receives the shutter for the next segment
+ * @param new_iso receives the ISO for the next segment
+ * @return status 1 if the exposure should change, 0 if not
+ */
+int exposure_choose(const uint64_t *hist, int shutter, int iso, int &new_shutter, int &new_iso) {
+	new_shutter = shutter;
+	new_iso = iso;
+	uint64_t disk = 0;
+	uint64_t clipped = 0;
+	for (int i=EXPOSURE_DISK_MIN; i<EXPOSURE_LEVELS; i++) {
+		disk += hist[i];
+		if (i >= RAW_BRIGHT_THRESH) {
+			clipped += hist[i];
+		}
+	}
+	if (disk < EXPOSURE_MIN_PIXELS) {
+		return 0;
+	}
+
+	double scale;
+	if ((double)clipped / disk > BRIGHT_THRESH) {
+		scale = EXPOSURE_CLIP_STEP;
+	} else {
+		scale = (double)AE_TARGET / exposure_limb(hist, disk);
+		if (fabs(scale - 1.) < EXPOSURE_DEADBAND) {
+			return 0;
+		}
+		scale = std::min(std::max(scale, 1. / EXPOSURE_MAX_STEP), EXPOSURE_MAX_STEP);
+	}
+
+	double target = (double)shutter * iso / 100. * scale;
+	for (int candidate : {100, 200, 400, 800}) {
+		if ((candidate < AE_ISO_MIN) || (candidate > AE_ISO_MAX)) {
+			continue;
+		}
+		new_iso = candidate;
+		if (target / (candidate / 100.) <= AE_SHUTTER_MAX) {
+			break;
+		}
+	}
+	new_shutter = (int)lround(target / (new_iso / 100.));
+	new_shutter = std::min(std::max(new_shutter, AE_SHUTTER_MIN.load()), AE_SHUTTER_MAX.load());
+	return ((new_shutter != shutter) || (new_iso != iso)) ? 1 : 0;
+}
+
+/**
+ * This function is called by the camera thread at each segment boundary, just before raspivid is
+ * restarted.  The shutter and ISO chosen from the last segment are used by the new raspivid, so the
+ * exposure changes without any more of a gap in the recording than a normal segment rotation.
+ *
+ * @return status 1 if the exposure changed, 0 if not
+ */
+int exposure_update() {
+	uint64_t hist[EXPOSURE_LEVELS];
+	{
+		std::lock_guard <std::mutex> lock(EXPOSURE_MUTEX);
+		for (int i=0; i<EXPOSURE_LEVELS; i++) {
+			hist[i] = EXPOSURE_HIST[i];
+			EXPOSURE_HIST[i] = 0;
+		}
+	}
+	if (!AUTO_EXPOSURE) {
+		return 0;
+	}
+
+	int shutter = *val_ptr.SHUTTER_VALaddr;
+	int iso = *val_ptr.ISO_VALaddr;
+	int new_shutter;
+	int new_iso;
+	if (exposure_choose(hist, shutter, iso, new_shutter, new_iso) == 0) {
+		LOG_DEBUG("auto exposure: keeping shutter " << shutter << " ISO " << iso);
+		return 0;
+	}
+	LOG_INFO("auto exposure: shutter " << shutter << " -> " << new_shutter << ", ISO " << iso << " -> "
+		<< new_iso);
+	*val_ptr.SHUTTER_VALaddr = new_shutter;
+	*val_ptr.ISO_VALaddr = new_iso;
+	telem_camera(TELEM_CAM_EXPOSURE, new_shutter, new_iso);
+	gui_notify();
+	return 1;
+}
@@ -0,0 +1,105 @@
+/*
+ * C_LunAero/exposure_LunAero.hpp - Auto exposure headers for LunAero_C
+ * Copyright (C) <2020>  <Wesley T. Honeycutt>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef EXPOSURE_LUNAERO_H
+#define EXPOSURE_LUNAERO_H
+
+// Standard C++ includes
+#include <cmath>           // provides lround
+#include <cstdint>         // provides fixed width integers
+#include <mutex>           // provides std::mutex
+
+// User Includes
+#include "LunAero.hpp"
+
+// Global Defined Constants
+/**
+ * Number of grey levels in the exposure histogram.
+ */
+#define EXPOSURE_LEVELS 256
+/**
+ * Lowest grey level counted as part of the moon disk, just above MOON_THRESH's default.  The fixed
+ * level is used rather than the tracker's adaptive threshold, so the disk measured over a segment does
+ * not shift as the threshold follows the sky.
+ */
+#define EXPOSURE_DISK_MIN 26
+/**
+ * Fewest disk pixels seen over a segment for the exposure to be judged.  Fewer means the moon was
+ * mostly out of view, so the exposure is left alone.
+ */
+#define EXPOSURE_MIN_PIXELS 1000
+/**
+ * Fraction of the disk pixels darker than the bright limb.  The grey level at this quantile is steered
+ * to AE_TARGET.
+ */
+#define EXPOSURE_LIMB_QUANTILE 0.99
+/**
+ * Exposure scale applied when too much of the disk is clipped, since a clipped histogram cannot say by
+ * how much the exposure is over.
+ */
+#define EXPOSURE_CLIP_STEP 0.7
+/**
+ * Largest change in exposure at one segment boundary, as a factor either way.
+ */
+#define EXPOSURE_MAX_STEP 2.0
+/**
+ * Changes smaller than this fraction are skipped, so the exposure does not hunt between segments.
+ */
+#define EXPOSURE_DEADBAND 0.1
+
+/**
+ * Should LunAero adjust the shutter and ISO while recording?  Customizable from settings.cfg.
+ */
+inline std::atomic<bool> AUTO_EXPOSURE = true;
+/**
+ * Grey level between 0-255 the bright limb of the moon is steered to.  Customizable from settings.cfg.
+ */
+inline std::atomic<int> AE_TARGET = 200;
+/**
+ * Shortest shutter in microseconds auto exposure may choose.  Customizable from settings.cfg.
+ */
+inline std::atomic<int> AE_SHUTTER_MIN = 10;
+/**
+ * Longest shutter in microseconds auto exposure may choose.  Customizable from settings.cfg.
+ */
+inline std::atomic<int> AE_SHUTTER_MAX = 33000;
+/**
+ * Lowest ISO auto exposure may choose.  Customizable from settings.cfg.
+ */
+inline std::atomic<int> AE_ISO_MIN = 100;
+/**
+ * Highest ISO auto exposure may choose.  Customizable from settings.cfg.
+ */
+inline std::atomic<int> AE_ISO_MAX = 800;
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+
+// Global Variables - Not "private" but not necessary to define for Doxygen
+inline std::mutex EXPOSURE_MUTEX;
+inline uint64_t EXPOSURE_HIST[EXPOSURE_LEVELS];
+
+#endif /* DOXYGEN_SHOULD_SKIP_THIS */
+
+// Function Prototypes
+void exposure_add(const uint32_t *hist);
+void exposure_reset();
+int exposure_limb(const uint64_t *hist, uint64_t disk);
+int exposure_choose(const uint64_t *hist, int shutter, int iso, int &new_shutter, int &new_iso);
+int exposure_update();
+
+#endif
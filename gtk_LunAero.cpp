@@ -18,49 +18,125 @@
 
 #include "gtk_LunAero.hpp"
 
+/**
+ * This function creates GUI_EVENT_FD.  It is called by main before the workers start, so no change is
+ * missed while the window is being built.
+ *
+ * @return status 0 if the GUI can be woken by changes
+ */
+int gui_events_init() {
+	GUI_EVENT_FD = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (GUI_EVENT_FD < 0) {
+		LOG_ERROR("ERROR: could not create the GUI event fd");
+		return 1;
+	}
+	return 0;
+}
+
+/**
+ * This function tells the GUI that something it shows may have changed.  It can be called from any
+ * thread.  Several calls before the GUI wakes are merged into one redraw by the eventfd counter.
+ *
+ */
+void gui_notify() {
+	if (GUI_EVENT_FD >= 0) {
+		uint64_t one = 1;
+		// The write only fails with EAGAIN when the counter is full, which wakes the GUI all the same
+		if (write(GUI_EVENT_FD, &one, sizeof(one)) < 0) {
+			return;
+		}
+	}
+}
+
+/**
+ * This callback runs on the GTK main loop when gui_notify has been called.  Commands from the command
+ * socket are run, the status text is redrawn if it changed, and an abort is acted on.
+ *
+ * @param fd GUI_EVENT_FD
+ * @param condition poll condition of fd.  Not used here.
+ * @param data gpointer to data from callback.  Not used here.
+ * @return gboolean G_SOURCE_CONTINUE to keep watching fd
+ */
+gboolean gui_event(gint fd, GIOCondition condition, gpointer data) {
+	uint64_t count;
+	// The count is not needed.  EAGAIN only means an earlier wake already emptied the counter.
+	if (read(fd, &count, sizeof(count)) < 0) {
+		LOG_TRACE("GUI woken with no events pending");
+	}
+	wd_beat(WD_GUI, "GUI event");
+	control_dispatch();
+	refresh_text_boxes(NULL);
+	abort_check(NULL);
+	return G_SOURCE_CONTINUE;
+}
+
+/**
+ * This callback runs on the GTK main loop when settings.cfg changes, so the changes are picked up for
+ * every thread.
+ *
+ * @param fd SETTINGS_FD
+ * @param condition poll condition of fd.  Not used here.
+ * @param data gpointer to data from callback.  Not used here.
+ * @return gboolean G_SOURCE_CONTINUE to keep watching fd
+ */
+gboolean gui_settings_event(gint fd, GIOCondition condition, gpointer data) {
+	wd_beat(WD_GUI, "reloading settings");
+	settings_poll();
+	return G_SOURCE_CONTINUE;
+}
+
+/**
+ * This callback tells the watchdog the GTK main loop is still running while nothing else wakes it.
+ *
+ * @param data gpointer to data from callback.  Not used here.
+ * @return gboolean status
+ */
+gboolean gui_heartbeat(gpointer data) {
+	wd_beat(WD_GUI, "GTK main loop");
+	return TRUE;
+}
+
 /**
  * This function refreshes the text boxes on the side of the GTK window.  During preview and manual motor
  * movement mode, this portion of the screen shows the value of the selected SHUTTER_VAL, ISO, and blur
  * value.  Note that this does not show the values of the video in the preview screen if the values have
  * been adjusted but not refreshed using the refresh camera button.  During normal operation, the box
- * just says "running".
+ * says "running" with the segment being recorded and whether the analysis thread can see the moon.  The
+ * label is only set when its text changes.
  *
  * @param data gpointer to data from callback.  Not used here.
  * @return gboolean status
  */
 gboolean refresh_text_boxes(gpointer data) {
+	static std::string shown;
 	if (*val_ptr.ABORTaddr == 0) {
+		std::string msg;
 		if (*val_ptr.RUN_MODEaddr == 0) {
 			// Construct message
-			std::string msg;
 			msg = "Shutter: ";
 			msg += std::to_string(*val_ptr.SHUTTER_VALaddr);
 			msg += "\nISO: ";
 			msg += std::to_string(*val_ptr.ISO_VALaddr);
-			gtk_label_set_text(GTK_LABEL(gtk_class::text_status), msg.c_str());
 		} else {
-			std::string msg;
 			msg = "Running";
+			msg += "\nSegment: ";
+			msg += std::to_string(*val_ptr.SEGMENTaddr);
+			analysis_result result = analysis_latest();
+			if (result.frame > 0) {
+				msg += (result.lost == 0) ? "\nMoon: found" : "\nMoon: lost";
+			}
+		}
+		if (msg != shown) {
 			gtk_label_set_text(GTK_LABEL(gtk_class::text_status), msg.c_str());
+			shown = msg;
 		}
 	}
     return TRUE;
 }
 
-/**
- * This callback function is a local holder of the cb_framecheck function from LunAero.cpp
- *
- * @param data gpointer to data from callback.  Not used here.
- * @return gboolean status
- */
-gboolean g_framecheck(gpointer data) {
-	cb_framecheck();
-	return TRUE;
-}
-
 /**
  * This funciton, called at program start, measures the available screen size the GTK window can occupy.
- * Several globals are defined here, including those of the RVD_ prototype, WORK_WIDTH, and WORK_HEIGHT.
+ * WORK_WIDTH and WORK_HEIGHT are defined here, and preview_geometry places the preview from them.
  * If you are having strange behavior related to screen sizing, check here first.  Note that some of the
  * values do not always behave well with the VC/DISPMANX screen program, since GTK is based on the X
  * window environment and VC/DISPMANX is a unique entity.  If the screenshot related functions are
@@ -74,37 +150,8 @@ void screen_size () {
 	// Calculate the screen workarea
 	WORK_HEIGHT = workarea.height;
 	WORK_WIDTH = workarea.width;
-	if (DEBUG_COUT) {
-		LOGGING.open(LOGOUT, std::ios_base::app);
-		LOGGING
-		<< "W: " << WORK_WIDTH << " x H: " << WORK_HEIGHT << std::endl;
-		LOGGING.close();
-	}
-	// Calculate the estimated size of a Raspivid window
-	RVD_HEIGHT = WORK_HEIGHT/2;
-	RVD_WIDTH = WORK_WIDTH/2;
-	if ((RVD_WIDTH/RVD_HEIGHT) != (16/9)) {
-		if ((RVD_WIDTH/RVD_HEIGHT) > (16/9)) {
-			RVD_WIDTH = RVD_HEIGHT * 16/9;
-		} else {
-			RVD_HEIGHT = RVD_WIDTH * 9/16;
-		}
-	}
-	if (DEBUG_COUT) {
-		LOGGING.open(LOGOUT, std::ios_base::app);
-		LOGGING
-		<< "Est Raspivid preview W: " << RVD_WIDTH << " x H: " << RVD_HEIGHT << std::endl;
-		LOGGING.close();
-	}
-	// Calculate the Raspivid preview corner
-	RVD_XCORN = (WORK_WIDTH/2)-(WORK_WIDTH/4);
-	RVD_YCORN = (WORK_HEIGHT/2);
-	if (DEBUG_COUT) {
-		LOGGING.open(LOGOUT, std::ios_base::app);
-		LOGGING
-		<< "Raspivid corner X: " << RVD_XCORN << " x Y: " << RVD_YCORN << std::endl;
-		LOGGING.close();
-	}
+	LOG_DEBUG("W: " << WORK_WIDTH << " x H: " << WORK_HEIGHT);
+	preview_geometry();
 	return;
 }
 
@@ -118,14 +165,9 @@ void screen_size () {
 std::string get_css_string() {
 	screen_size();
 	std::string css_string;
-	if (DEBUG_COUT) {
-		LOGGING.open(LOGOUT, std::ios_base::app);
-		LOGGING
-		<< "width: " << WORK_WIDTH << std::endl
+	LOG_DEBUG("width: " << WORK_WIDTH << std::endl
 		<< "height: " << WORK_HEIGHT << std::endl
-		<< "font-size: " << ((WORK_WIDTH*FONT_MOD)/WORK_HEIGHT) << std::endl;
-		LOGGING.close();
-	}
+		<< "font-size: " << ((WORK_WIDTH*FONT_MOD)/WORK_HEIGHT));
 	std::string font_size_string = std::to_string((WORK_WIDTH*FONT_MOD)/WORK_HEIGHT);
 	css_string = "window { background-color: black; \
 		 color: red; \
@@ -324,23 +366,11 @@ void gtk_global_setup(GtkApplication *app, gpointer local_val_ptr) {
  */
 void mot_stop_command() {
 	if (*val_ptr.RUN_MODEaddr == 0) {
-		if (DEBUG_COUT) {
-			LOGGING.open(LOGOUT, std::ios_base::app);
-			LOGGING
-			<< "mot stop command" << std::endl;
-			LOGGING.close();
-		}
+		LOG_DEBUG("mot stop command");
 	} else {
-		if (DEBUG_COUT) {
-			LOGGING.open(LOGOUT, std::ios_base::app);
-			LOGGING
-			<< "mot stop auto" << std::endl;
-			LOGGING.close();
-		}
+		LOG_DEBUG("mot stop auto");
 	}
-	sem_wait(&LOCK);
 	*val_ptr.STOP_DIRaddr = 3;
-	sem_post(&LOCK);
 }
 
 /**
@@ -350,32 +380,13 @@ void mot_stop_command() {
  */
 void mot_up_command() {
 	if (*val_ptr.RUN_MODEaddr == 0) {
-		if (DEBUG_COUT) {
-			LOGGING.open(LOGOUT, std::ios_base::app);
-			LOGGING
-			<< "mot up command" << std::endl;
-			LOGGING.close();
-		}
+		LOG_DEBUG("mot up command");
 	} else {
-		if (DEBUG_COUT) {
-			LOGGING.open(LOGOUT, std::ios_base::app);
-			LOGGING
-			<< "mot up auto" << std::endl;
-			LOGGING.close();
-		}
-	}
-	if (*val_ptr.STOP_DIRaddr == 3) {
-		sem_wait(&LOCK);
-		*val_ptr.STOP_DIRaddr = 1;
-		sem_post(&LOCK);
-	} else if (*val_ptr.STOP_DIRaddr == 2) {
-		sem_wait(&LOCK);
-		*val_ptr.STOP_DIRaddr = 0;
-		sem_post(&LOCK);
+		LOG_DEBUG("mot up auto");
 	}
-	sem_wait(&LOCK);
+	// Clear the vertical stop in one step so a horizontal stop set by another thread is kept
+	val_ptr.STOP_DIRaddr->fetch_and(~2);
 	*val_ptr.VERT_DIRaddr = 1;
-	sem_post(&LOCK);
 }
 
 /**
@@ -385,32 +396,13 @@ void mot_up_command() {
  */
 void mot_down_command() {
 	if (*val_ptr.RUN_MODEaddr == 0) {
-		if (DEBUG_COUT) {
-			LOGGING.open(LOGOUT, std::ios_base::app);
-			LOGGING
-			<< "mot down command" << std::endl;
-			LOGGING.close();
-		}
+		LOG_DEBUG("mot down command");
 	} else {
-		if (DEBUG_COUT) {
-			LOGGING.open(LOGOUT, std::ios_base::app);
-			LOGGING
-			<< "mot down auto" << std::endl;
-			LOGGING.close();
-		}
-	}
-	if (*val_ptr.STOP_DIRaddr == 3) {
-		sem_wait(&LOCK);
-		*val_ptr.STOP_DIRaddr = 1;
-		sem_post(&LOCK);
-	} else if (*val_ptr.STOP_DIRaddr == 2) {
-		sem_wait(&LOCK);
-		*val_ptr.STOP_DIRaddr = 0;
-		sem_post(&LOCK);
+		LOG_DEBUG("mot down auto");
 	}
-	sem_wait(&LOCK);
+	// Clear the vertical stop in one step so a horizontal stop set by another thread is kept
+	val_ptr.STOP_DIRaddr->fetch_and(~2);
 	*val_ptr.VERT_DIRaddr = 2;
-	sem_post(&LOCK);
 }
 
 /**
@@ -420,32 +412,13 @@ void mot_down_command() {
  */
 void mot_left_command() {
 	if (*val_ptr.RUN_MODEaddr == 0) {
-		if (DEBUG_COUT) {
-			LOGGING.open(LOGOUT, std::ios_base::app);
-			LOGGING
-			<< "mot left command" << std::endl;
-			LOGGING.close();
-		}
+		LOG_DEBUG("mot left command");
 	} else {
-		if (DEBUG_COUT) {
-			LOGGING.open(LOGOUT, std::ios_base::app);
-			LOGGING
-			<< "mot left auto" << std::endl;
-			LOGGING.close();
-		}
-	}
-	if (*val_ptr.STOP_DIRaddr == 3) {
-		sem_wait(&LOCK);
-		*val_ptr.STOP_DIRaddr = 2;
-		sem_post(&LOCK);
-	} else if (*val_ptr.STOP_DIRaddr == 1) {
-		sem_wait(&LOCK);
-		*val_ptr.STOP_DIRaddr = 0;
-		sem_post(&LOCK);
+		LOG_DEBUG("mot left auto");
 	}
-	sem_wait(&LOCK);
+	// Clear the horizontal stop in one step so a vertical stop set by another thread is kept
+	val_ptr.STOP_DIRaddr->fetch_and(~1);
 	*val_ptr.HORZ_DIRaddr = 1;
-	sem_post(&LOCK);
 }
 
 /**
@@ -455,32 +428,13 @@ void mot_left_command() {
  */
 void mot_right_command() {
 	if (*val_ptr.RUN_MODEaddr == 0) {
-		if (DEBUG_COUT) {
-			LOGGING.open(LOGOUT, std::ios_base::app);
-			LOGGING
-			<< "mot right command" << std::endl;
-			LOGGING.close();
-		}
+		LOG_DEBUG("mot right command");
 	} else {
-		if (DEBUG_COUT) {
-			LOGGING.open(LOGOUT, std::ios_base::app);
-			LOGGING
-			<< "mot right auto" << std::endl;
-			LOGGING.close();
-		}
+		LOG_DEBUG("mot right auto");
 	}
-	if (*val_ptr.STOP_DIRaddr == 3) {
-		sem_wait(&LOCK);
-		*val_ptr.STOP_DIRaddr = 2;
-		sem_post(&LOCK);
-	} else if (*val_ptr.STOP_DIRaddr == 1) {
-		sem_wait(&LOCK);
-		*val_ptr.STOP_DIRaddr = 0;
-		sem_post(&LOCK);
-	}
-	sem_wait(&LOCK);
+	// Clear the horizontal stop in one step so a vertical stop set by another thread is kept
+	val_ptr.STOP_DIRaddr->fetch_and(~1);
 	*val_ptr.HORZ_DIRaddr = 2;
-	sem_post(&LOCK);
 }
 
 /**
@@ -584,10 +538,10 @@ void gtk_css_preview() {
 
 /**
  * This is the main function of the GTK code, per the GTK usage guide.  The elements are set up from
- * global definitions, buttons are connected, and the CSS is applied.  Timeouts are applied which, after
- * a set number of microseconds (or maybe cycles?) the function in G_SOURCE_FUNC is called.  Keyboard
- * focus is set to one of the fake buttons to prevent accidental button presses.  Finally, the actual
- * window is activated.
+ * global definitions, buttons are connected, and the CSS is applied.  Rather than polling, the main loop
+ * watches GUI_EVENT_FD and the settings.cfg inotify fd, so it only wakes when something changes, plus a
+ * slow heartbeat for the watchdog.  Keyboard focus is set to one of the fake buttons to prevent
+ * accidental button presses.  Finally, the actual window is activated.
  *
  * @param *app Pointer value to the whole GtkApplication
  * @param local_val_ptr payload passed to this function (unused but passed on)
@@ -597,14 +551,21 @@ void activate(GtkApplication *app, gpointer local_val_ptr) {
 	gtk_buttons_preview();
 	gtk_css_preview();
 	
-	// Create timeout to refresh
-	g_timeout_add(500, G_SOURCE_FUNC(refresh_text_boxes), NULL);
-	g_timeout_add(50, G_SOURCE_FUNC(abort_check), NULL);
-	g_timeout_add(60, G_SOURCE_FUNC(cb_subsequent), app);
+	// Wake only on changes
+	if (GUI_EVENT_FD >= 0) {
+		g_unix_fd_add(GUI_EVENT_FD, G_IO_IN, gui_event, NULL);
+	}
+	if (SETTINGS_FD >= 0) {
+		g_unix_fd_add(SETTINGS_FD, G_IO_IN, gui_settings_event, NULL);
+	}
+	g_timeout_add_seconds(GUI_HEARTBEAT_S, G_SOURCE_FUNC(gui_heartbeat), NULL);
+	refresh_text_boxes(NULL);
+	wd_beat(WD_GUI, "GTK main loop");
 	
 	//Activate!
 	gtk_widget_grab_focus(gtk_class::fakebutton);
 	gtk_widget_show_all(gtk_class::window);
+	startup_step("gtk window", STARTUP_SPAWN);
 }
 
 /**
@@ -643,7 +604,7 @@ gboolean key_event_preview(GtkWidget *widget, GdkEventKey *event) {
 			refresh_camera();
 		}
 	} else if (strcmp(val, KV_QUIT.c_str()) == 0) {
-		*val_ptr.ABORTaddr = 1;
+		abort_code();
 	} else if (strcmp(val, KV_S_UP_UP.c_str()) == 0) {
 		if (*val_ptr.RUN_MODEaddr == 0) {
 			shutter_up_up();
@@ -669,12 +630,7 @@ gboolean key_event_preview(GtkWidget *widget, GdkEventKey *event) {
 			first_record_killer(NULL);
 		}
 	} else {
-		if (DEBUG_COUT) {
-			LOGGING.open(LOGOUT, std::ios_base::app);
-			LOGGING
-			<< "keyval: \"" << val << "\" not used here\n" << std::endl;
-			LOGGING.close();
-		}
+		LOG_DEBUG("keyval: \"" << val << "\" not used here\n");
 	}
 	
 	// Always return the keyboard focus back to our fake button
@@ -695,16 +651,9 @@ gboolean key_event_running(GtkWidget *widget, GdkEventKey *event) {
 	gchar* val = gdk_keyval_name (event->keyval);
 
 	if (strcmp(val, KV_QUIT.c_str()) == 0) {
-		sem_wait(&LOCK);
-		*val_ptr.ABORTaddr = 1;
-		sem_post(&LOCK);
+		abort_code();
 	} else {
-		if (DEBUG_COUT) {
-			LOGGING.open(LOGOUT, std::ios_base::app);
-			LOGGING
-			<< "keyval: \"" << val << "\" not used here\n" << std::endl;
-			LOGGING.close();
-		}
+		LOG_DEBUG("keyval: \"" << val << "\" not used here\n");
 	}
 	
 	// Always return the keyboard focus back to our fake button
@@ -716,7 +665,8 @@ gboolean key_event_running(GtkWidget *widget, GdkEventKey *event) {
 /**
  * This function checks whether the ABORT flag has been set elsewhere in the code.  If it is found, the
  * appropriate action is taken.  Next, the code checks if the LOST_COUNTER has passed the LOST_THRESH.
- * If this value is breached, the moon has been lost by LunAero and a shutdown is initiated.
+ * If this value is breached, the moon has been lost by LunAero and a shutdown is initiated.  It is run by
+ * gui_event, since abort_code wakes the GUI.  The camera thread stops raspivid itself.
  *
  * @param data gpointer to data from callback.  Not used here.
  * @return gboolean status
@@ -724,23 +674,12 @@ gboolean key_event_running(GtkWidget *widget, GdkEventKey *event) {
 gboolean abort_check(GtkWidget* data) {
 	if (*val_ptr.ABORTaddr == 1) {
 		if (*val_ptr.LOST_COUNTERaddr > LOST_THRESH) {
-			if (DEBUG_COUT) {
-				LOGGING.open(LOGOUT, std::ios_base::app);
-				LOGGING
-				<< "lost moon, shutting down" << std::endl;
-				LOGGING.close();
-			}
+			LOG_INFO("lost moon, shutting down");
 		} else {
-			if (DEBUG_COUT) {
-				LOGGING.open(LOGOUT, std::ios_base::app);
-				LOGGING
-				<< "recieved shutdown command from user" << std::endl;
-				LOGGING.close();
-			}
+			LOG_INFO("recieved shutdown command from user");
 		}
 		gtk_window_close(GTK_WINDOW(gtk_class::window));
 		g_application_quit(G_APPLICATION(gtk_class::app));
-		cleanup();
 	}
 	
     return TRUE;
@@ -751,13 +690,24 @@ gboolean abort_check(GtkWidget* data) {
  * mode.  The code here transitions between the modes by refreshing elements of the screen to be kept
  * and removing functionality from buttons that no longer have function in recording/automatic mode.
  * Keyboard bindings from preview/manual mode are disconnected and the new bindings are set.  Finally,
- * a new timeout is added to call g_framecheck and begin testing frames for moon centering.  The mode
- * flag RUN_MODE is incremented here.
+ * the camera thread is asked to start recording.  It sets the mode flag RUN_MODE once raspivid is
+ * running, and the analysis thread then starts testing frames for moon centering.
+ * Only the first call does anything, since the record button, key, and command socket can all ask for
+ * recording before RUN_MODE changes.  If no drive has room for a segment, the preview is left as it is.
  *
  * @param data gpointer to data from callback.  Not used here.
  */
 void first_record_killer(GtkWidget* data) {
-	sem_wait(&LOCK);
+	static bool requested = false;
+	if (requested) {
+		return;
+	}
+	if (disk_has_room()) {
+		telem_error(TELEM_ERR_DISK_FULL, "the drive is full");
+		notify_handler("LunAero Warning", "The drive is full.  Recording was not started.");
+		return;
+	}
+	requested = true;
 	
 	gtk_style_context_remove_class(gtk_widget_get_style_context(gtk_class::button_up), "activebutton");
 	gtk_style_context_add_class(gtk_widget_get_style_context(gtk_class::button_up), "fakebutton");
@@ -793,42 +743,8 @@ void first_record_killer(GtkWidget* data) {
 	gtk_label_set_text(GTK_LABEL(gtk_class::text_shutter), "");
 	g_signal_handler_disconnect(gtk_class::window, gtk_class::key_id);
 	g_signal_connect(gtk_class::window, "key-release-event", G_CALLBACK(key_event_running), NULL);
-	g_timeout_add(FRAMECHECK_FREQ, G_SOURCE_FUNC(g_framecheck), NULL);
 	
 	gtk_widget_queue_draw(gtk_class::window);
 	
-	while (g_main_context_pending(NULL)) {
-		g_main_context_iteration(NULL,FALSE);
-	}
-	
-	sem_post(&LOCK);
-	
-	first_record();
-	sem_wait(&LOCK);
-	*val_ptr.RUN_MODEaddr = 1;
-	sem_post(&LOCK);
-}
-
-/**
- * This callback function handles resetting video recording subsequent to the first recording event,
- * which is manually called by the user on mode switch.
- *
- * @param data gpointer to data from callback.  Not used here.
- * @return gboolean status
- */
-gboolean cb_subsequent(GtkWidget* data) {
-	if (*val_ptr.SUBSaddr == 2) {
-		if (DEBUG_COUT) {
-			LOGGING.open(LOGOUT, std::ios_base::app);
-			LOGGING
-			<< "cb sub 2 "
-			<< std::endl;
-			LOGGING.close();
-		}
-		reset_record();
-		sem_wait(&LOCK);
-		*val_ptr.SUBSaddr = 0;
-		sem_post(&LOCK);
-	}
-	return TRUE;
+	CAMERA_QUEUE.push(CAM_REQ_RECORD);
 }
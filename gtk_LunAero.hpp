@@ -26,21 +26,33 @@
 
 // Module specific includes
 #include <gtk/gtk.h>       // provides GTK3
+#include <glib-unix.h>     // provides g_unix_fd_add
+#include <sys/eventfd.h>   // provides eventfd
 
 // User Includes
 #include "LunAero.hpp"
 
+// Global Defined Constants
+/**
+ * Seconds between heartbeats of the GUI thread for the watchdog while nothing else wakes it.
+ */
+#define GUI_HEARTBEAT_S 1
+
 // Declare Functions
+int gui_events_init();
+void gui_notify();
+gboolean gui_event(gint fd, GIOCondition condition, gpointer data);
+gboolean gui_settings_event(gint fd, GIOCondition condition, gpointer data);
+gboolean gui_heartbeat(gpointer data);
+gboolean refresh_text_boxes(gpointer data);
 void screen_size();
 void activate(GtkApplication *app, gpointer user_data);
 gboolean key_event_preview(GtkWidget *widget, GdkEventKey *event);
 gboolean key_event_running(GtkWidget *widget, GdkEventKey *event);
 gboolean abort_check(GtkWidget* data);
-gboolean g_framecheck(gpointer data);
 gboolean key_event(GtkWidget *widget, GdkEventKey *event);
 std::string get_css_string();
 void first_record_killer(GtkWidget* data);
-gboolean cb_subsequent(GtkWidget* data);
 void mot_stop_command();
 void mot_up_command();
 void mot_down_command();
@@ -48,13 +60,14 @@ void mot_left_command();
 void mot_right_command();
 
 /**
- * Modifier value for determining the font size.  Customizable from settings.cfg
+ * eventfd written by gui_notify whenever something the GUI shows changes.  The GTK main loop sleeps on
+ * it instead of polling.  -1 in a headless run.
  */
-inline int FONT_MOD = 20;
+inline int GUI_EVENT_FD = -1;
 /**
- * Frequency in milliseconds to check the frame for moon centering.  Customizable from settings.cfg
+ * Modifier value for determining the font size.  Customizable from settings.cfg
  */
-inline int FRAMECHECK_FREQ = 50;
+inline int FONT_MOD = 20;
 /**
  * Keybinding for quit command
  * Customizable from settings.cfg
@@ -280,9 +293,10 @@ class gtk_class {
 		inline static GtkWidget *fakebutton5;
 		
 		/**
-		 * Holds the CSS string.  Not an actual widtet!
+		 * Holds the CSS string.  Not an actual widtet!  Filled by main during startup, since building it
+		 * measures the screen.
 		 */
-		inline static const std::string css_string = get_css_string();
+		inline static std::string css_string;
 		/**
 		 * Holds the key_id of a button pressed on the user's keyboard.
 		 */
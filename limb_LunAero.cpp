@@ -0,0 +1,274 @@
+/*
+ * C_LunAero/limb_LunAero.cpp - Limb fitting for LunAero_C
+ * Copyright (C) <2020>  <Wesley T. Honeycutt>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "limb_LunAero.hpp"
+
+/**
+ * This function finds the edge points of the moon from its runs (see blob_label): bright pixels with a
+ * dark neighbour.  These are the two ends of each run, and the stretches of a run not covered by runs
+ * in both the rows above and below, so only the edge itself is walked, never the inside of the disk.
+ * Pixels on the border of the region of interest are skipped, since there the disk is cut off by the
+ * frame and not by its limb.  If there are more than LIMB_MAX_POINTS, they are sampled evenly using the
+ * count from the previous frame, so only one pass is made.
+ *
+ * @param width width of the region
+ * @param height height of the region
+ * @param px receives up to LIMB_MAX_POINTS columns
+ * @param py receives up to LIMB_MAX_POINTS rows
+ * @return count number of points stored
+ */
+int limb_points(int width, int height, float *px, float *py) {
+	static int last_total = 0;
+	int stride = (last_total / LIMB_MAX_POINTS) + 1;
+	int total = 0;
+	int count = 0;
+	for (int k=1; k<height-1; k++) {
+		int above = BLOB_ROWS[k - 1];
+		int below = BLOB_ROWS[k + 1];
+		for (int i=BLOB_ROWS[k]; i<BLOB_ROWS[k + 1]; i++) {
+			const blob_run &run = BLOB_MOON[i];
+			int j = std::max(run.x0, 1);
+			int last = std::min(run.x1, width - 2);
+			while (j <= last) {
+				// Skip the stretch with bright pixels on all four sides
+				if ((j > run.x0) && (j < run.x1)) {
+					while ((above < BLOB_ROWS[k]) && (BLOB_MOON[above].x1 < j)) {
+						above++;
+					}
+					while ((below < BLOB_ROWS[k + 2]) && (BLOB_MOON[below].x1 < j)) {
+						below++;
+					}
+					if ((above < BLOB_ROWS[k]) && (BLOB_MOON[above].x0 <= j) && (below < BLOB_ROWS[k + 2])
+							&& (BLOB_MOON[below].x0 <= j)) {
+						j = std::min({BLOB_MOON[above].x1, BLOB_MOON[below].x1, run.x1 - 1}) + 1;
+						continue;
+					}
+				}
+				if (((total % stride) == 0) && (count < LIMB_MAX_POINTS)) {
+					px[count] = j;
+					py[count] = k;
+					count++;
+				}
+				total++;
+				j++;
+			}
+		}
+	}
+	last_total = total;
+	return count;
+}
+
+/**
+ * This function finds the circle through three points.
+ *
+ * @param x1 first point
+ * @param y1 first point
+ * @param x2 second point
+ * @param y2 second point
+ * @param x3 third point
+ * @param y3 third point
+ * @param x receives the centre column
+ * @param y receives the centre row
+ * @param r receives the radius
+ * @return status 0 on success, 1 if the points are in a line
+ */
+int limb_circle3(float x1, float y1, float x2, float y2, float x3, float y3, double &x, double &y, double &r) {
+	double ax = x2 - x1;
+	double ay = y2 - y1;
+	double bx = x3 - x1;
+	double by = y3 - y1;
+	double d = 2. * ((ax * by) - (ay * bx));
+	if (fabs(d) < 1e-6) {
+		return 1;
+	}
+	double a2 = (ax * ax) + (ay * ay);
+	double b2 = (bx * bx) + (by * by);
+	double ux = ((by * a2) - (ay * b2)) / d;
+	double uy = ((ax * b2) - (bx * a2)) / d;
+	x = x1 + ux;
+	y = y1 + uy;
+	r = sqrt((ux * ux) + (uy * uy));
+	return 0;
+}
+
+/**
+ * This function finds the determinant of a 3x3 matrix.
+ *
+ * @param m matrix
+ * @return det determinant
+ */
+double limb_det3(const double m[3][3]) {
+	return m[0][0] * ((m[1][1] * m[2][2]) - (m[1][2] * m[2][1]))
+		- m[0][1] * ((m[1][0] * m[2][2]) - (m[1][2] * m[2][0]))
+		+ m[0][2] * ((m[1][0] * m[2][1]) - (m[1][1] * m[2][0]));
+}
+
+/**
+ * This function refits a circle to the edge points near it by algebraic least squares, which gives a
+ * sub-pixel centre and radius from the many whole pixel points on the limb.  The quality and rms of the
+ * circle are then measured against every point.
+ *
+ * @param px edge point columns
+ * @param py edge point rows
+ * @param count number of edge points
+ * @param circle circle to refine, updated in place
+ * @return status 0 on success, 1 if too few points were near the circle
+ */
+int limb_refine(const float *px, const float *py, int count, limb_circle &circle) {
+	// Fit x^2 + y^2 + Dx + Ey + F = 0 to the points near the circle, relative to its centre
+	double sxx = 0., sxy = 0., syy = 0., sx = 0., sy = 0., sxz = 0., syz = 0., sz = 0.;
+	int n = 0;
+	for (int i=0; i<count; i++) {
+		double dx = px[i] - circle.x;
+		double dy = py[i] - circle.y;
+		if (fabs(sqrt((dx * dx) + (dy * dy)) - circle.r) > LIMB_TOLERANCE) {
+			continue;
+		}
+		double z = (dx * dx) + (dy * dy);
+		sxx += dx * dx;
+		sxy += dx * dy;
+		syy += dy * dy;
+		sx += dx;
+		sy += dy;
+		sxz += dx * z;
+		syz += dy * z;
+		sz += z;
+		n++;
+	}
+	if (n < LIMB_MIN_INLIERS) {
+		return 1;
+	}
+	// Solve the normal equations for D, E, and F by Cramer's rule
+	double m[3][3] = {{sxx, sxy, sx}, {sxy, syy, sy}, {sx, sy, (double)n}};
+	double v[3] = {-sxz, -syz, -sz};
+	double det = limb_det3(m);
+	if (fabs(det) < 1e-9) {
+		return 1;
+	}
+	double solution[3];
+	for (int c=0; c<3; c++) {
+		double mc[3][3];
+		for (int i=0; i<3; i++) {
+			for (int j=0; j<3; j++) {
+				mc[i][j] = (j == c) ? v[i] : m[i][j];
+			}
+		}
+		solution[c] = limb_det3(mc) / det;
+	}
+	double D = solution[0];
+	double E = solution[1];
+	double F = solution[2];
+	double ox = -D / 2.;
+	double oy = -E / 2.;
+	double r2 = (ox * ox) + (oy * oy) - F;
+	if (r2 <= 0.) {
+		return 1;
+	}
+	circle.x += ox;
+	circle.y += oy;
+	circle.r = sqrt(r2);
+
+	double sum_sq = 0.;
+	int inliers = 0;
+	for (int i=0; i<count; i++) {
+		double dx = px[i] - circle.x;
+		double dy = py[i] - circle.y;
+		double err = sqrt((dx * dx) + (dy * dy)) - circle.r;
+		if (fabs(err) <= LIMB_TOLERANCE) {
+			sum_sq += err * err;
+			inliers++;
+		}
+	}
+	circle.points = count;
+	circle.inliers = inliers;
+	circle.quality = (double)inliers / count;
+	circle.rms = (inliers > 0) ? sqrt(sum_sq / inliers) : 0.;
+	return 0;
+}
+
+/**
+ * This function fits a circle to the limb of the moon.  Unlike the centroid of the bright pixels, the
+ * centre of the fitted circle is the centre of the whole disk even for a crescent, or when part of the
+ * disk is outside the frame.  Circles through three random edge points are tried, and the one with the
+ * most edge points near it is refined by least squares (RANSAC), so the terminator of a crescent and
+ * stray bright specks do not pull the fit.  The bright pixels must lie inside the circle, which rules
+ * out circles along the terminator, whose bright side faces outwards.
+ *
+ * @param width width of the region
+ * @param height height of the region
+ * @param mx centroid column of the moon
+ * @param my centroid row of the moon
+ * @param seed seed for choosing points, so a frame always gives the same fit
+ * @param circle receives the fitted circle
+ * @return status 0 if a good fit was found, 1 if not
+ */
+int limb_fit(int width, int height, double mx, double my, uint64_t seed, limb_circle &circle) {
+	float px[LIMB_MAX_POINTS];
+	float py[LIMB_MAX_POINTS];
+	int count = limb_points(width, height, px, py);
+	circle = {0., 0., 0., 0., 0., count, 0};
+	if (count < LIMB_MIN_INLIERS) {
+		return 1;
+	}
+	double max_r = width + height;
+	uint64_t state = (seed * 6364136223846793005ull) + 1442695040888963407ull;
+	int best = 0;
+	for (int it=0; it<LIMB_ITERATIONS; it++) {
+		int pick[3];
+		for (int p=0; p<3; p++) {
+			state = (state * 6364136223846793005ull) + 1442695040888963407ull;
+			pick[p] = (int)((state >> 33) % count);
+		}
+		if ((pick[0] == pick[1]) || (pick[1] == pick[2]) || (pick[0] == pick[2])) {
+			continue;
+		}
+		double x, y, r;
+		if (limb_circle3(px[pick[0]], py[pick[0]], px[pick[1]], py[pick[1]], px[pick[2]], py[pick[2]], x, y,
+				r) != 0) {
+			continue;
+		}
+		if ((r < LIMB_MIN_RADIUS) || (r > max_r) || (((mx - x) * (mx - x)) + ((my - y) * (my - y)) > r * r)) {
+			continue;
+		}
+		int inliers = 0;
+		for (int i=0; i<count; i++) {
+			double dx = px[i] - x;
+			double dy = py[i] - y;
+			if (fabs(sqrt((dx * dx) + (dy * dy)) - r) <= LIMB_TOLERANCE) {
+				inliers++;
+			}
+		}
+		if (inliers > best) {
+			best = inliers;
+			circle.x = x;
+			circle.y = y;
+			circle.r = r;
+		}
+	}
+	if (best < LIMB_MIN_INLIERS) {
+		return 1;
+	}
+	if (limb_refine(px, py, count, circle) != 0) {
+		return 1;
+	}
+	if ((circle.inliers < LIMB_MIN_INLIERS) || (circle.quality < LIMB_MIN_QUALITY) || (circle.r < LIMB_MIN_RADIUS)
+			|| (circle.r > max_r)) {
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,93 @@
+/*
+ * C_LunAero/limb_LunAero.hpp - Limb fitting headers for LunAero_C
+ * Copyright (C) <2020>  <Wesley T. Honeycutt>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIMB_LUNAERO_H
+#define LIMB_LUNAERO_H
+
+// Standard C++ includes
+#include <algorithm>       // provides std::min and std::max
+#include <cmath>           // provides sqrt and fabs
+#include <cstdint>         // provides fixed width integers
+
+// User Includes
+#include "LunAero.hpp"
+
+// Global Defined Constants
+/**
+ * Most edge points kept from one frame.  Longer limbs are sampled evenly, which keeps the fit time
+ * fixed however large the moon is.
+ */
+#define LIMB_MAX_POINTS 512
+/**
+ * Number of random three point circles tried.
+ */
+#define LIMB_ITERATIONS 100
+/**
+ * Distance in pixels from a circle for an edge point to count as on it.
+ */
+#define LIMB_TOLERANCE 1.5
+/**
+ * Fewest edge points on the circle for the fit to be used.
+ */
+#define LIMB_MIN_INLIERS 20
+/**
+ * Smallest share of the edge points on the circle for the fit to be used.  The terminator of a
+ * crescent makes up much of the rest.
+ */
+#define LIMB_MIN_QUALITY 0.4
+/**
+ * Smallest radius in pixels accepted, so specks and noise are never taken for the moon.
+ */
+#define LIMB_MIN_RADIUS 8
+
+/**
+ * A circle fitted to the limb of the moon, in pixels of the region of interest.
+ */
+struct limb_circle {
+	double x;
+	double y;
+	double r;
+	/**
+	 * Share of the edge points within LIMB_TOLERANCE of the circle, between 0 and 1.
+	 */
+	double quality;
+	/**
+	 * Root mean square distance of those points from the circle.
+	 */
+	double rms;
+	/**
+	 * Number of edge points found and number on the circle.
+	 */
+	int points;
+	int inliers;
+};
+
+/**
+ * Should the centre of the moon be found by fitting a circle to its limb?  If not, or if no good fit
+ * is found, the centroid of the bright pixels is used.  Customizable from settings.cfg.
+ */
+inline std::atomic<bool> LIMB_FIT = true;
+
+// Function Prototypes
+int limb_points(int width, int height, float *px, float *py);
+int limb_circle3(float x1, float y1, float x2, float y2, float x3, float y3, double &x, double &y, double &r);
+double limb_det3(const double m[3][3]);
+int limb_refine(const float *px, const float *py, int count, limb_circle &circle);
+int limb_fit(int width, int height, double mx, double my, uint64_t seed, limb_circle &circle);
+
+#endif
@@ -0,0 +1,273 @@
+/*
+ * C_LunAero/log_LunAero.cpp - Debug log functions for LunAero_C
+ * Copyright (C) <2020>  <Wesley T. Honeycutt>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "log_LunAero.hpp"
+
+/**
+ * This function converts the name of a log level from settings.cfg to its value.
+ *
+ * @param name one of trace, debug, info, warn, or error
+ * @return level the LOG_LEVEL_* value, or -1 if the name is not recognized
+ */
+int log_parse_level(std::string name) {
+	std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+	if (name == "trace") {
+		return LOG_LEVEL_TRACE;
+	} else if (name == "debug") {
+		return LOG_LEVEL_DEBUG;
+	} else if (name == "info") {
+		return LOG_LEVEL_INFO;
+	} else if (name == "warn") {
+		return LOG_LEVEL_WARN;
+	} else if (name == "error") {
+		return LOG_LEVEL_ERROR;
+	}
+	return -1;
+}
+
+/**
+ * This function reads the monotonic clock.  Unlike the wall clock it never jumps when NTP or the user
+ * sets the time, so message order and spacing in the log can be trusted.
+ *
+ * @return ns monotonic time in nanoseconds
+ */
+uint64_t log_now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((uint64_t)ts.tv_sec * 1000000000ull) + ts.tv_nsec;
+}
+
+/**
+ * This function allocates the log rings.  It must be called at the start of main, before anything is
+ * logged or any thread is started.  Messages logged before the flusher starts wait in the rings.
+ *
+ */
+void log_init() {
+	LOG_RINGS = new (std::nothrow) log_ring[LOG_THREADS];
+	if (LOG_RINGS == NULL) {
+		std::cerr << "ERROR: could not allocate the log rings, logging is disabled" << std::endl;
+		return;
+	}
+	for (int i=0; i<LOG_THREADS; i++) {
+		log_ring *ring = &LOG_RINGS[i];
+		ring->head.store(0);
+		ring->drops.store(0);
+		ring->tail = 0;
+		ring->tag = '?';
+		for (uint32_t j=0; j<LOG_SLOTS; j++) {
+			ring->slot[j].seq.store(j);
+		}
+	}
+	LOG_EPOCH = log_now();
+	log_set_thread(0, 'G');
+}
+
+/**
+ * This function selects the ring used by the calling thread.  Each worker thread calls it once, as soon
+ * as it starts.  Threads which never call it log to ring 0 with the main thread, which is safe since
+ * every ring accepts several writers.
+ *
+ * @param index ring to use, less than LOG_THREADS
+ * @param tag character printed with every message from this thread
+ */
+void log_set_thread(int index, char tag) {
+	LOG_INDEX = index;
+	if (LOG_RINGS != NULL) {
+		LOG_RINGS[index].tag = tag;
+	}
+}
+
+/**
+ * This function queues one message.  A slot is claimed by advancing the head of the ring of this
+ * thread, and handed to the flusher by publishing its sequence number.  If the ring is full the message
+ * is counted as dropped rather than waiting, so logging never stalls the tracking or motor loops.
+ *
+ * @param text message to queue, normally ending in a newline
+ * @param len number of bytes in text
+ * @param kind LOG_KIND_TEXT for a line of text or LOG_KIND_TELEM for a telemetry event
+ */
+void log_push(const char *text, size_t len, int kind) {
+	if ((LOG_RINGS == NULL) || (len == 0)) {
+		return;
+	}
+	log_ring *ring = &LOG_RINGS[LOG_INDEX];
+	uint32_t pos = ring->head.load(std::memory_order_relaxed);
+	log_record *rec;
+	while (true) {
+		rec = &ring->slot[pos & (LOG_SLOTS - 1)];
+		uint32_t seq = rec->seq.load(std::memory_order_acquire);
+		int32_t diff = (int32_t)(seq - pos);
+		if (diff == 0) {
+			if (ring->head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+				break;
+			}
+		} else if (diff < 0) {
+			ring->drops.fetch_add(1, std::memory_order_relaxed);
+			return;
+		} else {
+			pos = ring->head.load(std::memory_order_relaxed);
+		}
+	}
+	rec->ts = log_now();
+	rec->len = (len < LOG_TEXT) ? len : LOG_TEXT;
+	rec->kind = kind;
+	memcpy(rec->text, text, rec->len);
+	rec->seq.store(pos + 1, std::memory_order_release);
+}
+
+/**
+ * This function writes a whole buffer to a file, retrying short writes.
+ *
+ * @param fd open file, or -1 to discard the buffer
+ * @param out bytes to write
+ */
+static void log_write_all(int fd, const std::string &out) {
+	size_t done = 0;
+	while ((fd >= 0) && (done < out.size())) {
+		ssize_t ret = write(fd, out.data() + done, out.size() - done);
+		if (ret <= 0) {
+			break;
+		}
+		done += ret;
+	}
+}
+
+/**
+ * This function moves every published message from the rings to the log files.  Messages are sorted by
+ * time so lines from the different threads interleave correctly.  Text lines are prefixed with the
+ * seconds since startup and the thread tag, telemetry events are encoded by telem_encode, and each file
+ * gets a single write call.
+ *
+ * @param fd open log file, or -1
+ * @param tfd open telemetry file, or -1
+ * @return count number of messages written
+ */
+int log_drain(int fd, int tfd) {
+	struct pending {
+		uint64_t ts;
+		char tag;
+		int kind;
+		std::string text;
+	};
+	vector <pending> batch;
+	for (int i=0; i<LOG_THREADS; i++) {
+		log_ring *ring = &LOG_RINGS[i];
+		while (true) {
+			log_record *rec = &ring->slot[ring->tail & (LOG_SLOTS - 1)];
+			if (rec->seq.load(std::memory_order_acquire) != ring->tail + 1) {
+				break;
+			}
+			batch.push_back({rec->ts, ring->tag, (int)rec->kind, std::string(rec->text, rec->len)});
+			rec->seq.store(ring->tail + LOG_SLOTS, std::memory_order_release);
+			ring->tail += 1;
+		}
+		uint32_t drops = ring->drops.exchange(0, std::memory_order_relaxed);
+		if (drops > 0) {
+			batch.push_back({log_now(), ring->tag, LOG_KIND_TEXT, "WARNING: log ring full, dropped " + std::to_string(drops) + " messages\n"});
+		}
+	}
+	if (batch.empty()) {
+		return 0;
+	}
+	std::stable_sort(batch.begin(), batch.end(), [](const pending &a, const pending &b) {
+		return a.ts < b.ts;
+	});
+	std::string out;
+	std::string tout;
+	char prefix[32];
+	for (unsigned int i=0; i<batch.size(); i++) {
+		if (batch[i].kind == LOG_KIND_TELEM) {
+			telem_encode(tout, batch[i].ts - LOG_EPOCH, batch[i].tag, batch[i].text.data(), batch[i].text.size());
+			continue;
+		}
+		snprintf(prefix, sizeof(prefix), "[%11.6f %c] ", (batch[i].ts - LOG_EPOCH) / 1e9, batch[i].tag);
+		out += prefix;
+		out += batch[i].text;
+		if (out.back() != '\n') {
+			out += '\n';
+		}
+	}
+	log_write_all(fd, out);
+	log_write_all(tfd, tout);
+	return batch.size();
+}
+
+/**
+ * This function runs on the flusher thread.  It drains the rings into LOGOUT and TELEMOUT until
+ * log_stop_flusher is called, sleeping briefly whenever there is nothing to write.  Either file is
+ * skipped if its path is empty.
+ *
+ */
+void log_flush_loop() {
+	int fd = -1;
+	int tfd = -1;
+	if (!LOGOUT.empty()) {
+		fd = open(LOGOUT.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+		if (fd < 0) {
+			std::cerr << "ERROR: could not open " << LOGOUT << std::endl;
+		}
+		log_write_all(fd, "log started " + current_time(1) + " UTC, times are seconds since startup\n");
+	}
+	if (!TELEMOUT.empty()) {
+		tfd = open(TELEMOUT.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		if (tfd < 0) {
+			std::cerr << "ERROR: could not open " << TELEMOUT << std::endl;
+		}
+		std::string header;
+		telem_header(header);
+		log_write_all(tfd, header);
+	}
+	while (!LOG_STOP.load()) {
+		if (log_drain(fd, tfd) == 0) {
+			usleep(LOG_FLUSH_US);
+		}
+	}
+	log_drain(fd, tfd);
+	if (fd >= 0) {
+		close(fd);
+	}
+	if (tfd >= 0) {
+		close(tfd);
+	}
+}
+
+/**
+ * This function starts the single flusher thread for the debug log and telemetry.  It is called from
+ * main once the settings are read and the log files are known.
+ *
+ */
+void log_start_flusher() {
+	if ((LOG_RINGS == NULL) || (LOGOUT.empty() && TELEMOUT.empty())) {
+		return;
+	}
+	LOG_STOP.store(false);
+	LOG_THREAD = std::thread(log_flush_loop);
+}
+
+/**
+ * This function stops the flusher thread once every worker thread has been joined, writing out anything
+ * left in the rings.
+ *
+ */
+void log_stop_flusher() {
+	if (!LOG_THREAD.joinable()) {
+		return;
+	}
+	LOG_STOP.store(true);
+	LOG_THREAD.join();
+}
@@ -0,0 +1,208 @@
+/*
+ * C_LunAero/log_LunAero.hpp - Debug log headers for LunAero_C
+ * Copyright (C) <2020>  <Wesley T. Honeycutt>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LOG_LUNAERO_H
+#define LOG_LUNAERO_H
+
+// Standard C++ includes
+#include <string>
+#include <iostream>
+#include <atomic>          // provides std::atomic
+#include <thread>          // provides std::thread
+#include <cstdint>         // provides fixed width integers
+#include <cstring>         // provides memcpy
+#include <new>             // provides std::nothrow
+
+// Module specific includes
+#include <fcntl.h>         // provides open
+#include <time.h>          // provides clock_gettime
+#include <unistd.h>        // provides write and usleep
+
+// User Includes
+#include "LunAero.hpp"
+
+// Global Defined Constants
+/**
+ * Number of log rings.  Each worker thread writes to its own ring, other threads share ring 0.
+ */
+#define LOG_THREADS 6
+/**
+ * Number of messages each ring can hold before new messages are dropped.  Must be a power of 2.
+ */
+#define LOG_SLOTS 1024
+/**
+ * Longest message in bytes.  Longer messages are truncated.
+ */
+#define LOG_TEXT 480
+/**
+ * Microseconds the flusher sleeps when every ring is empty.
+ */
+#define LOG_FLUSH_US 20000
+/**
+ * Kind of a queued message which is a line of text for LOGOUT.
+ */
+#define LOG_KIND_TEXT 0
+/**
+ * Kind of a queued message which is an encoded event for TELEMOUT.
+ */
+#define LOG_KIND_TELEM 1
+
+/**
+ * Severity of messages about every frame or motor tick.
+ */
+#define LOG_LEVEL_TRACE 0
+/**
+ * Severity of detailed messages useful when debugging a component.
+ */
+#define LOG_LEVEL_DEBUG 1
+/**
+ * Severity of normal progress messages.
+ */
+#define LOG_LEVEL_INFO 2
+/**
+ * Severity of recoverable problems.
+ */
+#define LOG_LEVEL_WARN 3
+/**
+ * Severity of failures.
+ */
+#define LOG_LEVEL_ERROR 4
+/**
+ * Lowest severity compiled into the program.  Messages below this level are removed by the compiler,
+ * arguments and all.  The release target of the Makefile raises this to LOG_LEVEL_DEBUG.
+ */
+#ifndef LOG_COMPILE_LEVEL
+#define LOG_COMPILE_LEVEL LOG_LEVEL_TRACE
+#endif
+
+/**
+ * Writes one line to the log at a severity.  The arguments are a stream expression such as
+ * "count: " << count.  They are only evaluated if the level is compiled in, DEBUG_COUT is set, and the
+ * level is at least LOG_THRESHOLD, so expensive arguments cost nothing when the message is off.
+ */
+#define LOG_AT(level, ...) \
+	do { \
+		if constexpr ((level) >= LOG_COMPILE_LEVEL) { \
+			if (DEBUG_COUT && ((level) >= LOG_THRESHOLD)) { \
+				LOGGING << __VA_ARGS__ << std::endl; \
+			} \
+		} \
+	} while (0)
+#define LOG_TRACE(...) LOG_AT(LOG_LEVEL_TRACE, __VA_ARGS__)
+#define LOG_DEBUG(...) LOG_AT(LOG_LEVEL_DEBUG, __VA_ARGS__)
+#define LOG_INFO(...) LOG_AT(LOG_LEVEL_INFO, __VA_ARGS__)
+#define LOG_WARN(...) LOG_AT(LOG_LEVEL_WARN, __VA_ARGS__)
+#define LOG_ERROR(...) LOG_AT(LOG_LEVEL_ERROR, __VA_ARGS__)
+
+/**
+ * One message in a log ring.  The sequence number tells the producer and flusher who owns the slot.
+ */
+struct log_record {
+	std::atomic <uint32_t> seq;
+	uint32_t len;
+	uint32_t kind;
+	uint64_t ts;
+	char text[LOG_TEXT];
+};
+
+/**
+ * Ring of messages written by one or more threads and read by the flusher.  Producers claim a
+ * slot by advancing head with a compare and swap, so no thread ever waits on a lock to log.
+ */
+struct log_ring {
+	std::atomic <uint32_t> head;
+	std::atomic <uint32_t> drops;
+	uint32_t tail;
+	char tag;
+	log_record slot[LOG_SLOTS];
+};
+
+void log_push(const char *text, size_t len, int kind);
+
+/**
+ * Stream buffer which collects one line in a fixed buffer and pushes it to the log ring when the
+ * stream is flushed by std::endl.  Nothing is allocated while logging.
+ */
+class log_buf : public std::streambuf {
+	public:
+		log_buf() {
+			setp(line, line + LOG_TEXT);
+		}
+	protected:
+		/**
+		 * Called when the line is full.  The rest of the line is discarded.
+		 */
+		int overflow(int c) override {
+			return c;
+		}
+		/**
+		 * Called by std::endl.  Sends the line to the ring and starts a new one.
+		 */
+		int sync() override {
+			log_push(line, pptr() - line, LOG_KIND_TEXT);
+			setp(line, line + LOG_TEXT);
+			return 0;
+		}
+	private:
+		char line[LOG_TEXT];
+};
+
+/**
+ * Output stream used for LOGGING.  Each thread has its own so lines from different threads never mix.
+ */
+class log_stream : public std::ostream {
+	public:
+		log_stream() : std::ostream(&buf) {}
+	private:
+		log_buf buf;
+};
+
+/**
+ * Lowest severity written to the log at runtime.  Customizable from settings.cfg with LOG_LEVEL.
+ */
+inline std::atomic<int> LOG_THRESHOLD = LOG_LEVEL_DEBUG;
+
+/**
+ * Stream behind the LOG_* macros.  A line written with LOGGING << ... << std::endl is queued without
+ * blocking and written to LOGOUT by the flusher thread.  Prefer the macros, which skip the formatting
+ * when the message is off.
+ */
+inline thread_local log_stream LOGGING;
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+
+// Global Variables - Not "private" but not necessary to define for Doxygen
+inline log_ring *LOG_RINGS = NULL;
+inline thread_local int LOG_INDEX = 0;
+inline uint64_t LOG_EPOCH = 0;
+inline std::atomic <bool> LOG_STOP(false);
+inline std::thread LOG_THREAD;
+
+#endif /* DOXYGEN_SHOULD_SKIP_THIS */
+
+// Function Prototypes
+int log_parse_level(std::string name);
+uint64_t log_now();
+void log_init();
+void log_set_thread(int index, char tag);
+int log_drain(int fd, int tfd);
+void log_flush_loop();
+void log_start_flusher();
+void log_stop_flusher();
+
+#endif
@@ -0,0 +1,404 @@
+/*
+ * C_LunAero/logdump_LunAero.cpp - Telemetry decoder for LunAero_C
+ * Copyright (C) <2020>  <Wesley T. Honeycutt>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * lunaero-logdump converts the telemetry.lat file written by LunAero into CSV or JSON, or prints a
+ * summary of the night.  It only depends on the standard library so it can be built on a desktop.
+ *
+ * Build with
+ *   make logdump
+ *
+ * Usage
+ *   lunaero-logdump [--csv | --json | --summary] [--event NAME] telemetry.lat
+ *
+ *   --csv       one line per record (default).  With --event the fields get their own columns.
+ *   --json      one JSON object per line
+ *   --summary   frame rate, tracking error, motor activity, camera events, and errors
+ *   --event     only output records of one type: frame, motor, mode, camera, or error
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "telemetry_format_LunAero.hpp"
+
+/**
+ * One decoded record.
+ */
+struct dump_record {
+	int type;
+	double t;
+	char proc;
+	std::vector<int64_t> fields;
+	std::string text;
+};
+
+/**
+ * This function reads every record of a telemetry file.
+ *
+ * @param path file to read
+ * @param records filled with the decoded records
+ * @param wall_ns filled with the UTC nanoseconds of record time 0
+ * @return status 0 on success
+ */
+int dump_read(const char *path, std::vector<dump_record> &records, uint64_t &wall_ns) {
+	std::ifstream file(path, std::ios::binary);
+	if (!file.is_open()) {
+		std::cerr << "ERROR: could not open " << path << std::endl;
+		return 1;
+	}
+	std::vector<unsigned char> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+	if ((data.size() < 4) || (memcmp(data.data(), TELEM_MAGIC, 4) != 0)) {
+		std::cerr << "ERROR: " << path << " is not a LunAero telemetry file" << std::endl;
+		return 1;
+	}
+	size_t pos = 4;
+	uint64_t version;
+	if (telem_get_varint(data.data(), data.size(), pos, version)
+		|| telem_get_varint(data.data(), data.size(), pos, wall_ns)) {
+		std::cerr << "ERROR: truncated header" << std::endl;
+		return 1;
+	}
+	if (version > TELEM_VERSION) {
+		std::cerr << "ERROR: " << path << " is version " << version << ", this tool reads up to "
+		<< TELEM_VERSION << std::endl;
+		return 1;
+	}
+	int64_t ts = 0;
+	while (pos < data.size()) {
+		uint64_t type, dt, len;
+		if (telem_get_varint(data.data(), data.size(), pos, type)
+			|| telem_get_varint(data.data(), data.size(), pos, dt)
+			|| (pos >= data.size())) {
+			std::cerr << "WARNING: file ends inside a record" << std::endl;
+			break;
+		}
+		char proc = (char)data[pos++];
+		if (telem_get_varint(data.data(), data.size(), pos, len) || (pos + len > data.size())) {
+			std::cerr << "WARNING: file ends inside a record" << std::endl;
+			break;
+		}
+		ts += telem_unzigzag(dt);
+		size_t end = pos + len;
+		const telem_event *event = telem_find_event(type);
+		if (event != NULL) {
+			dump_record rec;
+			rec.type = type;
+			rec.t = ts / 1e9;
+			rec.proc = proc;
+			for (int i=0; (i<event->nfields) && (pos<end); i++) {
+				uint64_t value;
+				if (telem_get_varint(data.data(), end, pos, value)) {
+					break;
+				}
+				rec.fields.push_back(telem_unzigzag(value));
+			}
+			if (event->text && (pos < end)) {
+				uint64_t tlen;
+				if ((telem_get_varint(data.data(), end, pos, tlen) == 0) && (pos + tlen <= end)) {
+					rec.text.assign((const char *)data.data() + pos, tlen);
+				}
+			}
+			records.push_back(rec);
+		}
+		pos = end;
+	}
+	return 0;
+}
+
+/**
+ * This function quotes a string for CSV or JSON output.  CSV doubles quotes while JSON escapes them.
+ *
+ * @param text string to quote
+ * @param csv true for CSV quoting, false for JSON
+ * @return quoted string
+ */
+std::string dump_quote(const std::string &text, bool csv) {
+	std::string out = "\"";
+	for (char c : text) {
+		if (csv) {
+			if (c == '"') {
+				out += '"';
+			}
+		} else if ((c == '"') || (c == '\\')) {
+			out += '\\';
+		} else if (c == '\n') {
+			out += "\\n";
+			continue;
+		}
+		out += c;
+	}
+	return out + "\"";
+}
+
+/**
+ * This function prints records as CSV.
+ *
+ * @param records decoded records
+ * @param only event type to print, or 0 for every type
+ */
+void dump_csv(const std::vector<dump_record> &records, int only) {
+	const telem_event *event = telem_find_event(only);
+	if (event != NULL) {
+		printf("t,proc");
+		for (int i=0; i<event->nfields; i++) {
+			printf(",%s", event->fields[i]);
+		}
+		printf(event->text ? ",text\n" : "\n");
+	} else {
+		printf("t,proc,event,fields,text\n");
+	}
+	for (const dump_record &rec : records) {
+		if ((only != 0) && (rec.type != only)) {
+			continue;
+		}
+		const telem_event *desc = telem_find_event(rec.type);
+		printf("%.6f,%c", rec.t, rec.proc);
+		if (event != NULL) {
+			for (int i=0; i<event->nfields; i++) {
+				if (i < (int)rec.fields.size()) {
+					printf(",%lld", (long long)rec.fields[i]);
+				} else {
+					printf(",");
+				}
+			}
+			if (event->text) {
+				printf(",%s", dump_quote(rec.text, true).c_str());
+			}
+		} else {
+			printf(",%s,\"", desc->name);
+			for (unsigned int i=0; i<rec.fields.size(); i++) {
+				printf("%s%s=%lld", (i > 0) ? " " : "", desc->fields[i], (long long)rec.fields[i]);
+			}
+			printf("\",%s", dump_quote(rec.text, true).c_str());
+		}
+		printf("\n");
+	}
+}
+
+/**
+ * This function prints records as JSON, one object per line.
+ *
+ * @param records decoded records
+ * @param only event type to print, or 0 for every type
+ * @param wall_ns UTC nanoseconds of record time 0
+ */
+void dump_json(const std::vector<dump_record> &records, int only, uint64_t wall_ns) {
+	for (const dump_record &rec : records) {
+		if ((only != 0) && (rec.type != only)) {
+			continue;
+		}
+		const telem_event *desc = telem_find_event(rec.type);
+		printf("{\"t\":%.6f,\"utc\":%.3f,\"proc\":\"%c\",\"event\":\"%s\"", rec.t, (wall_ns / 1e9) + rec.t,
+			rec.proc, desc->name);
+		for (unsigned int i=0; i<rec.fields.size(); i++) {
+			printf(",\"%s\":%lld", desc->fields[i], (long long)rec.fields[i]);
+		}
+		if (desc->text) {
+			printf(",\"text\":%s", dump_quote(rec.text, false).c_str());
+		}
+		printf("}\n");
+	}
+}
+
+/**
+ * This function returns a percentile of a list of values.
+ *
+ * @param values values to sort
+ * @param pct percentile between 0 and 100
+ * @return value at the percentile, or 0 if there are no values
+ */
+double dump_percentile(std::vector<double> values, double pct) {
+	if (values.empty()) {
+		return 0.;
+	}
+	std::sort(values.begin(), values.end());
+	size_t index = (size_t)((pct / 100.) * (values.size() - 1) + 0.5);
+	return values[index];
+}
+
+/**
+ * This function prints a summary of the night.  The tracking error is the distance in pixels of the
+ * centroid from the centre of the region of interest.  A reversal is a change of a motor between its
+ * two directions, ignoring stops in between.
+ *
+ * @param records decoded records
+ * @param wall_ns UTC nanoseconds of record time 0
+ */
+void dump_summary(const std::vector<dump_record> &records, uint64_t wall_ns) {
+	if (records.empty()) {
+		printf("no records\n");
+		return;
+	}
+	double first = records.front().t;
+	double last = records.back().t;
+	std::map<int, long> counts;
+	long frames = 0;
+	long lost = 0;
+	std::vector<double> err_x;
+	std::vector<double> err_y;
+	std::vector<double> err_r;
+	double first_frame = -1.;
+	double last_frame = -1.;
+	long reversals[2] = {0, 0};
+	int last_dir[2] = {0, 0};
+	double duty_sum[2] = {0., 0.};
+	long duty_cnt[2] = {0, 0};
+	long segments = 0;
+	long long bytes = 0;
+	long long worst_write = 0;
+	std::map<int, long> camera;
+	std::vector<const dump_record *> errors;
+	for (const dump_record &rec : records) {
+		counts[rec.type] += 1;
+		first = std::min(first, rec.t);
+		last = std::max(last, rec.t);
+		if ((rec.type == TELEM_FRAME) && (rec.fields.size() >= 5)) {
+			frames += 1;
+			if (first_frame < 0.) {
+				first_frame = rec.t;
+			}
+			last_frame = rec.t;
+			if (rec.fields[3] < 0) {
+				lost += 1;
+			} else {
+				double ex = rec.fields[3] - (rec.fields[0] / 2.);
+				double ey = rec.fields[4] - (rec.fields[1] / 2.);
+				err_x.push_back(std::fabs(ex));
+				err_y.push_back(std::fabs(ey));
+				err_r.push_back(std::sqrt((ex * ex) + (ey * ey)));
+			}
+		} else if ((rec.type == TELEM_MOTOR) && (rec.fields.size() >= 4)) {
+			for (int m=0; m<2; m++) {
+				int dir = rec.fields[m * 2];
+				int duty = rec.fields[(m * 2) + 1];
+				if (dir > 0) {
+					if ((last_dir[m] > 0) && (dir != last_dir[m])) {
+						reversals[m] += 1;
+					}
+					last_dir[m] = dir;
+					duty_sum[m] += duty;
+					duty_cnt[m] += 1;
+				}
+			}
+		} else if ((rec.type == TELEM_CAMERA) && (rec.fields.size() >= 3)) {
+			camera[rec.fields[0]] += 1;
+			if (rec.fields[0] == TELEM_CAM_CLOSED) {
+				segments += 1;
+				bytes += rec.fields[1];
+				worst_write = std::max(worst_write, (long long)rec.fields[2]);
+			}
+		} else if (rec.type == TELEM_ERROR) {
+			errors.push_back(&rec);
+		}
+	}
+	
+	time_t start = (time_t)((wall_ns / 1000000000ull) + (uint64_t)first);
+	char buffer[64];
+	strftime(buffer, sizeof(buffer), "%Y-%m-%d %H:%M:%S", gmtime(&start));
+	printf("start:            %s UTC\n", buffer);
+	printf("duration:         %.1f s\n", last - first);
+	printf("records:          %zu\n", records.size());
+	for (const telem_event &event : TELEM_EVENTS) {
+		printf("  %-15s %ld\n", event.name, counts[event.type]);
+	}
+	printf("\nframes\n");
+	double span = last_frame - first_frame;
+	printf("  rate:           %.2f frames/s\n", (span > 0.) ? (frames - 1) / span : 0.);
+	printf("  lost:           %ld (%.1f%%)\n", lost, frames ? (100. * lost) / frames : 0.);
+	printf("  error x (px):   median %.1f  p95 %.1f  max %.1f\n", dump_percentile(err_x, 50.),
+		dump_percentile(err_x, 95.), dump_percentile(err_x, 100.));
+	printf("  error y (px):   median %.1f  p95 %.1f  max %.1f\n", dump_percentile(err_y, 50.),
+		dump_percentile(err_y, 95.), dump_percentile(err_y, 100.));
+	printf("  error (px):     median %.1f  p95 %.1f  max %.1f\n", dump_percentile(err_r, 50.),
+		dump_percentile(err_r, 95.), dump_percentile(err_r, 100.));
+	printf("\nmotors\n");
+	printf("  vertical (A):   %ld reversals, mean duty %.1f%%\n", reversals[0],
+		duty_cnt[0] ? duty_sum[0] / duty_cnt[0] : 0.);
+	printf("  horizontal (B): %ld reversals, mean duty %.1f%%\n", reversals[1],
+		duty_cnt[1] ? duty_sum[1] / duty_cnt[1] : 0.);
+	printf("\ncamera\n");
+	printf("  previews:       %ld\n", camera[TELEM_CAM_PREVIEW]);
+	printf("  recordings:     %ld\n", camera[TELEM_CAM_RECORD]);
+	printf("  refreshes:      %ld\n", camera[TELEM_CAM_REFRESH]);
+	printf("  mmal retries:   %ld\n", camera[TELEM_CAM_MMAL]);
+	printf("  exposure steps: %ld\n", camera[TELEM_CAM_EXPOSURE]);
+	printf("  segments:       %ld, %.1f MB, worst write %lld ms\n", segments, bytes / 1e6, worst_write);
+	printf("\nerrors:           %zu\n", errors.size());
+	for (const dump_record *rec : errors) {
+		printf("  %10.3f %c code %lld: %s\n", rec->t, rec->proc,
+			rec->fields.empty() ? 0ll : (long long)rec->fields[0], rec->text.c_str());
+	}
+}
+
+int main(int argc, char **argv) {
+	std::string mode = "--csv";
+	int only = 0;
+	const char *path = NULL;
+	for (int i=1; i<argc; i++) {
+		std::string arg = argv[i];
+		if ((arg == "--csv") || (arg == "--json") || (arg == "--summary")) {
+			mode = arg;
+		} else if ((arg == "--event") && (i + 1 < argc)) {
+			std::string name = argv[++i];
+			for (const telem_event &event : TELEM_EVENTS) {
+				if (name == event.name) {
+					only = event.type;
+				}
+			}
+			if (only == 0) {
+				std::cerr << "ERROR: unknown event " << name << std::endl;
+				return 1;
+			}
+		} else if (arg[0] != '-') {
+			path = argv[i];
+		} else {
+			path = NULL;
+			break;
+		}
+	}
+	if (path == NULL) {
+		std::cerr << "usage: " << argv[0] << " [--csv | --json | --summary] [--event NAME] telemetry.lat"
+		<< std::endl;
+		return 2;
+	}
+	
+	std::vector<dump_record> records;
+	uint64_t wall_ns = 0;
+	if (dump_read(path, records, wall_ns)) {
+		return 1;
+	}
+	if (mode == "--json") {
+		dump_json(records, only, wall_ns);
+	} else if (mode == "--summary") {
+		dump_summary(records, wall_ns);
+	} else {
+		dump_csv(records, only);
+	}
+	return 0;
+}
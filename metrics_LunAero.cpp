@@ -0,0 +1,366 @@
+/*
+ * C_LunAero/metrics_LunAero.cpp - Performance metrics endpoint for LunAero_C
+ * Copyright (C) <2020>  <Wesley T. Honeycutt>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "metrics_LunAero.hpp"
+
+/**
+ * This function records one time in a latency histogram.
+ *
+ * @param hist histogram in METRICS
+ * @param start log_now when the stage began
+ */
+void metric_time(metric_histogram &hist, uint64_t start) {
+	uint64_t ns = log_now() - start;
+	uint64_t us = ns / 1000;
+	int index = (us <= 1) ? 0 : 64 - __builtin_clzll(us - 1);
+	if (index >= METRIC_BUCKETS) {
+		index = METRIC_BUCKETS - 1;
+	}
+	hist.bucket[index].fetch_add(1, std::memory_order_relaxed);
+	hist.sum_ns.fetch_add(ns, std::memory_order_relaxed);
+}
+
+/**
+ * This function estimates a quantile from a latency histogram.  The upper bound of the bucket holding
+ * the quantile is given, so the estimate is never below the true value and at most twice it.
+ *
+ * @param hist histogram to read
+ * @param q quantile between 0 and 1
+ * @return seconds, or 0 if nothing was recorded
+ */
+double metric_quantile(const metric_histogram &hist, double q) {
+	uint64_t counts[METRIC_BUCKETS];
+	uint64_t total = 0;
+	for (int i=0; i<METRIC_BUCKETS; i++) {
+		counts[i] = hist.bucket[i].load(std::memory_order_relaxed);
+		total += counts[i];
+	}
+	if (total == 0) {
+		return 0.;
+	}
+	uint64_t rank = (uint64_t)(q * total);
+	if (rank >= total) {
+		rank = total - 1;
+	}
+	uint64_t seen = 0;
+	for (int i=0; i<METRIC_BUCKETS; i++) {
+		seen += counts[i];
+		if (seen > rank) {
+			return (double)(1ull << i) / 1e6;
+		}
+	}
+	return (double)(1ull << (METRIC_BUCKETS - 1)) / 1e6;
+}
+
+/**
+ * This function writes one stage of the latency histogram and its quantiles in the Prometheus text
+ * format.
+ *
+ * @param out text being built
+ * @param stage value of the stage label
+ * @param hist histogram of the stage
+ */
+void metric_write_histogram(std::ostringstream &out, const char *stage, const metric_histogram &hist) {
+	uint64_t cumulative = 0;
+	for (int i=0; i<METRIC_BUCKETS - 1; i++) {
+		cumulative += hist.bucket[i].load(std::memory_order_relaxed);
+		out << "lunaero_stage_latency_seconds_bucket{stage=\"" << stage << "\",le=\""
+			<< (double)(1ull << i) / 1e6 << "\"} " << cumulative << "\n";
+	}
+	cumulative += hist.bucket[METRIC_BUCKETS - 1].load(std::memory_order_relaxed);
+	out << "lunaero_stage_latency_seconds_bucket{stage=\"" << stage << "\",le=\"+Inf\"} " << cumulative << "\n";
+	out << "lunaero_stage_latency_seconds_sum{stage=\"" << stage << "\"} "
+		<< hist.sum_ns.load(std::memory_order_relaxed) / 1e9 << "\n";
+	out << "lunaero_stage_latency_seconds_count{stage=\"" << stage << "\"} " << cumulative << "\n";
+}
+
+/**
+ * This function reads the temperature of the Raspberry Pi processor.
+ *
+ * @return degrees Celsius, or -1 if it could not be read
+ */
+double metric_cpu_temperature() {
+	std::ifstream file("/sys/class/thermal/thermal_zone0/temp");
+	long millidegrees = 0;
+	if (!(file >> millidegrees)) {
+		return -1.;
+	}
+	return millidegrees / 1000.;
+}
+
+/**
+ * This function reads the throttling flags reported by the Raspberry Pi firmware.  Bit 0 is under
+ * voltage, bit 1 a capped frequency, bit 2 throttling, and bit 3 the soft temperature limit.  Bits 16
+ * to 19 show the same conditions have happened since boot.
+ *
+ * @return flags, or -1 if vcgencmd is not available
+ */
+long metric_throttled() {
+	FILE *cmd = popen("vcgencmd get_throttled 2>/dev/null", "r");
+	if (cmd == NULL) {
+		return -1;
+	}
+	char line[128] = {0};
+	long flags = -1;
+	if (fgets(line, sizeof(line), cmd) != NULL) {
+		char *value = strchr(line, '=');
+		if (value != NULL) {
+			flags = strtol(value + 1, NULL, 16);
+		}
+	}
+	pclose(cmd);
+	return flags;
+}
+
+/**
+ * This function builds the metrics in the Prometheus text format.  The frame check rate is measured
+ * over the time since the previous request.
+ *
+ * @return metrics text
+ */
+std::string metrics_text() {
+	static uint64_t last_time = 0;
+	static uint64_t last_checks = 0;
+	uint64_t now = log_now();
+	uint64_t checks = METRICS.framechecks.load(std::memory_order_relaxed);
+	double rate = 0.;
+	if ((last_time != 0) && (now > last_time)) {
+		rate = (double)(checks - last_checks) / ((now - last_time) / 1e9);
+	}
+	last_time = now;
+	last_checks = checks;
+	
+	std::ostringstream out;
+	out << "# HELP lunaero_uptime_seconds Seconds since LunAero started.\n"
+		<< "# TYPE lunaero_uptime_seconds gauge\n"
+		<< "lunaero_uptime_seconds " << (now - LOG_EPOCH) / 1e9 << "\n"
+		<< "# HELP lunaero_run_mode 0 in preview/manual mode, 1 while recording.\n"
+		<< "# TYPE lunaero_run_mode gauge\n"
+		<< "lunaero_run_mode " << *val_ptr.RUN_MODEaddr << "\n"
+		<< "# HELP lunaero_headless 1 if LunAero was started with --headless and has no GUI.\n"
+		<< "# TYPE lunaero_headless gauge\n"
+		<< "lunaero_headless " << HEADLESS << "\n"
+		<< "# HELP lunaero_framechecks_total Frame checks run while recording.\n"
+		<< "# TYPE lunaero_framechecks_total counter\n"
+		<< "lunaero_framechecks_total " << checks << "\n"
+		<< "# HELP lunaero_framecheck_rate_hz Frame checks per second since the previous scrape.\n"
+		<< "# TYPE lunaero_framecheck_rate_hz gauge\n"
+		<< "lunaero_framecheck_rate_hz " << rate << "\n"
+		<< "# HELP lunaero_frames_lost_total Frame checks which did not find the moon.\n"
+		<< "# TYPE lunaero_frames_lost_total counter\n"
+		<< "lunaero_frames_lost_total " << METRICS.frames_lost.load(std::memory_order_relaxed) << "\n"
+		<< "# HELP lunaero_frames_dropped_total Screenshots skipped because analysis was still busy.\n"
+		<< "# TYPE lunaero_frames_dropped_total counter\n"
+		<< "lunaero_frames_dropped_total " << METRICS.frames_dropped.load(std::memory_order_relaxed) << "\n"
+		<< "# HELP lunaero_frames_missed_total Frame timer ticks skipped because a screenshot ran long.\n"
+		<< "# TYPE lunaero_frames_missed_total counter\n"
+		<< "lunaero_frames_missed_total " << METRICS.frames_missed.load(std::memory_order_relaxed) << "\n"
+		<< "# HELP lunaero_frame_overruns_total Frame checks which took longer than FRAMECHECK_FREQ.\n"
+		<< "# TYPE lunaero_frame_overruns_total counter\n"
+		<< "lunaero_frame_overruns_total " << METRICS.frame_overruns.load(std::memory_order_relaxed) << "\n"
+		<< "# HELP lunaero_frames_stale_total Frames too old to move the motors on.\n"
+		<< "# TYPE lunaero_frames_stale_total counter\n"
+		<< "lunaero_frames_stale_total " << METRICS.frames_stale.load(std::memory_order_relaxed) << "\n"
+		<< "# HELP lunaero_limb_fits_total Frames centred on a circle fitted to the limb instead of the centroid.\n"
+		<< "# TYPE lunaero_limb_fits_total counter\n"
+		<< "lunaero_limb_fits_total " << METRICS.limb_fits.load(std::memory_order_relaxed) << "\n"
+		<< "# HELP lunaero_blobs_rejected_total Bright blobs other than the moon left out of the frame checks.\n"
+		<< "# TYPE lunaero_blobs_rejected_total counter\n"
+		<< "lunaero_blobs_rejected_total " << METRICS.blobs_rejected.load(std::memory_order_relaxed) << "\n"
+		<< "# HELP lunaero_window_frames_total Frames checked only in the window around the moon.\n"
+		<< "# TYPE lunaero_window_frames_total counter\n"
+		<< "lunaero_window_frames_total " << METRICS.window_frames.load(std::memory_order_relaxed) << "\n"
+		<< "# HELP lunaero_window_fallbacks_total Frames checked again in full because the moon left the window.\n"
+		<< "# TYPE lunaero_window_fallbacks_total counter\n"
+		<< "lunaero_window_fallbacks_total " << METRICS.window_fallbacks.load(std::memory_order_relaxed) << "\n"
+		<< "# HELP lunaero_lost_counter Frames in a row the moon has been lost for.\n"
+		<< "# TYPE lunaero_lost_counter gauge\n"
+		<< "lunaero_lost_counter " << *val_ptr.LOST_COUNTERaddr << "\n"
+		<< "# HELP lunaero_moon_threshold Grey level separating the moon from the sky.\n"
+		<< "# TYPE lunaero_moon_threshold gauge\n"
+		<< "lunaero_moon_threshold " << THRESH_LEVEL.load(std::memory_order_relaxed) << "\n"
+		<< "# HELP lunaero_centroid_error_pixels Distance of the last centroid from the middle of the frame.\n"
+		<< "# TYPE lunaero_centroid_error_pixels gauge\n"
+		<< "lunaero_centroid_error_pixels{axis=\"x\"} " << METRICS.centroid_error_x.load(std::memory_order_relaxed) << "\n"
+		<< "lunaero_centroid_error_pixels{axis=\"y\"} " << METRICS.centroid_error_y.load(std::memory_order_relaxed) << "\n"
+		<< "# HELP lunaero_motor_duty_percent PWM duty cycle of each motor.\n"
+		<< "# TYPE lunaero_motor_duty_percent gauge\n"
+		<< "lunaero_motor_duty_percent{motor=\"vertical\"} " << *val_ptr.DUTY_Aaddr << "\n"
+		<< "lunaero_motor_duty_percent{motor=\"horizontal\"} " << *val_ptr.DUTY_Baddr << "\n"
+		<< "# HELP lunaero_motor_reversals_total Moves opposite to the previous move of the same motor.\n"
+		<< "# TYPE lunaero_motor_reversals_total counter\n"
+		<< "lunaero_motor_reversals_total " << METRICS.motor_reversals.load(std::memory_order_relaxed) << "\n"
+		<< "# HELP lunaero_camera_restarts_total Times raspivid was restarted.\n"
+		<< "# TYPE lunaero_camera_restarts_total counter\n"
+		<< "lunaero_camera_restarts_total " << METRICS.camera_restarts.load(std::memory_order_relaxed) << "\n"
+		<< "# HELP lunaero_mmal_errors_total MMAL errors reported by raspivid.\n"
+		<< "# TYPE lunaero_mmal_errors_total counter\n"
+		<< "lunaero_mmal_errors_total " << METRICS.mmal_errors.load(std::memory_order_relaxed) << "\n"
+		<< "# HELP lunaero_bytes_written_total Bytes of video written to the drives.\n"
+		<< "# TYPE lunaero_bytes_written_total counter\n"
+		<< "lunaero_bytes_written_total " << METRICS.bytes_written.load(std::memory_order_relaxed) << "\n"
+		<< "# HELP lunaero_disk_time_to_full_seconds Forecast time until every drive is full, -1 before recording.\n"
+		<< "# TYPE lunaero_disk_time_to_full_seconds gauge\n"
+		<< "lunaero_disk_time_to_full_seconds " << METRICS.disk_time_to_full.load(std::memory_order_relaxed) << "\n"
+		<< "# HELP lunaero_watchdog_stalls_total Stalls of the worker threads found by the watchdog.\n"
+		<< "# TYPE lunaero_watchdog_stalls_total counter\n"
+		<< "lunaero_watchdog_stalls_total " << METRICS.watchdog_stalls.load(std::memory_order_relaxed) << "\n"
+		<< "# HELP lunaero_cpu_temperature_celsius Processor temperature.\n"
+		<< "# TYPE lunaero_cpu_temperature_celsius gauge\n"
+		<< "lunaero_cpu_temperature_celsius " << metric_cpu_temperature() << "\n";
+	
+	long flags = metric_throttled();
+	if (flags >= 0) {
+		out << "# HELP lunaero_throttled Firmware throttling state, now and since boot.\n"
+			<< "# TYPE lunaero_throttled gauge\n"
+			<< "lunaero_throttled{condition=\"under_voltage\",when=\"now\"} " << ((flags >> 0) & 1) << "\n"
+			<< "lunaero_throttled{condition=\"frequency_capped\",when=\"now\"} " << ((flags >> 1) & 1) << "\n"
+			<< "lunaero_throttled{condition=\"throttled\",when=\"now\"} " << ((flags >> 2) & 1) << "\n"
+			<< "lunaero_throttled{condition=\"soft_temp_limit\",when=\"now\"} " << ((flags >> 3) & 1) << "\n"
+			<< "lunaero_throttled{condition=\"under_voltage\",when=\"since_boot\"} " << ((flags >> 16) & 1) << "\n"
+			<< "lunaero_throttled{condition=\"frequency_capped\",when=\"since_boot\"} " << ((flags >> 17) & 1) << "\n"
+			<< "lunaero_throttled{condition=\"throttled\",when=\"since_boot\"} " << ((flags >> 18) & 1) << "\n"
+			<< "lunaero_throttled{condition=\"soft_temp_limit\",when=\"since_boot\"} " << ((flags >> 19) & 1) << "\n";
+	}
+	
+	struct {
+		const char *name;
+		const metric_histogram *hist;
+	} stages[] = {
+		{"capture", &METRICS.capture},
+		{"analysis", &METRICS.analysis},
+		{"blob", &METRICS.blob},
+		{"limb", &METRICS.limb},
+		{"framecheck", &METRICS.framecheck},
+		{"frame_age", &METRICS.frame_age},
+		{"tick_lateness", &METRICS.tick_lateness},
+		{"motor", &METRICS.motor}
+	};
+	out << "# HELP lunaero_stage_latency_seconds Time taken by each stage of tracking.\n"
+		<< "# TYPE lunaero_stage_latency_seconds histogram\n";
+	for (auto &stage : stages) {
+		metric_write_histogram(out, stage.name, *stage.hist);
+	}
+	out << "# HELP lunaero_stage_latency_quantile_seconds Upper bound of the latency quantiles of each stage.\n"
+		<< "# TYPE lunaero_stage_latency_quantile_seconds gauge\n";
+	for (auto &stage : stages) {
+		for (double q : {0.5, 0.9, 0.99}) {
+			out << "lunaero_stage_latency_quantile_seconds{stage=\"" << stage.name << "\",quantile=\"" << q
+				<< "\"} " << metric_quantile(*stage.hist, q) << "\n";
+		}
+	}
+	return out.str();
+}
+
+/**
+ * This function answers one client.  The request is read but not checked, so a plain HTTP GET from
+ * curl or a scraper and a bare connection from socat both get the metrics.
+ *
+ * @param fd connected client socket
+ */
+void metrics_serve(int fd) {
+	struct pollfd pfd = {fd, POLLIN, 0};
+	if (poll(&pfd, 1, METRIC_REQUEST_MS) > 0) {
+		char request[1024];
+		// The request is not checked, so the metrics are sent even if it could not be read
+		if (read(fd, request, sizeof(request)) < 0) {
+			LOG_DEBUG("could not read the metrics request");
+		}
+	}
+	std::string body = metrics_text();
+	std::string reply = "HTTP/1.0 200 OK\r\n"
+		"Content-Type: text/plain; version=0.0.4\r\n"
+		"Content-Length: " + std::to_string(body.size()) + "\r\n"
+		"\r\n" + body;
+	size_t done = 0;
+	while (done < reply.size()) {
+		ssize_t ret = send(fd, reply.data() + done, reply.size() - done, MSG_NOSIGNAL);
+		if (ret <= 0) {
+			break;
+		}
+		done += ret;
+	}
+	close(fd);
+}
+
+/**
+ * This function runs on the metrics thread, answering clients one at a time until the run is aborted.
+ *
+ */
+void metrics_loop() {
+	while (*val_ptr.ABORTaddr == 0) {
+		struct pollfd pfd = {METRICS_FD, POLLIN, 0};
+		if (poll(&pfd, 1, METRIC_POLL_MS) <= 0) {
+			continue;
+		}
+		int fd = accept4(METRICS_FD, NULL, NULL, SOCK_CLOEXEC);
+		if (fd >= 0) {
+			metrics_serve(fd);
+		}
+	}
+}
+
+/**
+ * This function opens the metrics socket at METRICS_SOCKET and starts the metrics thread.  A socket
+ * left by an earlier run is replaced.
+ *
+ * @return status 0 if the metrics are served or METRICS_SOCKET is empty
+ */
+int metrics_start() {
+	METRICS.disk_time_to_full.store(-1);
+	if (METRICS_SOCKET.empty()) {
+		return 0;
+	}
+	struct sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if (METRICS_SOCKET.size() >= sizeof(addr.sun_path)) {
+		LOG_WARN("WARNING: METRICS_SOCKET path is too long, metrics are not served");
+		return 1;
+	}
+	strcpy(addr.sun_path, METRICS_SOCKET.c_str());
+	unlink(METRICS_SOCKET.c_str());
+	METRICS_FD = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if ((METRICS_FD < 0) || (bind(METRICS_FD, (struct sockaddr *)&addr, sizeof(addr)) != 0)
+		|| (listen(METRICS_FD, 4) != 0)) {
+		LOG_WARN("WARNING: could not open " << METRICS_SOCKET << ", metrics are not served");
+		if (METRICS_FD >= 0) {
+			close(METRICS_FD);
+		}
+		METRICS_FD = -1;
+		return 1;
+	}
+	METRICS_THREAD = std::thread(metrics_loop);
+	LOG_INFO("serving metrics on " << METRICS_SOCKET);
+	return 0;
+}
+
+/**
+ * This function stops the metrics thread once the run is aborted and removes the socket.
+ *
+ */
+void metrics_stop() {
+	if (METRICS_THREAD.joinable()) {
+		METRICS_THREAD.join();
+	}
+	if (METRICS_FD >= 0) {
+		close(METRICS_FD);
+		unlink(METRICS_SOCKET.c_str());
+		METRICS_FD = -1;
+	}
+}
@@ -0,0 +1,209 @@
+/*
+ * C_LunAero/metrics_LunAero.hpp - Performance metrics headers for LunAero_C
+ * Copyright (C) <2020>  <Wesley T. Honeycutt>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef METRICS_LUNAERO_H
+#define METRICS_LUNAERO_H
+
+// Standard C++ includes
+#include <string>
+#include <sstream>         // provides ostringstream
+#include <atomic>          // provides std::atomic
+#include <cstdint>         // provides fixed width integers
+
+// Module specific includes
+#include <poll.h>          // provides poll
+#include <sys/socket.h>    // provides socket
+#include <sys/un.h>        // provides sockaddr_un
+#include <unistd.h>        // provides read and write
+
+// User Includes
+#include "LunAero.hpp"
+
+// Global Defined Constants
+/**
+ * Number of latency histogram buckets.  Bucket i counts times up to 2^i microseconds, and the last
+ * bucket counts everything longer.
+ */
+#define METRIC_BUCKETS 22
+/**
+ * Milliseconds the metrics thread waits for a connection before checking for an abort.
+ */
+#define METRIC_POLL_MS 250
+/**
+ * Milliseconds a client has to send its request before the metrics are sent anyway.
+ */
+#define METRIC_REQUEST_MS 100
+
+/**
+ * Latency histogram of one stage.  Updated with relaxed atomics, so recording a time never waits.
+ */
+struct metric_histogram {
+	std::atomic <uint64_t> bucket[METRIC_BUCKETS];
+	std::atomic <uint64_t> sum_ns;
+};
+
+/**
+ * Counters updated from the tracking, motor, camera, and writer loops.  Values which already live in
+ * val_ptr are read from there when the metrics are served instead.
+ */
+struct metric_block {
+	/**
+	 * Frame checks run while recording.
+	 */
+	std::atomic <uint64_t> framechecks;
+	/**
+	 * Frame checks which did not find the moon.
+	 */
+	std::atomic <uint64_t> frames_lost;
+	/**
+	 * Screenshots skipped because a newer one arrived before analysis could start on them.
+	 */
+	std::atomic <uint64_t> frames_dropped;
+	/**
+	 * Frame timer ticks with no screenshot, because the previous screenshot was still being taken.
+	 */
+	std::atomic <uint64_t> frames_missed;
+	/**
+	 * Frame checks which took longer than FRAMECHECK_FREQ.
+	 */
+	std::atomic <uint64_t> frame_overruns;
+	/**
+	 * Frames older than FRAME_STALE_MS by the time they were checked, which stopped the motors.
+	 */
+	std::atomic <uint64_t> frames_stale;
+	/**
+	 * Frames whose centre came from a circle fitted to the limb rather than the centroid.
+	 */
+	std::atomic <uint64_t> limb_fits;
+	/**
+	 * Blobs of bright pixels other than the moon which were left out of the frame checks.
+	 */
+	std::atomic <uint64_t> blobs_rejected;
+	/**
+	 * Frames where the moon was found in the tracking window, without checking the whole frame.
+	 */
+	std::atomic <uint64_t> window_frames;
+	/**
+	 * Frames where the moon was not within the tracking window, so the whole frame was checked again.
+	 */
+	std::atomic <uint64_t> window_fallbacks;
+	/**
+	 * Times either motor was driven in the opposite direction to its previous move.
+	 */
+	std::atomic <uint64_t> motor_reversals;
+	/**
+	 * Times raspivid was restarted for a new segment, a refresh, or by the watchdog.
+	 */
+	std::atomic <uint64_t> camera_restarts;
+	/**
+	 * MMAL errors reported by raspivid.
+	 */
+	std::atomic <uint64_t> mmal_errors;
+	/**
+	 * Bytes of video written to the drives.
+	 */
+	std::atomic <uint64_t> bytes_written;
+	/**
+	 * Stalls found by the watchdog.
+	 */
+	std::atomic <uint64_t> watchdog_stalls;
+	/**
+	 * Distance of the last centroid from the middle of the frame in pixels.
+	 */
+	std::atomic <int32_t> centroid_error_x;
+	std::atomic <int32_t> centroid_error_y;
+	/**
+	 * Forecast seconds until every drive is full, or -1 before the first forecast.
+	 */
+	std::atomic <int64_t> disk_time_to_full;
+	/**
+	 * Time to take the screenshot of the preview.
+	 */
+	metric_histogram capture;
+	/**
+	 * Time to find the moon in the screenshot.
+	 */
+	metric_histogram analysis;
+	/**
+	 * Time to fit a circle to the limb of the moon.
+	 */
+	metric_histogram limb;
+	/**
+	 * Time to threshold the frame into runs of bright pixels and pick out the moon.
+	 */
+	metric_histogram blob;
+	/**
+	 * Time of the whole frame check on the analysis thread.
+	 */
+	metric_histogram framecheck;
+	/**
+	 * Time from the screenshot until the motors were commanded from it.
+	 */
+	metric_histogram frame_age;
+	/**
+	 * Time from when a frame timer tick was due until the capture thread woke for it.
+	 */
+	metric_histogram tick_lateness;
+	/**
+	 * Time of one cycle of the motor handler, including braking.
+	 */
+	metric_histogram motor;
+};
+
+/**
+ * Path of the Unix socket the metrics are served on.  Empty to not serve metrics.  Customizable from
+ * settings.cfg.
+ */
+inline std::string METRICS_SOCKET = "/tmp/lunaero-metrics.sock";
+
+/**
+ * Counters for the metrics endpoint.
+ */
+inline metric_block METRICS;
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+
+// Global Variables - Not "private" but not necessary to define for Doxygen
+inline int METRICS_FD = -1;
+inline std::thread METRICS_THREAD;
+
+#endif /* DOXYGEN_SHOULD_SKIP_THIS */
+
+/**
+ * This function adds to a counter.  It is a single relaxed atomic add, cheap enough for any loop.
+ *
+ * @param counter counter in METRICS
+ * @param n amount to add
+ */
+inline void metric_add(std::atomic <uint64_t> &counter, uint64_t n = 1) {
+	counter.fetch_add(n, std::memory_order_relaxed);
+}
+
+// Function Prototypes
+void metric_time(metric_histogram &hist, uint64_t start);
+double metric_quantile(const metric_histogram &hist, double q);
+void metric_write_histogram(std::ostringstream &out, const char *stage, const metric_histogram &hist);
+double metric_cpu_temperature();
+long metric_throttled();
+std::string metrics_text();
+void metrics_serve(int fd);
+void metrics_loop();
+int metrics_start();
+void metrics_stop();
+
+#endif
@@ -30,31 +30,24 @@
  *
  */
 void motor_handler() {
-	// Handle stopping
-	if (*val_ptr.STOP_DIRaddr == 3) {
+	// Handle stopping.  The stop is taken and cleared in one step, so a stop set by another thread while
+	// this one brakes is kept for the next cycle rather than lost.
+	int stop = val_ptr.STOP_DIRaddr->exchange(0);
+	if (stop == 3) {
 		//~ std::cout << "stopping both motors" << std::endl;
-		sem_wait(&LOCK);
 		*val_ptr.HORZ_DIRaddr = 0;
 		*val_ptr.VERT_DIRaddr = 0;
-		sem_post(&LOCK);
+		wd_beat(WD_MOTOR, "braking both motors");
 		while ((*val_ptr.DUTY_Aaddr > 0) || (*val_ptr.DUTY_Baddr > 0)) {
 			if (*val_ptr.DUTY_Aaddr > BRAKE_DUTY) {
-				sem_wait(&LOCK);
-				*val_ptr.DUTY_Aaddr = BRAKE_DUTY;
-				sem_post(&LOCK);
+				*val_ptr.DUTY_Aaddr = BRAKE_DUTY.load();
 			} else {
-				sem_wait(&LOCK);
 				*val_ptr.DUTY_Aaddr = *val_ptr.DUTY_Aaddr - 1;
-				sem_post(&LOCK);
 			}
 			if (*val_ptr.DUTY_Baddr > BRAKE_DUTY) {
-				sem_wait(&LOCK);
-				*val_ptr.DUTY_Baddr = BRAKE_DUTY;
-				sem_post(&LOCK);
+				*val_ptr.DUTY_Baddr = BRAKE_DUTY.load();
 			} else {
-				sem_wait(&LOCK);
 				*val_ptr.DUTY_Baddr = *val_ptr.DUTY_Baddr - 1;
-				sem_post(&LOCK);
 			}
 			softPwmWrite(APINP, *val_ptr.DUTY_Aaddr);
 			softPwmWrite(BPINP, *val_ptr.DUTY_Baddr);
@@ -68,15 +61,12 @@ void motor_handler() {
 		softPwmWrite(BPINP, *val_ptr.DUTY_Baddr);
 		// When stopped, reset code
 		//~ val_ptr.STOP_DIRaddr = 0;
-	} else if (*val_ptr.STOP_DIRaddr == 2) {
-		sem_wait(&LOCK);
+	} else if (stop == 2) {
 		*val_ptr.VERT_DIRaddr = 0;
-		sem_post(&LOCK);
 		//~ std::cout << "stopping vertical motor (A)" << std::endl;
+		wd_beat(WD_MOTOR, "braking vertical motor");
 		while (*val_ptr.DUTY_Aaddr > 0) {
-			sem_wait(&LOCK);
 			*val_ptr.DUTY_Aaddr = *val_ptr.DUTY_Aaddr - 1;
-			sem_post(&LOCK);
 			softPwmWrite(APINP, *val_ptr.DUTY_Aaddr);
 			usleep(10);
 		}
@@ -85,15 +75,12 @@ void motor_handler() {
 		softPwmWrite(APINP, *val_ptr.DUTY_Aaddr);
 		// When stopped, reset code
 		//~ val_ptr.STOP_DIRaddr = 0;
-	} else if (*val_ptr.STOP_DIRaddr == 1) {
-		sem_wait(&LOCK);
+	} else if (stop == 1) {
 		*val_ptr.HORZ_DIRaddr = 0;
-		sem_post(&LOCK);
 		//~ std::cout << "stopping horizontal motor (B)" << std::endl;
+		wd_beat(WD_MOTOR, "braking horizontal motor");
 		while (*val_ptr.DUTY_Baddr > 0) {
-			sem_wait(&LOCK);
 			*val_ptr.DUTY_Baddr = *val_ptr.DUTY_Baddr - 1;
-			sem_post(&LOCK);
 			softPwmWrite(BPINP, *val_ptr.DUTY_Baddr);
 			usleep(10);
 		}
@@ -103,10 +90,18 @@ void motor_handler() {
 		// When stopped, reset code
 		//~ val_ptr.STOP_DIRaddr = 0;
 	}
-	if (*val_ptr.STOP_DIRaddr > 0) {
-		sem_wait(&LOCK);
-		*val_ptr.STOP_DIRaddr = 0;
-		sem_post(&LOCK);
+	// Count moves opposite to the previous move of each motor
+	if (*val_ptr.VERT_DIRaddr > 0) {
+		if ((LAST_VERT_DIR > 0) && (*val_ptr.VERT_DIRaddr != LAST_VERT_DIR)) {
+			metric_add(METRICS.motor_reversals);
+		}
+		LAST_VERT_DIR = *val_ptr.VERT_DIRaddr;
+	}
+	if (*val_ptr.HORZ_DIRaddr > 0) {
+		if ((LAST_HORZ_DIR > 0) && (*val_ptr.HORZ_DIRaddr != LAST_HORZ_DIR)) {
+			metric_add(METRICS.motor_reversals);
+		}
+		LAST_HORZ_DIR = *val_ptr.HORZ_DIRaddr;
 	}
 	// Handle Vertical Motion
 	if (*val_ptr.VERT_DIRaddr > 0) {
@@ -117,19 +112,12 @@ void motor_handler() {
 			digitalWrite(APIN1, LOW);
 			digitalWrite(APIN2, HIGH);
 			if (*val_ptr.RUN_MODEaddr == 0) {
-				sem_wait(&LOCK);
 				*val_ptr.DUTY_Aaddr = DUTY;
-				sem_post(&LOCK);
 			} else {
 				speed_up(1);
 			}
 			if (*val_ptr.DUTY_Aaddr != OLD_DUTY_A) {
-				if (DEBUG_COUT) {
-					LOGGING.open(LOGOUT, std::ios_base::app);
-					LOGGING
-					<< "setting motor B duty cycle to: " << *val_ptr.DUTY_Aaddr << std::endl;
-					LOGGING.close();
-				}
+				LOG_TRACE("setting motor B duty cycle to: " << *val_ptr.DUTY_Aaddr);
 			}
 			softPwmWrite(APINP, *val_ptr.DUTY_Aaddr);
 		} else {
@@ -139,19 +127,12 @@ void motor_handler() {
 			digitalWrite(APIN1, HIGH);
 			digitalWrite(APIN2, LOW);
 			if (*val_ptr.RUN_MODEaddr == 0) {
-				sem_wait(&LOCK);
 				*val_ptr.DUTY_Aaddr = DUTY;
-				sem_post(&LOCK);
 			} else {
 				speed_up(1);
 			}
 			if (*val_ptr.DUTY_Aaddr != OLD_DUTY_A) {
-				if (DEBUG_COUT) {
-					LOGGING.open(LOGOUT, std::ios_base::app);
-					LOGGING
-					<< "setting motor B duty cycle to: " << *val_ptr.DUTY_Aaddr << std::endl;
-					LOGGING.close();
-				}
+				LOG_TRACE("setting motor B duty cycle to: " << *val_ptr.DUTY_Aaddr);
 			}
 			softPwmWrite(APINP, *val_ptr.DUTY_Aaddr);
 		}
@@ -165,54 +146,28 @@ void motor_handler() {
 			digitalWrite(BPIN1, LOW);
 			digitalWrite(BPIN2, HIGH);
 			if (*val_ptr.RUN_MODEaddr == 0) {
-				sem_wait(&LOCK);
 				*val_ptr.DUTY_Baddr = DUTY;
-				sem_post(&LOCK);
 			} else {
 				speed_up(2);
 			}
 			if ((*val_ptr.DUTY_Baddr != OLD_DUTY_B) && (OLD_DIR == 1)) {
-				if (DEBUG_COUT) {
-					LOGGING.open(LOGOUT, std::ios_base::app);
-					LOGGING
-					<< "setting motor B duty cycle to: " << *val_ptr.DUTY_Baddr << std::endl;
-					LOGGING.close();
-				}
+				LOG_TRACE("setting motor B duty cycle to: " << *val_ptr.DUTY_Baddr);
 			}
 			softPwmWrite(BPINP, *val_ptr.DUTY_Baddr);
 			if (OLD_DIR == 2) {
 				// Loose Wheel protocol
 				auto current_time = std::chrono::system_clock::now();
 				std::chrono::duration<double> elapsed_seconds = current_time-OLD_LOOSE_WHEEL_TIME;
-				sem_wait(&LOCK);
 				*val_ptr.DUTY_Baddr = DUTY;
-				sem_post(&LOCK);
-				if (elapsed_seconds > LOOSE_WHEEL_DURATION) {
-					sem_wait(&LOCK);
-					*val_ptr.DUTY_Baddr = MIN_DUTY;
-					sem_post(&LOCK);
-					if (DEBUG_COUT) {
-						LOGGING.open(LOGOUT, std::ios_base::app);
-						LOGGING
-						<< "Loose Wheel maneuver complete" << std::endl;
-						LOGGING.close();
-					}
+				if (elapsed_seconds > LOOSE_WHEEL_DURATION.load()) {
+					*val_ptr.DUTY_Baddr = MIN_DUTY.load();
+					LOG_TRACE("Loose Wheel maneuver complete");
 					OLD_DIR = 1;
 				} else {
-					if (DEBUG_COUT) {
-						LOGGING.open(LOGOUT, std::ios_base::app);
-						LOGGING
-						<< "running in Loose Wheel mode" << std::endl;
-						LOGGING.close();
-					}
+					LOG_TRACE("running in Loose Wheel mode");
 					OLD_DIR = 2;
 				}
-				if (DEBUG_COUT) {
-					LOGGING.open(LOGOUT, std::ios_base::app);
-					LOGGING
-					<< "setting motor B duty cycle to: " << *val_ptr.DUTY_Baddr << std::endl;
-					LOGGING.close();
-				}
+				LOG_TRACE("setting motor B duty cycle to: " << *val_ptr.DUTY_Baddr);
 			} else {
 				OLD_DIR = 1;
 				softPwmWrite(BPINP, *val_ptr.DUTY_Baddr);
@@ -224,50 +179,26 @@ void motor_handler() {
 			digitalWrite(BPIN1, HIGH);
 			digitalWrite(BPIN2, LOW);
 			if (*val_ptr.RUN_MODEaddr == 0) {
-				sem_wait(&LOCK);
 				*val_ptr.DUTY_Baddr = DUTY;
-				sem_post(&LOCK);
 			} else {
 				speed_up(2);
 			}
 			if ((*val_ptr.DUTY_Baddr != OLD_DUTY_B) && (OLD_DIR == 2)) {
-				if (DEBUG_COUT) {
-					LOGGING.open(LOGOUT, std::ios_base::app);
-					LOGGING
-					<< "setting motor B duty cycle to: " << *val_ptr.DUTY_Baddr << std::endl;
-					LOGGING.close();
-				}
+				LOG_TRACE("setting motor B duty cycle to: " << *val_ptr.DUTY_Baddr);
 			}
 			if (OLD_DIR == 1) {
 				auto current_time = std::chrono::system_clock::now();
 				std::chrono::duration<double> elapsed_seconds = current_time-OLD_LOOSE_WHEEL_TIME;
-				sem_wait(&LOCK);
 				*val_ptr.DUTY_Baddr = DUTY;
-				sem_post(&LOCK);
-				if (elapsed_seconds > LOOSE_WHEEL_DURATION) {
-					*val_ptr.DUTY_Baddr = MIN_DUTY;
-					if (DEBUG_COUT) {
-						LOGGING.open(LOGOUT, std::ios_base::app);
-						LOGGING
-						<< "Loose Wheel maneuver complete" << std::endl;
-						LOGGING.close();
-					}
+				if (elapsed_seconds > LOOSE_WHEEL_DURATION.load()) {
+					*val_ptr.DUTY_Baddr = MIN_DUTY.load();
+					LOG_TRACE("Loose Wheel maneuver complete");
 					OLD_DIR = 2;
 				} else {
-					if (DEBUG_COUT) {
-						LOGGING.open(LOGOUT, std::ios_base::app);
-						LOGGING
-						<< "running in Loose Wheel mode" << std::endl;
-						LOGGING.close();
-					}
+					LOG_TRACE("running in Loose Wheel mode");
 					OLD_DIR = 1;
 				}
-				if (DEBUG_COUT) {
-					LOGGING.open(LOGOUT, std::ios_base::app);
-					LOGGING
-					<< "setting motor B duty cycle to: " << *val_ptr.DUTY_Baddr << std::endl;
-					LOGGING.close();
-				}
+				LOG_TRACE("setting motor B duty cycle to: " << *val_ptr.DUTY_Baddr);
 				softPwmWrite(BPINP, *val_ptr.DUTY_Baddr);
 			} else {
 				OLD_DIR = 2;
@@ -275,6 +206,7 @@ void motor_handler() {
 			}
 		}
 	}
+	telem_motor();
 }
 
 /**
@@ -296,13 +228,9 @@ void speed_up(int motor) {
 		if (CNT_MOTOR_A == 2) {
 			CNT_MOTOR_A = 0;
 			if (*val_ptr.DUTY_Aaddr < MIN_DUTY) {
-				sem_wait(&LOCK);
-				*val_ptr.DUTY_Aaddr = MIN_DUTY;
-				sem_post(&LOCK);
+				*val_ptr.DUTY_Aaddr = MIN_DUTY.load();
 			} else if (*val_ptr.DUTY_Aaddr < MAX_DUTY) {
-				sem_wait(&LOCK);
 				*val_ptr.DUTY_Aaddr = *val_ptr.DUTY_Aaddr + 1;
-				sem_post(&LOCK);
 			}
 		} else {
 			CNT_MOTOR_A += 1;
@@ -311,13 +239,9 @@ void speed_up(int motor) {
 		if (CNT_MOTOR_B == 2) {
 			CNT_MOTOR_B = 0;
 			if (*val_ptr.DUTY_Baddr < MIN_DUTY) {
-				sem_wait(&LOCK);
-				*val_ptr.DUTY_Baddr = MIN_DUTY;
-				sem_post(&LOCK);
+				*val_ptr.DUTY_Baddr = MIN_DUTY.load();
 			} else if (*val_ptr.DUTY_Baddr < MAX_DUTY) {
-				sem_wait(&LOCK);
 				*val_ptr.DUTY_Baddr = *val_ptr.DUTY_Baddr + 1;
-				sem_post(&LOCK);
 			}
 		} else {
 			CNT_MOTOR_B += 1;
@@ -345,20 +269,10 @@ void gpio_pin_setup () {
 		// PWM pins go PWM, all else go HIGH
 		if ((i == 0) | (i == 5)) {
 			digitalWrite(pin_array[i], LOW);
-			if (DEBUG_COUT) {
-				LOGGING.open(LOGOUT, std::ios_base::app);
-				LOGGING
-				<< "Set pin " << pin_array[i] << " LOW" << std::endl;
-				LOGGING.close();
-			}
+			LOG_DEBUG("Set pin " << pin_array[i] << " LOW");
 		} else {
 			digitalWrite(pin_array[i], HIGH);
-			if (DEBUG_COUT) {
-				LOGGING.open(LOGOUT, std::ios_base::app);
-				LOGGING
-				<< "Set pin " << pin_array[i] << " HIGH" << std::endl;
-				LOGGING.close();
-			}
+			LOG_DEBUG("Set pin " << pin_array[i] << " HIGH");
 		}
 	}
 	// create soft PWM
@@ -372,12 +286,7 @@ void gpio_pin_setup () {
  *
  */
 void final_stop() {
-	if (DEBUG_COUT) {
-		LOGGING.open(LOGOUT, std::ios_base::app);
-		LOGGING
-		<< "stopping motors to end program" << std::endl;
-		LOGGING.close();
-	}
+	LOG_INFO("stopping motors to end program");
 	softPwmWrite(APINP, 0);
 	softPwmWrite(BPINP, 0);
 	digitalWrite(APIN1, LOW);
@@ -385,3 +294,23 @@ void final_stop() {
 	digitalWrite(BPIN1, LOW);
 	digitalWrite(BPIN2, LOW);
 }
+
+/**
+ * This function runs on the motor thread.  The GPIO pins are prepared, then motor commands are handled
+ * every MOTOR_CYCLE_US until the run is aborted, when the motors are stopped.
+ *
+ */
+void motor_loop() {
+	log_set_thread(2, 'M');
+	gpio_pin_setup();
+	startup_step("gpio setup", STARTUP_SPAWN);
+	while (*val_ptr.ABORTaddr == 0) {
+		wd_beat(WD_MOTOR, "motor handler");
+		uint64_t start = log_now();
+		motor_handler();
+		metric_time(METRICS.motor, start);
+		wd_progress(WD_MOTOR);
+		usleep(MOTOR_CYCLE_US);
+	}
+	final_stop();
+}
@@ -37,6 +37,10 @@
  * Duty cycle % range for motors
  */
 #define DUTY 100
+/**
+ * Microseconds between cycles of the motor thread.
+ */
+#define MOTOR_CYCLE_US 50000
 
 
 /**
@@ -67,15 +71,15 @@ inline int BPINP = 14;
 /**
  * Minimum allowable duty cycle.  Customizable from settings.cfg.
  */
-inline int MIN_DUTY = 20;
+inline std::atomic<int> MIN_DUTY = 20;
 /**
  * Maximumallowable duty cycle.  Customizable from settings.cfg.
  */
-inline int MAX_DUTY = 75;
+inline std::atomic<int> MAX_DUTY = 75;
 /**
  * Duty cycle threshold for braking during recording.  Customizable from settings.cfg.
  */
-inline int BRAKE_DUTY = 10;
+inline std::atomic<int> BRAKE_DUTY = 10;
 /**
  * PWM operation frequency in Hz.  Customizable from settings.cfg.
  */
@@ -83,12 +87,14 @@ inline int FREQ = 10000;
 /**
  * Number of seconds to perform a loose wheel maneuver.  This can be customized in settings.cfg.
  */
-inline std::chrono::duration<double> LOOSE_WHEEL_DURATION = (std::chrono::duration<double>)2.;
+inline std::atomic<std::chrono::duration<double>> LOOSE_WHEEL_DURATION{std::chrono::duration<double>(2.)};
 
 #ifndef DOXYGEN_SHOULD_SKIP_THIS
 
 // Global Variables - Not "private" but not necessary to define for Doxygen
 inline int OLD_DIR = 0;
+inline int LAST_VERT_DIR = 0;
+inline int LAST_HORZ_DIR = 0;
 inline int OLD_DUTY_A = 0;
 inline int OLD_DUTY_B = 0;
 inline int CNT_MOTOR_A = 0;
@@ -103,5 +109,6 @@ void motor_handler();
 void loose_wheel(int wheel_dir);
 void speed_up(int motor);
 void final_stop();
+void motor_loop();
 
 #endif
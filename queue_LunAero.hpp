@@ -0,0 +1,71 @@
+/*
+ * C_LunAero/queue_LunAero.hpp - Message queue between threads for LunAero_C
+ * Copyright (C) <2020>  <Wesley T. Honeycutt>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef QUEUE_LUNAERO_H
+#define QUEUE_LUNAERO_H
+
+// Standard C++ includes
+#include <chrono>          // provides C++ chrono
+#include <mutex>           // provides std::mutex
+#include <condition_variable> // provides std::condition_variable
+#include <deque>
+
+/**
+ * Queue of requests sent to a worker thread.  Any thread may push.  The worker sleeps in pop until a
+ * request arrives or the timeout passes, so it needs no polling loop of its own.
+ */
+template <typename T>
+class msg_queue {
+	public:
+		/**
+		 * This function adds a request to the back of the queue and wakes the worker.
+		 *
+		 * @param item request to send
+		 */
+		void push(T item) {
+			{
+				std::lock_guard <std::mutex> lock(mutex);
+				items.push_back(item);
+			}
+			cv.notify_one();
+		}
+
+		/**
+		 * This function takes the oldest request from the queue, waiting up to timeout for one to arrive.
+		 *
+		 * @param item receives the request
+		 * @param timeout longest time to wait
+		 * @return received true if item was filled, false if the wait timed out
+		 */
+		bool pop(T &item, std::chrono::milliseconds timeout) {
+			std::unique_lock <std::mutex> lock(mutex);
+			if (!cv.wait_for(lock, timeout, [this]{ return !items.empty(); })) {
+				return false;
+			}
+			item = items.front();
+			items.pop_front();
+			return true;
+		}
+
+	private:
+		std::mutex mutex;
+		std::condition_variable cv;
+		std::deque <T> items;
+};
+
+#endif
@@ -0,0 +1,665 @@
+/*
+ * C_LunAero/settings_LunAero.cpp - Settings registry functions for LunAero_C
+ * Copyright (C) <2020>  <Wesley T. Honeycutt>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "settings_LunAero.hpp"
+
+/*
+ * The settings registry.  Entries are written to the default settings file in this order.  To add a
+ * setting, declare its global in the module header and add one line here.
+ */
+static const setting_entry SETTINGS[] = {
+	{"DEBUG_COUT", SET_BOOL, &DEBUG_COUT, "true", 0, 1, false,
+		"General settings",
+		"Save log with debugging output (prints everything verbose)"},
+	{"LOG_LEVEL", SET_LOG_LEVEL, &LOG_THRESHOLD, "debug", LOG_LEVEL_TRACE, LOG_LEVEL_ERROR, true, NULL,
+		"Least severe messages saved to the log: trace, debug, info, warn, or error.  trace logs every frame\n"
+		"and motor tick and is left out of builds made with \"make release\"."},
+	{"TELEMETRY", SET_BOOL, &TELEMETRY, "true", 0, 1, false, NULL,
+		"Record frame results, motor commands, and camera events to telemetry.lat for lunaero-logdump"},
+	{"WATCHDOG_MS", SET_INT, &WATCHDOG_MS, "2000", 100, 60000, true, NULL,
+		"Milliseconds a worker thread (motor, camera, capture, analysis, or GUI) may stop responding before\n"
+		"the watchdog steps in.\n"
+		"A stalled motor thread ends the run with the motors stopped."},
+	{"METRICS_SOCKET", SET_STRING, &METRICS_SOCKET, "/tmp/lunaero-metrics.sock", 0, 0, false, NULL,
+		"Unix socket serving performance metrics in the Prometheus text format.  Read them with\n"
+		"curl --unix-socket /tmp/lunaero-metrics.sock http://localhost/metrics\n"
+		"Leave empty to not serve metrics."},
+	{"CONTROL_SOCKET", SET_STRING, &CONTROL_SOCKET, "/tmp/lunaero-control.sock", 0, 0, false, NULL,
+		"Unix socket taking commands from lunaero-ctl, for control over SSH or from scripts.\n"
+		"Leave empty to only allow control from the screen and keyboard."},
+	{"SHM_NAME", SET_STRING, &SHM_NAME, "/lunaero-frames", 0, 0, false, NULL,
+		"Shared memory name where other programs can read each analysed frame and its result, see\n"
+		"shm_format_LunAero.hpp.  Leave empty to not share frames."},
+	{"SHM_SLOTS", SET_INT, &SHM_SLOTS, "8", 2, 256, false, NULL,
+		"Number of frames kept in shared memory for other programs before the oldest is overwritten"},
+	{"RECORD_DURATION", SET_SECONDS, &RECORD_DURATION, "1800", 10, 86400, false, NULL,
+		"Duration to record video before starting a new one (in seconds)"},
+	{"DRIVE_NAME", SET_STRING, &DRIVE_NAME, "MOON1", 0, 0, false, NULL,
+		"The name given to your external storage drive for videos.  Give a comma separated list to spill\n"
+		"over onto the next drive when one fills, e.g. MOON1,MOON2.  Absolute paths are used as given."},
+	{"DISK_WARN_TIME", SET_INT, &DISK_WARN_TIME, "1800", 0, 86400, true, NULL,
+		"Warn when the drive is forecast to fill within this many seconds of recording"},
+	{"DISK_MIN_SEGMENT", SET_INT, &DISK_MIN_SEGMENT, "60", 1, 86400, false, NULL,
+		"Shortest final segment (in seconds) worth recording when the drive is nearly full"},
+	{"DISK_BENCH_MB", SET_INT, &DISK_BENCH_MB, "32", 0, 4096, false, NULL,
+		"Mebibytes written to each drive at startup to measure its speed.  Set to 0 to skip the test."},
+	{"DISK_BENCH_HEADROOM", SET_FLOAT, &DISK_BENCH_HEADROOM, "2.0", 1, 100, false, NULL,
+		"Drives must write faster than the bitrate.  Warn if they are not this many times faster."},
+	{"WRITER_BUFFERS", SET_INT, &WRITER_BUFFERS, "16", 2, 256, false, NULL,
+		"Number of 1 MiB buffers between raspivid and the drive.  More buffers ride out longer drive stalls."},
+	{"WRITER_SYNC_TIME", SET_INT, &WRITER_SYNC_TIME, "2", 1, 60, false, NULL,
+		"Longest time (in seconds) recorded video is held in memory before it is synced to the drive"},
+	{"SAVE_DEBUG_IMAGE", SET_BOOL, &SAVE_DEBUG_IMAGE, "false", 0, 1, true, NULL,
+		"Should LunAero save a screenshot from the raspivid output every cycle?\n"
+		"It will be saved to to /your/path/out.ppm"},
+
+	{"KV_QUIT", SET_STRING, &KV_QUIT, "q", 0, 0, true,
+		"Keybindings\n"
+		"If you want to use non-alphabetic keys, check to see what the key value is called before editing.",
+		"Keybinding for quit command"},
+	{"KV_RUN", SET_STRING, &KV_RUN, "Return", 0, 0, true, NULL,
+		"Keybinding for beginning the recording/entering automatic mode"},
+	{"KV_LEFT", SET_STRING, &KV_LEFT, "Left", 0, 0, true, NULL,
+		"Keybinding for left manual motor movement."},
+	{"KV_RIGHT", SET_STRING, &KV_RIGHT, "Right", 0, 0, true, NULL,
+		"Keybinding for right manual motor movement."},
+	{"KV_UP", SET_STRING, &KV_UP, "Up", 0, 0, true, NULL,
+		"Keybinding for up manual motor movement."},
+	{"KV_DOWN", SET_STRING, &KV_DOWN, "Down", 0, 0, true, NULL,
+		"Keybinding for down manual motor movement."},
+	{"KV_STOP", SET_STRING, &KV_STOP, "space", 0, 0, true, NULL,
+		"Keybinding for motor stop command."},
+	{"KV_REFRESH", SET_STRING, &KV_REFRESH, "z", 0, 0, true, NULL,
+		"Keybinding for raspivid refresh command."},
+	{"KV_S_UP_UP", SET_STRING, &KV_S_UP_UP, "g", 0, 0, true, NULL,
+		"Keybinding for greatly increasing the shutter speed."},
+	{"KV_S_DOWN_DOWN", SET_STRING, &KV_S_DOWN_DOWN, "b", 0, 0, true, NULL,
+		"Keybinding for greatly decreasing the shutter speed."},
+	{"KV_S_UP", SET_STRING, &KV_S_UP, "h", 0, 0, true, NULL,
+		"Keybinding for increasing the shutter speed."},
+	{"KV_S_DOWN", SET_STRING, &KV_S_DOWN, "n", 0, 0, true, NULL,
+		"Keybinding for decreasing the shutter speed."},
+	{"KV_ISO", SET_STRING, &KV_ISO, "i", 0, 0, true, NULL,
+		"Keybinding for cycling the ISO value."},
+
+	{"FONT_MOD", SET_INT, &FONT_MOD, "20", 1, 100, false,
+		"GUI settings",
+		"Modifier value which effects the font size automatically determined for the GTK window"},
+	{"EMG_DUR", SET_INT, &EMG_DUR, "10", 0, 600000, false, NULL,
+		"Number of milliseconds an emergency message should remain on the desktop before disappearing in the\n"
+		"event of certain crash conditions."},
+
+	{"EDGE_DIVISOR_W", SET_INT, &EDGE_DIVISOR_W, "20", 1, 1000, true,
+		"Image processing settings",
+		"Divisor for the number pixels on the top and bottom edges to warrant a move.  Bigger is more sensitive."},
+	{"EDGE_DIVISOR_H", SET_INT, &EDGE_DIVISOR_H, "20", 1, 1000, true, NULL,
+		"Divisor for the number pixels on the left and right edges to warrant a move.  Bigger is more sensitive."},
+	{"RAW_BRIGHT_THRESH", SET_INT, &RAW_BRIGHT_THRESH, "240", 0, 255, true, NULL,
+		"Brightness value between 0-255 to act as the threshold for raw brightness tests.  Auto exposure counts\n"
+		"moon pixels this bright as clipped."},
+	{"BRIGHT_THRESH", SET_FLOAT, &BRIGHT_THRESH, "0.001", 0, 1, true, NULL,
+		"Threshold for the brightness tests.  Images scoring above this are too bright to see birds against\n"
+		"the lunar albedo.  Auto exposure shortens the exposure when more of the moon than this is clipped."},
+	{"FRAMECHECK_FREQ", SET_INT, &FRAMECHECK_FREQ, "50", 1, 10000, false, NULL,
+		"Milliseconds between the screenshots checked for moon centering while recording.  If a screenshot\n"
+		"takes longer, the ticks it covered are skipped and counted rather than caught up on.\n"
+		"WARNING Editing this value changes a bunch of behaviors.  You can touch it, but be careful."},
+	{"THRESH_AUTO", SET_BOOL, &THRESH_AUTO, "true", 0, 1, true, NULL,
+		"Find the brightness which separates the moon from the sky from each frame, so haze, a bright\n"
+		"twilight sky, or a thin crescent need no retuning.  If false, MOON_THRESH is always used."},
+	{"MOON_THRESH", SET_INT, &MOON_THRESH, "25", 0, 254, true, NULL,
+		"Brightness value between 0-255 above which a pixel is part of the moon.  Used when THRESH_AUTO is\n"
+		"false, and as the starting point of each recording otherwise."},
+	{"THRESH_MIN", SET_INT, &THRESH_MIN, "10", 0, 254, true, NULL,
+		"Lowest brightness the automatic threshold may choose, so noise in a dark sky is not taken for the moon."},
+	{"THRESH_SMOOTHING", SET_FLOAT, &THRESH_SMOOTHING, "0.2", 0.01, 1, true, NULL,
+		"Weight of each new frame in the automatic threshold, between 0 and 1.  Smaller is steadier."},
+	{"THRESH_HYSTERESIS", SET_INT, &THRESH_HYSTERESIS, "4", 0, 255, true, NULL,
+		"Brightness levels the automatic threshold must drift by before it is changed."},
+	{"LIMB_FIT", SET_BOOL, &LIMB_FIT, "true", 0, 1, true, NULL,
+		"Centre on a circle fitted to the edge of the moon instead of the middle of its bright pixels, so a\n"
+		"crescent or a moon cut off by the frame edge is still centred on the whole disk."},
+	{"BLOB_FILTER", SET_BOOL, &BLOB_FILTER, "true", 0, 1, true, NULL,
+		"Track only the largest and roundest patch of bright pixels, so streetlights, aircraft, stars, and hot\n"
+		"pixels in the frame do not pull the tracker.  If false, every bright pixel counts."},
+	{"BLOB_MIN_AREA", SET_INT, &BLOB_MIN_AREA, "20", 1, 100000, true, NULL,
+		"Smallest patch of bright pixels which may be the moon, in pixels.  Used when BLOB_FILTER is true."},
+	{"TRACK_WINDOW", SET_BOOL, &TRACK_WINDOW, "true", 0, 1, true, NULL,
+		"Once the moon is found, only check a window around it in the next frame, which is much faster than\n"
+		"checking the whole preview.  The whole preview is still checked when the moon is not in the window."},
+	{"TRACK_MARGIN", SET_INT, &TRACK_MARGIN, "24", 1, 1000, true, NULL,
+		"Pixels between the moon and the border of the tracking window.  Raise it if the moon often moves\n"
+		"out of the window between frames."},
+	{"FRAME_STALE_MS", SET_INT, &FRAME_STALE_MS, "250", 1, 60000, true, NULL,
+		"Milliseconds from a screenshot after which it is too old to move the motors on.  Older frames stop\n"
+		"the motors until a fresh one arrives, so a busy processor cannot make the tracker chase old frames."},
+
+	{"MMAL_ERROR_THRESH", SET_INT, &MMAL_ERROR_THRESH, "100", 1, 100000, false,
+		"Raspivid and Camera settings",
+		"Number of MMAL errors encountered in a row before LunAero should crash with an error because something\n"
+		"has gone wrong with the hardware."},
+	{"RPI_FPS", SET_INT, &RPI_FPS, "30", 1, 90, false, NULL,
+		"Recording framerate of the raspivid command"},
+	{"RPI_BR", SET_INT, &RPI_BR, "8000000", 100000, 25000000, false, NULL,
+		"Recording bitrate for raspivid command"},
+	{"RPI_EX", SET_STRING, &RPI_EX, "auto", 0, 0, false, NULL,
+		"Recording exposure mode for raspivid command.  Use a string from this list:\n"
+		"auto: use automatic exposure mode\n"
+		"night: select setting for night shooting\n"
+		"nightpreview:\n"
+		"backlight: select setting for backlit subject\n"
+		"spotlight:\n"
+		"sports: select setting for sports (fast shutter etc.)\n"
+		"snow: select setting optimised for snowy scenery\n"
+		"beach: select setting optimised for beach\n"
+		"verylong: select setting for long exposures\n"
+		"fixedfps: constrain fps to a fixed value\n"
+		"antishake: antishake mode\n"
+		"fireworks: select setting optimised for fireworks"},
+	{"SHUT_JUMP", SET_INT, &SHUT_JUMP, "100", 1, 1000000, true, NULL,
+		"Value to adjust the shutter speed when using up or down buttons."},
+	{"SHUT_JUMP_BIG", SET_INT, &SHUT_JUMP_BIG, "1000", 1, 1000000, true, NULL,
+		"Value to adjust the shutter speed when using the up-up or down-down buttons.\n"
+		"Should be greater than SHUT_JUMP"},
+	{"LOST_THRESH", SET_INT, &LOST_THRESH, "30", 1, 100000, true, NULL,
+		"Threshold value for number of cycles the moon is \"lost\" for"},
+
+	{"AUTO_EXPOSURE", SET_BOOL, &AUTO_EXPOSURE, "true", 0, 1, true,
+		"Auto exposure settings",
+		"Adjust the shutter and ISO at each new video segment so the moon is not saturated.  The values set\n"
+		"in preview are used for the first segment."},
+	{"AE_TARGET", SET_INT, &AE_TARGET, "200", 26, 254, true, NULL,
+		"Brightness value between 0-255 the brightest part of the moon is steered to."},
+	{"AE_SHUTTER_MIN", SET_INT, &AE_SHUTTER_MIN, "10", 10, 33000, true, NULL,
+		"Shortest shutter speed in microseconds auto exposure may choose."},
+	{"AE_SHUTTER_MAX", SET_INT, &AE_SHUTTER_MAX, "33000", 10, 33000, true, NULL,
+		"Longest shutter speed in microseconds auto exposure may choose.  Lower it to limit motion blur of\n"
+		"birds."},
+	{"AE_ISO_MIN", SET_INT, &AE_ISO_MIN, "100", 100, 800, true, NULL,
+		"Lowest ISO auto exposure may choose.  One of 100, 200, 400, or 800."},
+	{"AE_ISO_MAX", SET_INT, &AE_ISO_MAX, "800", 100, 800, true, NULL,
+		"Highest ISO auto exposure may choose.  One of 100, 200, 400, or 800."},
+
+	{"LOOSE_WHEEL_DURATION", SET_SECONDS, &LOOSE_WHEEL_DURATION, "2", 0, 60, true,
+		"Motor and Speed settings",
+		"Number of seconds the left-right motor should force high speed movement to compensate for loose\n"
+		"laser cut gears."},
+	{"FREQ", SET_INT, &FREQ, "10000", 1, 100000, false, NULL,
+		"PWM operation frequency in Hz"},
+	{"MIN_DUTY", SET_INT, &MIN_DUTY, "20", 0, 100, true, NULL,
+		"Minimum allowable PWM duty cycle. Must be integer. Units are percent.\n"
+		"This value does not impact the speed during manual mode."},
+	{"MAX_DUTY", SET_INT, &MAX_DUTY, "75", 0, 100, true, NULL,
+		"Maximum allowable PWM duty cycle.  Must be integer.  Units are percent.\n"
+		"This value does not impact the speed during manual mode."},
+	{"BRAKE_DUTY", SET_INT, &BRAKE_DUTY, "10", 0, 100, true, NULL,
+		"Duty cycle threshold for slower braking of motors during the run.  Must be integer.  Units are percent.\n"
+		"This value does not impact braking during manual mode"},
+
+	{"APINP", SET_INT, &APINP, "0", 0, 31, false,
+		"Rasperry Pi GPIO Pin setup",
+		"Raspberry Pi GPIO pin for motor A Soft PWM.  BCM equivalent of 0 = 17"},
+	{"APIN1", SET_INT, &APIN1, "2", 0, 31, false, NULL,
+		"Raspberry Pi GPIO pin for motor A 1 pin.  BCM equivalent of 2 = 27"},
+	{"APIN2", SET_INT, &APIN2, "3", 0, 31, false, NULL,
+		"Raspberry Pi GPIO pin for motor A 2 pin.  BCM equivalent of 3 = 22"},
+	{"BPIN1", SET_INT, &BPIN1, "12", 0, 31, false, NULL,
+		"Raspberry Pi GPIO pin for motor B 1 pin.  BCM equivalent of 12 = 10"},
+	{"BPIN2", SET_INT, &BPIN2, "13", 0, 31, false, NULL,
+		"Raspberry Pi GPIO pin for motor B 2 pin.  BCM equivalent of 13 = 9"},
+	{"BPINP", SET_INT, &BPINP, "14", 0, 31, false, NULL,
+		"Raspberry Pi GPIO pin for motor A Soft PWM.  BCM equivalent of 14 = 11"},
+};
+
+/*
+ * Names of the log levels, indexed by LOG_LEVEL value.
+ */
+static const char *SETTINGS_LEVELS[] = {"trace", "debug", "info", "warn", "error"};
+
+/**
+ * This function looks up a setting in the registry by name.
+ *
+ * @param name name of the setting as written in settings.cfg
+ * @return entry pointer to the registry entry, or NULL if there is no such setting
+ */
+const setting_entry *settings_find(std::string name) {
+	for (const setting_entry &entry : SETTINGS) {
+		if (name == entry.name) {
+			return &entry;
+		}
+	}
+	return NULL;
+}
+
+/**
+ * This function converts the text of a setting to a value of the type given by its registry entry and
+ * checks it against the allowed range.  Nothing is assigned, so a value can be checked before it is used.
+ *
+ * @param entry registry entry of the setting
+ * @param value text of the value from settings.cfg
+ * @param result receives the parsed value
+ * @return status 0 if valid, 1 if the text is not a value of the right type, 2 if it is out of range
+ */
+int setting_parse(const setting_entry *entry, std::string value, setting_value &result) {
+	result.number = 0.;
+	result.text = value;
+	if (entry->type == SET_STRING) {
+		return 0;
+	} else if (entry->type == SET_BOOL) {
+		if (value == "true" || value == "True" || value == "TRUE") {
+			result.number = 1.;
+		} else if (value == "false" || value == "False" || value == "FALSE") {
+			result.number = 0.;
+		} else {
+			return 1;
+		}
+		return 0;
+	} else if (entry->type == SET_LOG_LEVEL) {
+		result.number = log_parse_level(value);
+		if (result.number < 0) {
+			return 1;
+		}
+		return 0;
+	}
+
+	size_t used = 0;
+	try {
+		if (entry->type == SET_INT) {
+			result.number = std::stoi(value, &used);
+		} else {
+			result.number = std::stod(value, &used);
+		}
+	} catch (const std::exception &e) {
+		return 1;
+	}
+	if (used != value.size()) {
+		return 1;
+	}
+	if (result.number < entry->min || result.number > entry->max) {
+		return 2;
+	}
+	return 0;
+}
+
+/**
+ * This function assigns a parsed value to the global variable of a setting.  Hot settings other than
+ * strings are read by the camera, motor, and analysis threads while the GUI thread reloads them, so
+ * their globals are atomic.
+ *
+ * @param entry registry entry of the setting
+ * @param value value returned by setting_parse
+ */
+void setting_store(const setting_entry *entry, const setting_value &value) {
+	std::chrono::duration<double> seconds = (std::chrono::duration<double>) value.number;
+	switch (entry->type) {
+		case SET_BOOL:
+			if (entry->hot) {
+				((std::atomic<bool> *)entry->target)->store(value.number != 0., std::memory_order_relaxed);
+			} else {
+				*(bool *)entry->target = (value.number != 0.);
+			}
+			break;
+		case SET_INT:
+		case SET_LOG_LEVEL:
+			if (entry->hot) {
+				((std::atomic<int> *)entry->target)->store((int)value.number, std::memory_order_relaxed);
+			} else {
+				*(int *)entry->target = (int)value.number;
+			}
+			break;
+		case SET_FLOAT:
+			if (entry->hot) {
+				((std::atomic<float> *)entry->target)->store((float)value.number, std::memory_order_relaxed);
+			} else {
+				*(float *)entry->target = (float)value.number;
+			}
+			break;
+		case SET_SECONDS:
+			if (entry->hot) {
+				((std::atomic<std::chrono::duration<double>> *)entry->target)->store(seconds,
+					std::memory_order_relaxed);
+			} else {
+				*(std::chrono::duration<double> *)entry->target = seconds;
+			}
+			break;
+		case SET_STRING:
+			*(std::string *)entry->target = value.text;
+			break;
+	}
+}
+
+/**
+ * This function reads the current value of a numeric setting, whether or not its global is atomic.
+ *
+ * @param entry registry entry of the setting
+ * @return number current value, with true as 1
+ */
+double setting_number(const setting_entry *entry) {
+	switch (entry->type) {
+		case SET_BOOL:
+			return entry->hot ? ((std::atomic<bool> *)entry->target)->load(std::memory_order_relaxed)
+				: *(bool *)entry->target;
+		case SET_INT:
+		case SET_LOG_LEVEL:
+			return entry->hot ? ((std::atomic<int> *)entry->target)->load(std::memory_order_relaxed)
+				: *(int *)entry->target;
+		case SET_FLOAT:
+			return entry->hot ? ((std::atomic<float> *)entry->target)->load(std::memory_order_relaxed)
+				: *(float *)entry->target;
+		case SET_SECONDS:
+			return entry->hot ? ((std::atomic<std::chrono::duration<double>> *)entry->target)->load(
+				std::memory_order_relaxed).count() : ((std::chrono::duration<double> *)entry->target)->count();
+		case SET_STRING:
+			break;
+	}
+	return 0.;
+}
+
+/**
+ * This function checks if a parsed value is the same as the one the setting already holds.
+ *
+ * @param entry registry entry of the setting
+ * @param value value returned by setting_parse
+ * @return equal true if storing the value would change nothing
+ */
+bool setting_equal(const setting_entry *entry, const setting_value &value) {
+	switch (entry->type) {
+		case SET_BOOL:
+			return (setting_number(entry) != 0.) == (value.number != 0.);
+		case SET_INT:
+		case SET_LOG_LEVEL:
+			return (int)setting_number(entry) == (int)value.number;
+		case SET_FLOAT:
+			return (float)setting_number(entry) == (float)value.number;
+		case SET_SECONDS:
+			return setting_number(entry) == value.number;
+		case SET_STRING:
+			return *(std::string *)entry->target == value.text;
+	}
+	return false;
+}
+
+/**
+ * This function formats the current value of a setting as it would be written in settings.cfg.
+ *
+ * @param entry registry entry of the setting
+ * @return text current value
+ */
+std::string setting_string(const setting_entry *entry) {
+	std::ostringstream text;
+	switch (entry->type) {
+		case SET_BOOL:
+			text << ((setting_number(entry) != 0.) ? "true" : "false");
+			break;
+		case SET_INT:
+			text << (int)setting_number(entry);
+			break;
+		case SET_LOG_LEVEL:
+			text << SETTINGS_LEVELS[(int)setting_number(entry)];
+			break;
+		case SET_FLOAT:
+			text << (float)setting_number(entry);
+			break;
+		case SET_SECONDS:
+			text << setting_number(entry);
+			break;
+		case SET_STRING:
+			text << *(std::string *)entry->target;
+			break;
+	}
+	return text.str();
+}
+
+/**
+ * This function reads the name and value pairs from a settings file.  Whitespace is removed, and lines
+ * which are empty or start with an octothorpe are skipped.
+ *
+ * @param path path of the settings file
+ * @param pairs receives the name and value of each setting line in file order
+ * @return status 0 if the file was read
+ */
+int settings_read(std::string path, vector <std::pair <std::string, std::string>> &pairs) {
+	std::ifstream cFile (path);
+	if (!cFile.is_open()) {
+		return 1;
+	}
+	std::string line;
+	while (getline(cFile, line)) {
+		line.erase(std::remove_if(line.begin(), line.end(), isspace), line.end());
+		if (line.empty() || line[0] == '#') {
+			continue;
+		}
+		auto delimiter_pos = line.find("=");
+		if (delimiter_pos == std::string::npos) {
+			pairs.push_back(std::make_pair(line, std::string("")));
+		} else {
+			pairs.push_back(std::make_pair(line.substr(0, delimiter_pos), line.substr(delimiter_pos + 1)));
+		}
+	}
+	return 0;
+}
+
+/**
+ * This function assigns the registry default to every setting, so settings missing from an older
+ * settings.cfg behave the same as in a freshly written one.
+ */
+void settings_defaults() {
+	for (const setting_entry &entry : SETTINGS) {
+		setting_value value;
+		if (setting_parse(&entry, entry.def, value) == 0) {
+			setting_store(&entry, value);
+		}
+	}
+}
+
+/**
+ * This function loads every setting from a settings file on top of the registry defaults.
+ *
+ * @param path path of the settings file
+ * @return status 0 if every setting in the file was valid
+ */
+int settings_load(std::string path) {
+	settings_defaults();
+	vector <std::pair <std::string, std::string>> pairs;
+	if (settings_read(path, pairs)) {
+		notify_handler("LunAero Error", "Couldn't open config file for reading.");
+		return 1;
+	}
+	for (unsigned int i=0; i<pairs.size(); i++) {
+		if (parse_checklist(pairs[i].first, pairs[i].second)) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/**
+ * This function handles the strings and values parsed from the settings.cfg file and assigns them
+ * to the global values.
+ *
+ * @param name String obtained while parsing the settings.cfg file
+ * @param value The value associated with name from settings.cfg file
+ * @return status
+ */
+int parse_checklist(std::string name, std::string value) {
+	const setting_entry *entry = settings_find(name);
+	if (entry == NULL) {
+		std::cerr << "Did not recognize entry " << name << " in config file, skipping" << std::endl;
+		return 0;
+	}
+	setting_value result;
+	int status = setting_parse(entry, value, result);
+	if (status == 1) {
+		std::cerr << "Invalid value in settings.cfg item: " << name << std::endl;
+		return 1;
+	} else if (status == 2) {
+		std::cerr << "Value out of range (" << entry->min << " to " << entry->max
+			<< ") in settings.cfg item: " << name << std::endl;
+		return 1;
+	}
+	setting_store(entry, result);
+	return 0;
+}
+
+/**
+ * This function is called to create a default settings config file.  Creates the file in the current
+ * working directory as ./settings.cfg.  Every entry of the registry is written with its section heading,
+ * comment, and default value, and entries which reload while running are marked as such.  If the file
+ * at that path after writing is smaller than 2kb, this function returns an error status.
+ *
+ * @return status
+ */
+int create_default_config() {
+	std::string config_loc = SETTINGS_PATH;
+	std::ofstream config_file;
+	config_file.open(config_loc);
+	config_file
+	<< "############# settings #############" << std::endl
+	<< "#                                  #" << std::endl
+	<< "#         part of LunAero_C        #" << std::endl
+	<< "#     Wesley T. Honeycutt, 2020    #" << std::endl
+	<< "#                                  #" << std::endl
+	<< "#   Comment lines with octothorpe  #" << std::endl
+	<< "# Code lines must be \\n terminated #" << std::endl
+	<< "#                                  #" << std::endl
+	<< "####################################" << std::endl << std::endl;
+
+	for (const setting_entry &entry : SETTINGS) {
+		std::string line;
+		if (entry.section != NULL) {
+			std::istringstream section(entry.section);
+			if (&entry != SETTINGS) {
+				config_file << std::endl << std::endl << std::endl;
+			}
+			std::getline(section, line);
+			config_file << "### " << line << std::endl;
+			while (std::getline(section, line)) {
+				config_file << "# " << line << std::endl;
+			}
+			config_file << std::endl;
+		}
+		std::istringstream comment(entry.comment);
+		while (std::getline(comment, line)) {
+			config_file << "# " << line << std::endl;
+		}
+		if (entry.hot) {
+			config_file << "# Takes effect when this file is saved, no restart needed." << std::endl;
+		}
+		config_file << entry.name << " = " << entry.def << std::endl << std::endl;
+	}
+
+	config_file.close();
+
+	if (std::filesystem::file_size(config_loc) < 2000) {
+		return 1;
+	} else {
+		return 0;
+	}
+}
+
+/**
+ * This function starts watching the settings file for changes.  It is called once from main, and the
+ * watch is polled by the GUI thread.  Every thread shares the same settings, so one reload is enough.
+ *
+ * @return status 0 if the watch was added
+ */
+int settings_watch() {
+	if (SETTINGS_FD >= 0) {
+		close(SETTINGS_FD);
+	}
+	SETTINGS_FD = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (SETTINGS_FD < 0) {
+		LOG_WARN("WARNING: could not watch settings.cfg, changes need a restart");
+		return 1;
+	}
+	if (inotify_add_watch(SETTINGS_FD, SETTINGS_DIR, IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+		LOG_WARN("WARNING: could not watch settings.cfg, changes need a restart");
+		close(SETTINGS_FD);
+		SETTINGS_FD = -1;
+		return 1;
+	}
+	return 0;
+}
+
+/**
+ * This function rereads settings.cfg while LunAero is running.  Settings marked hot in the registry are
+ * applied if they are valid.  Invalid values keep the old setting, and changes to other settings are
+ * reported once as needing a restart.
+ *
+ * @return status 0 if the file was read
+ */
+int settings_reload() {
+	static std::map <std::string, std::string> reported;
+	vector <std::pair <std::string, std::string>> pairs;
+	if (settings_read(SETTINGS_PATH, pairs)) {
+		LOG_WARN("WARNING: could not reread settings.cfg");
+		return 1;
+	}
+	for (unsigned int i=0; i<pairs.size(); i++) {
+		const setting_entry *entry = settings_find(pairs[i].first);
+		if (entry == NULL) {
+			continue;
+		}
+		setting_value result;
+		int status = setting_parse(entry, pairs[i].second, result);
+		if (status != 0) {
+			if (reported[entry->name] != pairs[i].second) {
+				reported[entry->name] = pairs[i].second;
+				LOG_WARN("WARNING: ignoring invalid settings.cfg value " << entry->name << " = " << pairs[i].second);
+			}
+			continue;
+		}
+		if (setting_equal(entry, result)) {
+			continue;
+		}
+		if (entry->hot) {
+			std::string old = setting_string(entry);
+			setting_store(entry, result);
+			LOG_INFO("settings: " << entry->name << " " << old << " -> " << setting_string(entry));
+		} else if (reported[entry->name] != pairs[i].second) {
+			reported[entry->name] = pairs[i].second;
+			LOG_WARN("WARNING: restart LunAero to apply " << entry->name << " = " << pairs[i].second);
+		}
+	}
+	return 0;
+}
+
+/**
+ * This function checks for changes to settings.cfg without blocking and reloads it if it was saved.
+ * It is called from the GUI thread.  Several events from one save cause a single reload.
+ */
+void settings_poll() {
+	if (SETTINGS_FD < 0) {
+		return;
+	}
+	alignas(struct inotify_event) char buffer[4096];
+	bool changed = false;
+	ssize_t len;
+	while ((len = read(SETTINGS_FD, buffer, sizeof(buffer))) > 0) {
+		for (char *ptr = buffer; ptr < buffer + len; ) {
+			struct inotify_event *event = (struct inotify_event *)ptr;
+			if (event->len > 0 && strcmp(event->name, SETTINGS_NAME) == 0) {
+				changed = true;
+			}
+			ptr += sizeof(struct inotify_event) + event->len;
+		}
+	}
+	if (changed) {
+		settings_reload();
+	}
+}
@@ -0,0 +1,142 @@
+/*
+ * C_LunAero/settings_LunAero.hpp - Settings registry headers for LunAero_C
+ * Copyright (C) <2020>  <Wesley T. Honeycutt>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SETTINGS_LUNAERO_H
+#define SETTINGS_LUNAERO_H
+
+// Standard C++ includes
+#include <string>
+#include <iostream>
+#include <fstream>
+#include <sstream>         // provides ostringstream
+#include <map>
+#include <cstring>         // provides strcmp
+
+// Module specific includes
+#include <sys/inotify.h>   // provides inotify
+#include <unistd.h>        // provides read
+
+// User Includes
+#include "LunAero.hpp"
+
+// Global Defined Constants
+/**
+ * Path of the settings file, relative to the working directory.
+ */
+#define SETTINGS_PATH "./settings.cfg"
+/**
+ * Directory watched for changes to the settings file.  The directory is watched rather than the file
+ * because most editors save by writing a new file and renaming it over the old one.
+ */
+#define SETTINGS_DIR "."
+/**
+ * Name of the settings file inside SETTINGS_DIR, as reported by inotify.
+ */
+#define SETTINGS_NAME "settings.cfg"
+
+/**
+ * Types of value held by a setting.  SET_SECONDS is a std::chrono::duration<double> given in seconds and
+ * SET_LOG_LEVEL is an int holding one of the LOG_LEVEL values, given by name.
+ */
+enum setting_type {
+	SET_BOOL,
+	SET_INT,
+	SET_FLOAT,
+	SET_SECONDS,
+	SET_STRING,
+	SET_LOG_LEVEL
+};
+
+/**
+ * One entry of the settings registry.  The registry is the only list of settings.  parse_checklist and
+ * create_default_config are both driven by it.
+ */
+struct setting_entry {
+	/**
+	 * Name of the setting in settings.cfg.
+	 */
+	const char *name;
+	/**
+	 * Type of the target variable.
+	 */
+	setting_type type;
+	/**
+	 * Global variable which receives the value.
+	 */
+	void *target;
+	/**
+	 * Default value, written as it would appear in settings.cfg.
+	 */
+	const char *def;
+	/**
+	 * Smallest value accepted for numeric settings.
+	 */
+	double min;
+	/**
+	 * Largest value accepted for numeric settings.
+	 */
+	double max;
+	/**
+	 * Set if the setting may be changed while LunAero is running.  Only values which are read fresh on
+	 * every cycle, and which cannot leave the hardware in a bad state, are marked.  The target of a hot
+	 * setting must be a std::atomic of its type, except for strings, which only the GUI thread reads.
+	 */
+	bool hot;
+	/**
+	 * Heading written before this entry in the default settings file, or NULL to continue the section.
+	 */
+	const char *section;
+	/**
+	 * Comment written above the entry in the default settings file.  May span several lines.
+	 */
+	const char *comment;
+};
+
+/**
+ * A parsed but not yet assigned setting value.  Numeric, boolean, and log level values are held in
+ * number, strings in text.
+ */
+struct setting_value {
+	double number;
+	std::string text;
+};
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+
+// Global Variables - Not "private" but not necessary to define for Doxygen
+inline int SETTINGS_FD = -1;
+
+#endif /* DOXYGEN_SHOULD_SKIP_THIS */
+
+// Function Prototypes
+const setting_entry *settings_find(std::string name);
+int setting_parse(const setting_entry *entry, std::string value, setting_value &result);
+void setting_store(const setting_entry *entry, const setting_value &value);
+double setting_number(const setting_entry *entry);
+bool setting_equal(const setting_entry *entry, const setting_value &value);
+std::string setting_string(const setting_entry *entry);
+int settings_read(std::string path, vector <std::pair <std::string, std::string>> &pairs);
+void settings_defaults();
+int settings_load(std::string path);
+int parse_checklist(std::string name, std::string value);
+int create_default_config();
+int settings_watch();
+int settings_reload();
+void settings_poll();
+
+#endif
@@ -0,0 +1,159 @@
+/*
+ * C_LunAero/shm_LunAero.cpp - Shared memory frame ring for LunAero_C
+ * Copyright (C) <2020>  <Wesley T. Honeycutt>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "shm_LunAero.hpp"
+
+/**
+ * This function creates the shared memory frame ring, replacing any left by an earlier run.  It is
+ * called once the size of the preview window is known.  If the ring cannot be created, frames are
+ * simply not published.
+ *
+ * @param max_width largest region of interest width
+ * @param max_height largest region of interest height
+ * @return status 0 if the ring was created or SHM_NAME is empty
+ */
+int shm_init(int max_width, int max_height) {
+	if (SHM_NAME.empty() || (max_width <= 0) || (max_height <= 0)) {
+		return 0;
+	}
+	uint32_t slot_bytes = shm_slot_bytes(max_width, max_height);
+	size_t size = sizeof(shm_header) + ((size_t)SHM_SLOTS * slot_bytes);
+	
+	shm_unlink(SHM_NAME.c_str());
+	int fd = shm_open(SHM_NAME.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+	if (fd < 0) {
+		LOG_WARN("WARNING: could not create the frame ring " << SHM_NAME << ", frames are not shared");
+		return 1;
+	}
+	if (ftruncate(fd, size) != 0) {
+		LOG_WARN("WARNING: could not size the frame ring " << SHM_NAME << ", frames are not shared");
+		close(fd);
+		shm_unlink(SHM_NAME.c_str());
+		return 1;
+	}
+	void *mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (mem == MAP_FAILED) {
+		LOG_WARN("WARNING: could not map the frame ring " << SHM_NAME << ", frames are not shared");
+		shm_unlink(SHM_NAME.c_str());
+		return 1;
+	}
+	SHM_BASE = (unsigned char *)mem;
+	SHM_SIZE = size;
+	SHM_FRAME = 0;
+	
+	// ftruncate filled the ring with zeros, so every slot already reads as empty
+	shm_header *header = new (SHM_BASE) shm_header;
+	header->version = SHM_VERSION;
+	header->slots = SHM_SLOTS;
+	header->slot_bytes = slot_bytes;
+	header->max_width = max_width;
+	header->max_height = max_height;
+	header->pid = getpid();
+	header->published.store(0, std::memory_order_relaxed);
+	for (int i=0; i<SHM_SLOTS; i++) {
+		new (SHM_BASE + sizeof(shm_header) + ((size_t)i * slot_bytes)) shm_slot;
+	}
+	// Readers check the magic, so write it last
+	std::atomic_thread_fence(std::memory_order_release);
+	memcpy(header->magic, SHM_MAGIC, 4);
+	
+	LOG_INFO("sharing frames in " << SHM_NAME << ", " << SHM_SLOTS << " slots of " << slot_bytes << " bytes");
+	return 0;
+}
+
+/**
+ * This function claims the slot for the next frame.  The slot is marked as being written, so readers
+ * still holding the frame it replaces see that it is gone.  The caller fills the returned buffer with
+ * the grey region of interest and then calls shm_publish.  If the frame is abandoned before it is
+ * published, the next call reuses the same slot.
+ *
+ * @param width width of the region of interest
+ * @param height height of the region of interest
+ * @param time_ns log_now when the frame was captured
+ * @return pixels buffer of width * height bytes, or NULL if frames are not shared
+ */
+unsigned char *shm_begin_frame(int width, int height, uint64_t time_ns) {
+	SHM_WRITING = NULL;
+	if (SHM_BASE == NULL) {
+		return NULL;
+	}
+	shm_header *header = (shm_header *)SHM_BASE;
+	if ((width <= 0) || (height <= 0) || ((uint32_t)width > header->max_width)
+		|| ((uint32_t)height > header->max_height)) {
+		return NULL;
+	}
+	shm_slot *slot = (shm_slot *)(SHM_BASE + sizeof(shm_header)
+		+ ((size_t)(SHM_FRAME % header->slots) * header->slot_bytes));
+	slot->seq.store((2 * SHM_FRAME) + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	slot->result.frame = SHM_FRAME;
+	slot->result.time_ns = time_ns;
+	slot->result.width = width;
+	slot->result.height = height;
+	SHM_WRITING = slot;
+	return (unsigned char *)(slot + 1);
+}
+
+/**
+ * This function adds the result of the analysis to the frame claimed by shm_begin_frame and hands it
+ * to the readers.  The arguments are the same as telem_frame.
+ *
+ * @param area number of bright pixels
+ * @param cx centroid x, or -1 if the moon was not found
+ * @param cy centroid y, or -1 if the moon was not found
+ * @param top bright pixels on the top edge
+ * @param bottom bright pixels on the bottom edge
+ * @param left bright pixels on the left edge
+ * @param right bright pixels on the right edge
+ * @param lost number of frames the moon has been lost for
+ */
+void shm_publish(int area, int cx, int cy, int top, int bottom, int left, int right, int lost) {
+	if (SHM_WRITING == NULL) {
+		return;
+	}
+	shm_slot *slot = SHM_WRITING;
+	slot->result.area = area;
+	slot->result.cx = cx;
+	slot->result.cy = cy;
+	slot->result.top = top;
+	slot->result.bottom = bottom;
+	slot->result.left = left;
+	slot->result.right = right;
+	slot->result.lost = lost;
+	slot->result.run_mode = *val_ptr.RUN_MODEaddr;
+	slot->seq.store((2 * SHM_FRAME) + 2, std::memory_order_release);
+	SHM_FRAME++;
+	((shm_header *)SHM_BASE)->published.store(SHM_FRAME, std::memory_order_release);
+	SHM_WRITING = NULL;
+}
+
+/**
+ * This function removes the frame ring on exit.  Readers which still have it mapped keep their copy
+ * until they close it.
+ *
+ */
+void shm_close() {
+	if (SHM_BASE == NULL) {
+		return;
+	}
+	munmap(SHM_BASE, SHM_SIZE);
+	shm_unlink(SHM_NAME.c_str());
+	SHM_BASE = NULL;
+	SHM_WRITING = NULL;
+}
@@ -0,0 +1,56 @@
+/*
+ * C_LunAero/shm_LunAero.hpp - Shared memory frame ring headers for LunAero_C
+ * Copyright (C) <2020>  <Wesley T. Honeycutt>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SHM_LUNAERO_H
+#define SHM_LUNAERO_H
+
+// Standard C++ includes
+#include <string>
+
+// User Includes
+#include "shm_format_LunAero.hpp"
+#include "LunAero.hpp"
+
+/**
+ * Name of the shared memory frame ring other programs can read with shm_reader.  It appears as
+ * /dev/shm/NAME.  Empty to not publish frames.  Customizable from settings.cfg.
+ */
+inline std::string SHM_NAME = "/lunaero-frames";
+/**
+ * Number of frames kept in the shared memory ring.  Readers have SHM_SLOTS - 1 frames to use a frame
+ * before it is overwritten.  Customizable from settings.cfg.
+ */
+inline int SHM_SLOTS = 8;
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+
+// Global Variables - Not "private" but not necessary to define for Doxygen
+inline unsigned char *SHM_BASE = NULL;
+inline size_t SHM_SIZE = 0;
+inline uint32_t SHM_FRAME = 0;
+inline shm_slot *SHM_WRITING = NULL;
+
+#endif /* DOXYGEN_SHOULD_SKIP_THIS */
+
+// Function Prototypes
+int shm_init(int max_width, int max_height);
+unsigned char *shm_begin_frame(int width, int height, uint64_t time_ns);
+void shm_publish(int area, int cx, int cy, int top, int bottom, int left, int right, int lost);
+void shm_close();
+
+#endif
@@ -0,0 +1,335 @@
+/*
+ * C_LunAero/shm_format_LunAero.hpp - Shared memory frame ring format and reader for LunAero_C
+ * Copyright (C) <2020>  <Wesley T. Honeycutt>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * This header describes the frame ring LunAero publishes in shared memory, and holds a reader for
+ * other programs on the Pi.  Like telemetry_format_LunAero.hpp it does not include LunAero.hpp, so
+ * consumers only need the standard library and POSIX.  Link with -lrt on older glibc.
+ *
+ * Every analysed frame is published with the grey region of interest LunAero looked at and the result
+ * of the analysis.  There is one writer and any number of readers.  The writer never waits for readers:
+ * when the ring is full the oldest frame is overwritten, and readers which fall behind skip ahead.
+ * Readers map the ring read only and are never seen by LunAero.
+ *
+ * Layout of SHM_NAME:
+ *   shm_header    one, padded to SHM_ALIGN bytes
+ *   slots         slots of slot_bytes each, a shm_slot followed by width * height grey pixels
+ *
+ * Frame n is stored in slot n % slots.  The seq of a slot is 2n + 1 while frame n is being written and
+ * 2n + 2 once it is complete, so a reader knows a frame is whole if seq is the same before and after
+ * it was read.
+ *
+ * Example:
+ *   shm_reader reader;
+ *   shm_view view;
+ *   if (reader.open("/lunaero-frames") == 0) {
+ *       while (running) {
+ *           if (reader.next(view)) {
+ *               use(view.result, view.pixels);   // no copy is made
+ *               if (!reader.valid(view)) {
+ *                   discard();                   // LunAero overwrote the slot while it was used
+ *               }
+ *           } else {
+ *               usleep(10000);
+ *           }
+ *       }
+ *   }
+ */
+
+#ifndef SHM_FORMAT_LUNAERO_H
+#define SHM_FORMAT_LUNAERO_H
+
+// Standard C++ includes
+#include <atomic>          // provides std::atomic
+#include <cstdint>         // provides fixed width integers
+#include <cstring>         // provides memcmp
+
+// Module specific includes
+#include <fcntl.h>         // provides O_RDONLY
+#include <sys/mman.h>      // provides shm_open and mmap
+#include <sys/stat.h>      // provides fstat
+#include <unistd.h>        // provides close
+
+/**
+ * Bytes at the start of the ring.
+ */
+#define SHM_MAGIC "LUNF"
+/**
+ * Version of the ring layout.  Readers refuse rings of other versions.
+ */
+#define SHM_VERSION 1
+/**
+ * Alignment of the header and of every slot, one cache line.
+ */
+#define SHM_ALIGN 64
+
+static_assert(std::atomic <uint32_t>::is_always_lock_free, "the frame ring needs lock free atomics");
+
+/**
+ * Result of the analysis of one frame.  The fields match the frame records of the telemetry file.
+ */
+struct shm_result {
+	/**
+	 * Number of the frame, counting from 0 when LunAero started.
+	 */
+	uint64_t frame;
+	/**
+	 * CLOCK_MONOTONIC nanoseconds when the frame was captured.
+	 */
+	uint64_t time_ns;
+	/**
+	 * Width of the region of interest in pixels.  Rows are stored without padding.
+	 */
+	int32_t width;
+	/**
+	 * Height of the region of interest in pixels.
+	 */
+	int32_t height;
+	/**
+	 * Number of pixels bright enough to be part of the moon.
+	 */
+	int32_t area;
+	/**
+	 * Centroid of the moon in the region of interest, or -1 if nothing was found.
+	 */
+	int32_t cx;
+	int32_t cy;
+	/**
+	 * Bright pixels touching each edge of the region of interest.
+	 */
+	int32_t top;
+	int32_t bottom;
+	int32_t left;
+	int32_t right;
+	/**
+	 * Number of frames in a row the moon has been lost for.
+	 */
+	int32_t lost;
+	/**
+	 * 0 for preview/manual mode, 1 for recording/automatic mode.
+	 */
+	int32_t run_mode;
+};
+
+/**
+ * Start of the shared memory, written once by LunAero when the ring is created.
+ */
+struct alignas(SHM_ALIGN) shm_header {
+	char magic[4];
+	uint32_t version;
+	/**
+	 * Number of slots in the ring.
+	 */
+	uint32_t slots;
+	/**
+	 * Bytes from the start of one slot to the next.
+	 */
+	uint32_t slot_bytes;
+	/**
+	 * Largest width and height of a frame.
+	 */
+	uint32_t max_width;
+	uint32_t max_height;
+	/**
+	 * Process ID of the LunAero which created the ring.
+	 */
+	int32_t pid;
+	/**
+	 * Number of frames completely written.  Frame published - 1 is the newest.
+	 */
+	std::atomic <uint32_t> published;
+};
+
+/**
+ * Start of one slot.  The grey pixels follow at offset sizeof(shm_slot).
+ */
+struct alignas(SHM_ALIGN) shm_slot {
+	/**
+	 * 2n + 1 while frame n is written, 2n + 2 once it is complete.
+	 */
+	std::atomic <uint32_t> seq;
+	shm_result result;
+};
+
+/**
+ * This function works out the size of a slot holding frames up to the given size.
+ *
+ * @param max_width largest frame width
+ * @param max_height largest frame height
+ * @return bytes from the start of one slot to the next
+ */
+inline uint32_t shm_slot_bytes(uint32_t max_width, uint32_t max_height) {
+	uint32_t bytes = sizeof(shm_slot) + (max_width * max_height);
+	return (bytes + SHM_ALIGN - 1) & ~(uint32_t)(SHM_ALIGN - 1);
+}
+
+/**
+ * A frame in the ring.  The pointers point straight into shared memory, so the frame may be overwritten
+ * while it is used.  Check it with shm_reader::valid once done.
+ */
+struct shm_view {
+	const shm_result *result;
+	const unsigned char *pixels;
+	const shm_slot *slot;
+	uint32_t seq;
+};
+
+/**
+ * Reader of the frame ring for programs other than LunAero.
+ */
+class shm_reader {
+	public:
+		/**
+		 * Frames which were overwritten before this reader got to them.
+		 */
+		uint64_t dropped = 0;
+
+		~shm_reader() {
+			close();
+		}
+
+		/**
+		 * This function maps the ring read only.  Reading starts from the newest frame.
+		 *
+		 * @param name shared memory name given as SHM_NAME in settings.cfg
+		 * @return status 0 if the ring was opened, 1 if it does not exist, 2 if it is not a usable ring
+		 */
+		int open(const char *name) {
+			close();
+			int fd = shm_open(name, O_RDONLY, 0);
+			if (fd < 0) {
+				return 1;
+			}
+			struct stat st;
+			if ((fstat(fd, &st) != 0) || ((size_t)st.st_size < sizeof(shm_header))) {
+				::close(fd);
+				return 2;
+			}
+			void *mem = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+			::close(fd);
+			if (mem == MAP_FAILED) {
+				return 2;
+			}
+			base = (const unsigned char *)mem;
+			size = st.st_size;
+			header = (const shm_header *)base;
+			if ((memcmp(header->magic, SHM_MAGIC, 4) != 0) || (header->version != SHM_VERSION)
+				|| (header->slots == 0)
+				|| (size < sizeof(shm_header) + (size_t)header->slots * header->slot_bytes)) {
+				close();
+				return 2;
+			}
+			uint32_t published = header->published.load(std::memory_order_acquire);
+			next_frame = (published > 0) ? published - 1 : 0;
+			return 0;
+		}
+
+		/**
+		 * This function unmaps the ring.
+		 */
+		void close() {
+			if (base != NULL) {
+				munmap((void *)base, size);
+			}
+			base = NULL;
+			header = NULL;
+			size = 0;
+		}
+
+		/**
+		 * This function gets the oldest frame this reader has not seen yet.  Frames which have already
+		 * been overwritten are skipped and counted in dropped.
+		 *
+		 * @param view filled with the frame
+		 * @return found true if a frame was returned, false if there is nothing new
+		 */
+		bool next(shm_view &view) {
+			if (header == NULL) {
+				return false;
+			}
+			uint32_t published = header->published.load(std::memory_order_acquire);
+			if (published - next_frame > header->slots) {
+				dropped += published - header->slots - next_frame;
+				next_frame = published - header->slots;
+			}
+			while (next_frame != published) {
+				uint32_t frame = next_frame++;
+				const shm_slot *slot = slot_at(frame);
+				uint32_t seq = slot->seq.load(std::memory_order_acquire);
+				if (seq == (2 * frame) + 2) {
+					view.result = &slot->result;
+					view.pixels = (const unsigned char *)(slot + 1);
+					view.slot = slot;
+					view.seq = seq;
+					return true;
+				}
+				dropped++;
+			}
+			return false;
+		}
+
+		/**
+		 * This function gets the newest complete frame, skipping any others not seen yet.
+		 *
+		 * @param view filled with the frame
+		 * @return found true if a frame was returned, false if there is nothing new
+		 */
+		bool latest(shm_view &view) {
+			if (header == NULL) {
+				return false;
+			}
+			uint32_t published = header->published.load(std::memory_order_acquire);
+			if (published != next_frame) {
+				dropped += published - 1 - next_frame;
+				next_frame = published - 1;
+			}
+			return next(view);
+		}
+
+		/**
+		 * This function checks that a frame was not overwritten while it was used.
+		 *
+		 * @param view frame returned by next or latest
+		 * @return valid true if everything read from the frame is whole
+		 */
+		bool valid(const shm_view &view) {
+			std::atomic_thread_fence(std::memory_order_acquire);
+			return view.slot->seq.load(std::memory_order_relaxed) == view.seq;
+		}
+
+		/**
+		 * This function gets the header of the open ring.
+		 *
+		 * @return header, or NULL if no ring is open
+		 */
+		const shm_header *info() {
+			return header;
+		}
+
+	private:
+		const unsigned char *base = NULL;
+		size_t size = 0;
+		const shm_header *header = NULL;
+		uint32_t next_frame = 0;
+
+		const shm_slot *slot_at(uint32_t frame) {
+			return (const shm_slot *)(base + sizeof(shm_header) + (size_t)(frame % header->slots) * header->slot_bytes);
+		}
+};
+
+#endif
@@ -0,0 +1,164 @@
+/*
+ * C_LunAero/telemetry_LunAero.cpp - Telemetry recording functions for LunAero_C
+ * Copyright (C) <2020>  <Wesley T. Honeycutt>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "telemetry_LunAero.hpp"
+
+/**
+ * This function encodes an event payload and queues it on the log ring of this thread.  The payload is
+ * the event type followed by zigzag varint fields and optional text, built in a stack buffer so nothing
+ * is formatted or allocated on the calling loop.  The flusher adds the timestamp and thread tag.
+ *
+ * @param type event type from telem_type
+ * @param fields integer fields in the order listed in TELEM_EVENTS
+ * @param count number of fields
+ * @param text text of the event, or empty
+ */
+void telem_push(int type, const int64_t *fields, int count, std::string text) {
+	if (!TELEMETRY) {
+		return;
+	}
+	unsigned char buffer[LOG_TEXT];
+	int n = telem_put_varint(buffer, type);
+	for (int i=0; i<count; i++) {
+		n += telem_put_varint(buffer + n, telem_zigzag(fields[i]));
+	}
+	if (!text.empty()) {
+		size_t room = LOG_TEXT - n - 10;
+		size_t len = (text.size() < room) ? text.size() : room;
+		n += telem_put_varint(buffer + n, len);
+		memcpy(buffer + n, text.data(), len);
+		n += len;
+	}
+	log_push((const char *)buffer, n, LOG_KIND_TELEM);
+}
+
+/**
+ * This function records the result of one frame check.  Coordinates are in pixels of the region of
+ * interest, so the moon is centred when cx and cy are half the width and height.
+ *
+ * @param width width of the region of interest
+ * @param height height of the region of interest
+ * @param area number of pixels above the threshold
+ * @param cx centroid column, -1 if nothing was found
+ * @param cy centroid row, -1 if nothing was found
+ * @param top bright pixels on the top edge
+ * @param bottom bright pixels on the bottom edge
+ * @param left bright pixels on the left edge
+ * @param right bright pixels on the right edge
+ * @param lost value of the lost moon counter
+ */
+void telem_frame(int width, int height, int area, int cx, int cy, int top, int bottom, int left, int right, int lost) {
+	int64_t fields[] = {width, height, area, cx, cy, top, bottom, left, right, lost};
+	telem_push(TELEM_FRAME, fields, 10, "");
+}
+
+/**
+ * This function records the motor state when it differs from the last recorded state.  It is called
+ * once per cycle of motor_handler, so repeated identical ticks cost only a comparison.
+ *
+ */
+void telem_motor() {
+	int64_t fields[] = {*val_ptr.VERT_DIRaddr, *val_ptr.DUTY_Aaddr, *val_ptr.HORZ_DIRaddr, *val_ptr.DUTY_Baddr, *val_ptr.STOP_DIRaddr};
+	if (std::equal(fields, fields + 5, TELEM_LAST_MOTOR)) {
+		return;
+	}
+	std::copy(fields, fields + 5, TELEM_LAST_MOTOR);
+	telem_push(TELEM_MOTOR, fields, 5, "");
+}
+
+/**
+ * This function records the run mode and abort flag when either changes.
+ *
+ */
+void telem_mode() {
+	int64_t fields[] = {*val_ptr.RUN_MODEaddr, *val_ptr.ABORTaddr};
+	if (std::equal(fields, fields + 2, TELEM_LAST_MODE)) {
+		return;
+	}
+	std::copy(fields, fields + 2, TELEM_LAST_MODE);
+	telem_push(TELEM_MODE, fields, 2, "");
+}
+
+/**
+ * This function records a camera or segment event.
+ *
+ * @param event kind of event from telem_camera_event
+ * @param value first value of the event, for example bytes written to a closed segment
+ * @param value2 second value of the event, for example the worst write latency in ms
+ */
+void telem_camera(int event, long long value, long long value2) {
+	int64_t fields[] = {event, value, value2};
+	telem_push(TELEM_CAMERA, fields, 3, "");
+}
+
+/**
+ * This function records an error.
+ *
+ * @param code error from telem_error_code
+ * @param text short description of the error
+ */
+void telem_error(int code, std::string text) {
+	int64_t fields[] = {code};
+	telem_push(TELEM_ERROR, fields, 1, text);
+}
+
+/**
+ * This function builds the file header.  The UTC time of the monotonic clock epoch used by the log is
+ * stored so the decoder can print wall clock times.
+ *
+ * @param out buffer to append the header to
+ */
+void telem_header(std::string &out) {
+	struct timespec wall;
+	clock_gettime(CLOCK_REALTIME, &wall);
+	uint64_t wall_ns = ((uint64_t)wall.tv_sec * 1000000000ull) + wall.tv_nsec;
+	unsigned char buffer[32];
+	int n = telem_put_varint(buffer, TELEM_VERSION);
+	n += telem_put_varint(buffer + n, wall_ns - (log_now() - LOG_EPOCH));
+	out.append(TELEM_MAGIC, 4);
+	out.append((const char *)buffer, n);
+	TELEM_LAST_TS = 0;
+}
+
+/**
+ * This function encodes one queued event as a record of the telemetry file.  The timestamp is stored as
+ * the difference from the previous record, which is signed since events from different threads may reach
+ * the flusher slightly out of order.
+ *
+ * @param out buffer to append the record to
+ * @param ts nanoseconds since the log epoch
+ * @param tag thread tag
+ * @param data queued payload, starting with the event type
+ * @param len bytes of data
+ */
+void telem_encode(std::string &out, uint64_t ts, char tag, const char *data, size_t len) {
+	const unsigned char *payload = (const unsigned char *)data;
+	size_t pos = 0;
+	uint64_t type;
+	if (telem_get_varint(payload, len, pos, type)) {
+		return;
+	}
+	unsigned char buffer[32];
+	int n = telem_put_varint(buffer, type);
+	n += telem_put_varint(buffer + n, telem_zigzag((int64_t)(ts - TELEM_LAST_TS)));
+	buffer[n++] = (unsigned char)tag;
+	n += telem_put_varint(buffer + n, len - pos);
+	TELEM_LAST_TS = ts;
+	out.append((const char *)buffer, n);
+	out.append(data + pos, len - pos);
+}
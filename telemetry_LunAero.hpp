@@ -0,0 +1,59 @@
+/*
+ * C_LunAero/telemetry_LunAero.hpp - Telemetry recording headers for LunAero_C
+ * Copyright (C) <2020>  <Wesley T. Honeycutt>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TELEMETRY_LUNAERO_H
+#define TELEMETRY_LUNAERO_H
+
+// Standard C++ includes
+#include <string>
+#include <cstdint>         // provides fixed width integers
+
+// User Includes
+#include "telemetry_format_LunAero.hpp"
+#include "LunAero.hpp"
+
+/**
+ * Should LunAero record frame results, motor commands, and camera events to telemetry.lat?  Decode
+ * the file with lunaero-logdump.  Customizable from settings.cfg.
+ */
+inline bool TELEMETRY = true;
+/**
+ * Path of the telemetry file for this session.  Empty if TELEMETRY is off.
+ */
+inline std::string TELEMOUT = "";
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+
+// Global Variables - Not "private" but not necessary to define for Doxygen
+inline uint64_t TELEM_LAST_TS = 0;
+inline int64_t TELEM_LAST_MOTOR[5] = {-1, -1, -1, -1, -1};
+inline int64_t TELEM_LAST_MODE[2] = {-1, -1};
+
+#endif /* DOXYGEN_SHOULD_SKIP_THIS */
+
+// Function Prototypes
+void telem_push(int type, const int64_t *fields, int count, std::string text);
+void telem_frame(int width, int height, int area, int cx, int cy, int top, int bottom, int left, int right, int lost);
+void telem_motor();
+void telem_mode();
+void telem_camera(int event, long long value, long long value2);
+void telem_error(int code, std::string text);
+void telem_header(std::string &out);
+void telem_encode(std::string &out, uint64_t ts, char tag, const char *data, size_t len);
+
+#endif
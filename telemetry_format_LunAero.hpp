@@ -0,0 +1,202 @@
+/*
+ * C_LunAero/telemetry_format_LunAero.hpp - Binary telemetry format for LunAero_C
+ * Copyright (C) <2020>  <Wesley T. Honeycutt>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * This header describes the telemetry file and is shared by LunAero and lunaero-logdump.  Unlike the
+ * other headers it does not include LunAero.hpp, so the decoder can be built on any machine without
+ * the Raspberry Pi libraries.
+ *
+ * File layout:
+ *   magic      4 bytes "LUNT"
+ *   version    varint, TELEM_VERSION
+ *   wall_ns    varint, UTC nanoseconds corresponding to a record time of 0
+ *   records    until the end of the file
+ *
+ * Record layout:
+ *   type       varint, one of telem_type
+ *   dt_ns      zigzag varint, monotonic nanoseconds since the previous record (or since 0)
+ *   proc       1 byte, thread tag ('M' motor, 'C' camera, 'G' GUI, 'F' capture, 'A' analysis)
+ *   length     varint, bytes of payload
+ *   payload    zigzag varint fields in the order listed in TELEM_EVENTS, then a length prefixed
+ *              string if the event has text
+ *
+ * Decoders skip records of unknown type using the length, and ignore fields beyond those they know, so
+ * new fields may be appended to an event without text without changing the version.  The text follows
+ * the known fields directly, so an old decoder would read a field appended to an event with text as the
+ * length of the string.  Adding a field to such an event needs a new TELEM_VERSION.
+ */
+
+#ifndef TELEMETRY_FORMAT_LUNAERO_H
+#define TELEMETRY_FORMAT_LUNAERO_H
+
+// Standard C++ includes
+#include <string>
+#include <cstdint>         // provides fixed width integers
+
+/**
+ * Bytes at the start of every telemetry file.
+ */
+#define TELEM_MAGIC "LUNT"
+/**
+ * Version of the file layout.  Increase only for changes old decoders cannot skip over.
+ */
+#define TELEM_VERSION 1
+/**
+ * Most integer fields in one event.
+ */
+#define TELEM_MAX_FIELDS 12
+
+/**
+ * Event types stored in the telemetry file.
+ */
+enum telem_type {
+	TELEM_FRAME = 1,
+	TELEM_MOTOR = 2,
+	TELEM_MODE = 3,
+	TELEM_CAMERA = 4,
+	TELEM_ERROR = 5
+};
+
+/**
+ * Values of the "kind" field of TELEM_CAMERA records.  TELEM_CAM_EXPOSURE records the shutter and ISO
+ * chosen by auto exposure as value and value2.
+ */
+enum telem_camera_event {
+	TELEM_CAM_PREVIEW = 0,
+	TELEM_CAM_RECORD = 1,
+	TELEM_CAM_CLOSED = 2,
+	TELEM_CAM_MMAL = 3,
+	TELEM_CAM_REFRESH = 4,
+	TELEM_CAM_EXPOSURE = 5
+};
+
+/**
+ * Values of the "code" field of TELEM_ERROR records.
+ */
+enum telem_error_code {
+	TELEM_ERR_LOST = 1,
+	TELEM_ERR_MMAL = 2,
+	TELEM_ERR_DISK_FULL = 3,
+	TELEM_ERR_WRITE = 4,
+	TELEM_ERR_NO_RASPIVID = 5,
+	TELEM_ERR_DISPLAY = 6,
+	TELEM_ERR_STALL = 7
+};
+
+/**
+ * Description of one event type, used by the decoder to name fields.
+ */
+struct telem_event {
+	int type;
+	const char *name;
+	int nfields;
+	const char *fields[TELEM_MAX_FIELDS];
+	bool text;
+};
+
+/**
+ * Field names of every event type in version 1.  A cx or cy of -1 in a frame means nothing bright
+ * enough was found.
+ */
+inline const telem_event TELEM_EVENTS[] = {
+	{TELEM_FRAME, "frame", 10, {"width", "height", "area", "cx", "cy", "top", "bottom", "left", "right", "lost"}, false},
+	{TELEM_MOTOR, "motor", 5, {"vert_dir", "duty_a", "horz_dir", "duty_b", "stop"}, false},
+	{TELEM_MODE, "mode", 2, {"run_mode", "abort"}, false},
+	{TELEM_CAMERA, "camera", 3, {"kind", "value", "value2"}, false},
+	{TELEM_ERROR, "error", 1, {"code"}, true}
+};
+
+/**
+ * This function looks up the description of an event type.
+ *
+ * @param type event type read from a record
+ * @return event description, or NULL for unknown types
+ */
+inline const telem_event *telem_find_event(int type) {
+	for (const telem_event &event : TELEM_EVENTS) {
+		if (event.type == type) {
+			return &event;
+		}
+	}
+	return NULL;
+}
+
+/**
+ * This function appends an unsigned LEB128 varint to a buffer.
+ *
+ * @param out buffer with room for 10 bytes
+ * @param value value to encode
+ * @return bytes number of bytes written
+ */
+inline int telem_put_varint(unsigned char *out, uint64_t value) {
+	int n = 0;
+	while (value >= 0x80) {
+		out[n++] = (unsigned char)(value | 0x80);
+		value >>= 7;
+	}
+	out[n++] = (unsigned char)value;
+	return n;
+}
+
+/**
+ * This function maps a signed value onto an unsigned one so small negative numbers stay short.
+ *
+ * @param value signed value
+ * @return zigzag encoded value
+ */
+inline uint64_t telem_zigzag(int64_t value) {
+	return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+}
+
+/**
+ * This function reverses telem_zigzag.
+ *
+ * @param value zigzag encoded value
+ * @return signed value
+ */
+inline int64_t telem_unzigzag(uint64_t value) {
+	return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+}
+
+/**
+ * This function reads an unsigned LEB128 varint.
+ *
+ * @param data buffer to read from
+ * @param len bytes in the buffer
+ * @param pos position to read at, advanced past the varint
+ * @param value filled with the decoded value
+ * @return status 0 on success, 1 if the buffer ends inside the varint
+ */
+inline int telem_get_varint(const unsigned char *data, size_t len, size_t &pos, uint64_t &value) {
+	value = 0;
+	int shift = 0;
+	while (pos < len) {
+		unsigned char byte = data[pos++];
+		value |= (uint64_t)(byte & 0x7f) << shift;
+		if (!(byte & 0x80)) {
+			return 0;
+		}
+		shift += 7;
+		if (shift > 63) {
+			return 1;
+		}
+	}
+	return 1;
+}
+
+#endif
@@ -0,0 +1,199 @@
+/*
+ * C_LunAero/watchdog_LunAero.cpp - Worker watchdog for LunAero_C
+ * Copyright (C) <2020>  <Wesley T. Honeycutt>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "watchdog_LunAero.hpp"
+
+/**
+ * This function records a heartbeat from a worker.  It is cheap enough to call on every cycle.
+ *
+ * @param worker worker from wd_worker
+ * @param stage string literal naming what the worker is about to do
+ */
+void wd_beat(int worker, const char *stage) {
+	WD_STATE[worker].stage.store(stage, std::memory_order_relaxed);
+	WD_STATE[worker].beat.store(log_now(), std::memory_order_release);
+}
+
+/**
+ * This function records that a worker has finished a unit of work, such as a frame check.
+ *
+ * @param worker worker from wd_worker
+ */
+void wd_progress(int worker) {
+	uint64_t now = log_now();
+	WD_STATE[worker].progress.store(now, std::memory_order_relaxed);
+	WD_STATE[worker].beat.store(now, std::memory_order_release);
+}
+
+/**
+ * This function names a worker for the log.
+ *
+ * @param worker worker from wd_worker
+ * @return name of the worker
+ */
+const char *wd_name(int worker) {
+	switch (worker) {
+		case WD_MOTOR:
+			return "motor";
+		case WD_CAMERA:
+			return "camera";
+		case WD_GUI:
+			return HEADLESS ? "headless main" : "GUI";
+		case WD_CAPTURE:
+			return "capture";
+		case WD_ANALYSIS:
+			return "analysis";
+	}
+	return "unknown";
+}
+
+/**
+ * This function gives the normal time between heartbeats of a worker.  A worker is stalled once it has
+ * gone WATCHDOG_MS longer than this without one.
+ *
+ * @param worker worker from wd_worker
+ * @return interval in nanoseconds
+ */
+uint64_t wd_interval(int worker) {
+	switch (worker) {
+		case WD_MOTOR:
+			return (uint64_t)MOTOR_CYCLE_US * 1000;
+		case WD_CAMERA:
+			return (uint64_t)CAMERA_MONITOR_MS * 1000000;
+		case WD_GUI:
+			if (HEADLESS) {
+				return (uint64_t)HEADLESS_POLL_MS * 1000000;
+			}
+			return (uint64_t)GUI_HEARTBEAT_S * 1000000000;
+		case WD_CAPTURE:
+		case WD_ANALYSIS:
+			if (*val_ptr.RUN_MODEaddr == 1) {
+				return (uint64_t)FRAMECHECK_FREQ * 1000000;
+			}
+			return (uint64_t)ANALYSIS_IDLE_MS * 1000000;
+	}
+	return 0;
+}
+
+/**
+ * This function makes the component safe once a stall is found.  A stalled motor thread cannot be
+ * trusted to brake, so the motors are stopped from here and the run is ended.  A stalled capture or
+ * analysis thread leaves the motors running on the last command given, so the motor thread is told to
+ * stop them.  So does a stalled GUI thread in preview, where it gives the motor commands.
+ * A stalled camera thread is most likely waiting on raspivid, so raspivid is killed to free it and the
+ * camera is restarted once the thread recovers.  If the camera thread stays stalled, the run is ended.
+ *
+ * @param worker worker from wd_worker
+ * @param age nanoseconds since the last heartbeat
+ */
+void wd_stalled(int worker, uint64_t age) {
+	const char *stage = WD_STATE[worker].stage.load(std::memory_order_relaxed);
+	LOG_ERROR("ERROR: watchdog found the " << wd_name(worker) << " thread stalled in \"" << stage
+		<< "\" for " << (age / 1000000) << " ms");
+	telem_error(TELEM_ERR_STALL, std::string(wd_name(worker)) + " stalled in " + stage);
+	metric_add(METRICS.watchdog_stalls);
+	if (worker == WD_MOTOR) {
+		final_stop();
+		notify_handler("LunAero Error", "The motor thread stopped responding.  Motors stopped.");
+		abort_code();
+	} else if ((worker == WD_CAPTURE) || (worker == WD_ANALYSIS)) {
+		*val_ptr.STOP_DIRaddr = 3;
+	} else if ((worker == WD_GUI) && (*val_ptr.RUN_MODEaddr == 0)) {
+		*val_ptr.STOP_DIRaddr = 3;
+	} else if (worker == WD_CAMERA) {
+		kill_raspivid();
+	}
+}
+
+/**
+ * This function is called when a stalled worker starts beating again.
+ *
+ * @param worker worker from wd_worker
+ * @param age nanoseconds the worker was stalled for
+ */
+void wd_recovered(int worker, uint64_t age) {
+	LOG_WARN("WARNING: watchdog found the " << wd_name(worker) << " thread running again after "
+		<< (age / 1000000) << " ms");
+	if (worker == WD_CAMERA) {
+		CAMERA_QUEUE.push(CAM_REQ_RESTART);
+	}
+}
+
+/**
+ * This function runs on the watchdog thread.  Every worker which has started is checked several times
+ * per WATCHDOG_MS.  The capture and analysis threads must also keep finishing screenshots and frame
+ * checks while recording, since a thread which still beats but no longer checks frames would leave the
+ * motors on a stale command.
+ *
+ */
+void wd_loop() {
+	log_set_thread(3, 'W');
+	bool stalled[WD_WORKERS] = {false};
+	uint64_t since[WD_WORKERS] = {0};
+	while (*val_ptr.ABORTaddr == 0) {
+		uint64_t deadline = (uint64_t)WATCHDOG_MS * 1000000;
+		uint64_t now = log_now();
+		for (int i=0; i<WD_WORKERS; i++) {
+			uint64_t last = WD_STATE[i].beat.load(std::memory_order_acquire);
+			if (((i == WD_CAPTURE) || (i == WD_ANALYSIS)) && (*val_ptr.RUN_MODEaddr == 1)) {
+				last = WD_STATE[i].progress.load(std::memory_order_relaxed);
+			}
+			if (last == 0) {
+				continue;
+			}
+			uint64_t age = (now > last) ? now - last : 0;
+			if (!stalled[i] && (age > wd_interval(i) + deadline)) {
+				stalled[i] = true;
+				since[i] = last;
+				wd_stalled(i, age);
+			} else if (stalled[i] && (last != since[i])) {
+				stalled[i] = false;
+				wd_recovered(i, last - since[i]);
+			} else if (stalled[i] && (i == WD_CAMERA) && (age > 2 * (wd_interval(i) + deadline))) {
+				LOG_ERROR("ERROR: the camera thread did not recover, ending the run");
+				notify_handler("LunAero Error", "The camera stopped responding.");
+				abort_code();
+			}
+		}
+		usleep(std::max(WATCHDOG_MS / 4, WD_MIN_CHECK_MS) * 1000);
+	}
+}
+
+/**
+ * This function starts the watchdog thread.  Workers are only watched once they have sent their first
+ * heartbeat, so a slow startup is not mistaken for a stall.
+ *
+ */
+void wd_start() {
+	for (int i=0; i<WD_WORKERS; i++) {
+		WD_STATE[i].beat.store(0);
+		WD_STATE[i].progress.store(0);
+		WD_STATE[i].stage.store("starting");
+	}
+	WD_THREAD = std::thread(wd_loop);
+}
+
+/**
+ * This function waits for the watchdog thread to notice the abort and exit.
+ *
+ */
+void wd_stop() {
+	if (WD_THREAD.joinable()) {
+		WD_THREAD.join();
+	}
+}
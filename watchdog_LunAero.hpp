@@ -0,0 +1,91 @@
+/*
+ * C_LunAero/watchdog_LunAero.hpp - Worker watchdog headers for LunAero_C
+ * Copyright (C) <2020>  <Wesley T. Honeycutt>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef WATCHDOG_LUNAERO_H
+#define WATCHDOG_LUNAERO_H
+
+// Standard C++ includes
+#include <string>
+#include <atomic>          // provides std::atomic
+#include <cstdint>         // provides fixed width integers
+
+// User Includes
+#include "LunAero.hpp"
+
+// Global Defined Constants
+/**
+ * Shortest time in milliseconds between checks of the watchdog.
+ */
+#define WD_MIN_CHECK_MS 50
+
+/**
+ * Workers watched by the watchdog.
+ */
+enum wd_worker {
+	WD_MOTOR,
+	WD_CAMERA,
+	WD_GUI,
+	WD_CAPTURE,
+	WD_ANALYSIS,
+	WD_WORKERS
+};
+
+/**
+ * Heartbeat of one worker.  Written by the worker, read by the watchdog thread.
+ */
+struct wd_state {
+	/**
+	 * log_now of the last heartbeat, or 0 if the worker has not started.
+	 */
+	std::atomic <uint64_t> beat;
+	/**
+	 * log_now when the worker last finished a unit of work.
+	 */
+	std::atomic <uint64_t> progress;
+	/**
+	 * What the worker was doing at the last heartbeat.  Always points at a string literal.
+	 */
+	std::atomic <const char *> stage;
+};
+
+/**
+ * Longest time in milliseconds a worker may go without a heartbeat, on top of its normal cycle time,
+ * before it is considered stalled.  Customizable from settings.cfg.
+ */
+inline std::atomic<int> WATCHDOG_MS = 2000;
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+
+// Global Variables - Not "private" but not necessary to define for Doxygen
+inline wd_state WD_STATE[WD_WORKERS];
+inline std::thread WD_THREAD;
+
+#endif /* DOXYGEN_SHOULD_SKIP_THIS */
+
+// Function Prototypes
+void wd_beat(int worker, const char *stage);
+void wd_progress(int worker);
+const char *wd_name(int worker);
+uint64_t wd_interval(int worker);
+void wd_stalled(int worker, uint64_t age);
+void wd_recovered(int worker, uint64_t age);
+void wd_loop();
+void wd_start();
+void wd_stop();
+
+#endif
@@ -0,0 +1,263 @@
+/*
+ * C_LunAero/writer_LunAero.cpp - Video segment writer functions for LunAero_C
+ * Copyright (C) <2020>  <Wesley T. Honeycutt>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "writer_LunAero.hpp"
+
+/**
+ * This function takes over the output of a raspivid process started with "-o -" and begins writing it
+ * to a segment file.  The segment is preallocated at the forecast size so the drive does not fragment
+ * it or update the allocation table on every write.  FALLOC_FL_KEEP_SIZE is used so the file size still
+ * grows as video is written, which disk_monitor_check relies on.  Drives which do not support
+ * preallocation, such as exFAT, are written without it.  A reader thread fills a ring of WRITER_BUFFERS
+ * aligned buffers from the pipe and a writer thread empties them to the drive.
+ *
+ * @param pipe stream returned by popen for the raspivid process
+ * @param path full path of the segment to write
+ * @return status 0 if the writer started
+ */
+int writer_start(FILE *pipe, std::string path) {
+	writer_finish();
+	WRITER_OUT = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (WRITER_OUT < 0) {
+		LOG_ERROR("ERROR: could not open " << path << " for writing");
+		return 1;
+	}
+	
+	// Reserve the whole segment, leaving DISK_RESERVE free for the log and ID file
+	double forecast = disk_forecast_bytes(std::chrono::duration<double>(RECORD_DURATION).count());
+	double usable = (double)disk_available(path.substr(0, path.rfind('/'))) - DISK_RESERVE;
+	if (forecast > usable) {
+		forecast = usable;
+	}
+	WRITER_PREALLOC = 0;
+	if (forecast > 0.) {
+		if (fallocate(WRITER_OUT, FALLOC_FL_KEEP_SIZE, 0, (off_t)forecast) == 0) {
+			WRITER_PREALLOC = (unsigned long long)forecast;
+		} else {
+			LOG_WARN("WARNING: could not preallocate " << path << ", writing without it");
+		}
+	}
+	*val_ptr.PREALLOC_MBaddr = WRITER_PREALLOC / WRITER_BLOCK;
+	
+	// Ring buffers are allocated once and reused by every segment
+	if ((int)WRITER_RING.size() != WRITER_BUFFERS) {
+		for (unsigned int i=0; i<WRITER_RING.size(); i++) {
+			free(WRITER_RING[i]);
+		}
+		WRITER_RING.clear();
+		for (int i=0; i<WRITER_BUFFERS; i++) {
+			void *buffer = NULL;
+			if (posix_memalign(&buffer, WRITER_ALIGN, WRITER_BLOCK) != 0) {
+				close(WRITER_OUT);
+				return 1;
+			}
+			WRITER_RING.push_back((char *)buffer);
+		}
+		WRITER_LEN.assign(WRITER_BUFFERS, 0);
+	}
+	
+	WRITER_PIPE = pipe;
+	WRITER_IN = fileno(pipe);
+	// A larger pipe lets raspivid keep encoding while the reader is waiting for a free buffer
+	fcntl(WRITER_IN, F_SETPIPE_SZ, WRITER_BLOCK);
+	WRITER_PATH = path;
+	WRITER_HEAD = 0;
+	WRITER_TAIL = 0;
+	WRITER_COUNT = 0;
+	WRITER_HIGH = 0;
+	WRITER_STALLS = 0;
+	WRITER_EOF = false;
+	WRITER_FAILED = false;
+	WRITER_WRITTEN = 0;
+	WRITER_LATENCY.clear();
+	WRITER_ACTIVE = true;
+	WRITER_READ_THREAD = std::thread(writer_read_loop);
+	WRITER_WRITE_THREAD = std::thread(writer_write_loop);
+	return 0;
+}
+
+/**
+ * This function waits for the current segment to end and closes it.  It must only be called once
+ * raspivid has been killed, otherwise the pipe never reaches the end of file.  The unused part of the
+ * preallocation is released by truncating the file to the bytes written, and the per-write latency of
+ * the segment is reported to the log.  Segments which received no video, such as failed MMAL starts,
+ * are removed.
+ *
+ */
+void writer_finish() {
+	if (!WRITER_ACTIVE) {
+		return;
+	}
+	WRITER_READ_THREAD.join();
+	WRITER_WRITE_THREAD.join();
+	WRITER_ACTIVE = false;
+	pclose(WRITER_PIPE);
+	WRITER_PIPE = NULL;
+	
+	if (ftruncate(WRITER_OUT, WRITER_WRITTEN) != 0) {
+		LOG_WARN("WARNING: could not release the unused preallocation of " << WRITER_PATH << ": "
+			<< strerror(errno));
+	}
+	fdatasync(WRITER_OUT);
+	close(WRITER_OUT);
+	WRITER_OUT = -1;
+	*val_ptr.PREALLOC_MBaddr = 0;
+	if (WRITER_WRITTEN == 0) {
+		unlink(WRITER_PATH.c_str());
+	}
+	
+	double mean = 0.;
+	double p99 = 0.;
+	double worst = 0.;
+	if (!WRITER_LATENCY.empty()) {
+		for (unsigned int i=0; i<WRITER_LATENCY.size(); i++) {
+			mean += WRITER_LATENCY[i];
+		}
+		mean = mean / WRITER_LATENCY.size();
+		std::sort(WRITER_LATENCY.begin(), WRITER_LATENCY.end());
+		p99 = WRITER_LATENCY[(WRITER_LATENCY.size() * 99) / 100];
+		worst = WRITER_LATENCY.back();
+	}
+	telem_camera(TELEM_CAM_CLOSED, WRITER_WRITTEN, (long long)worst);
+	LOG_INFO("closed " << WRITER_PATH << ": " << WRITER_WRITTEN << " bytes in " << WRITER_LATENCY.size()
+		<< " writes, latency mean " << mean << " ms p99 " << p99 << " ms max " << worst
+		<< " ms, ring high water " << WRITER_HIGH << "/" << WRITER_BUFFERS
+		<< ", stalls " << WRITER_STALLS);
+}
+
+/**
+ * This function runs on the reader thread.  It fills the buffer at the head of the ring from the
+ * raspivid pipe and passes each full buffer to the writer thread.  If every buffer is waiting to be
+ * written the drive has stalled for longer than the ring can absorb, so the stall is counted and the
+ * reader waits, which in turn blocks raspivid.
+ *
+ */
+void writer_read_loop() {
+	while (true) {
+		{
+			std::unique_lock<std::mutex> lock(WRITER_MUTEX);
+			if (WRITER_COUNT == WRITER_BUFFERS) {
+				WRITER_STALLS += 1;
+				WRITER_CV.wait(lock, []{ return WRITER_COUNT < WRITER_BUFFERS; });
+			}
+		}
+		char *buffer = WRITER_RING[WRITER_HEAD];
+		size_t len = 0;
+		bool eof = false;
+		while (len < WRITER_BLOCK) {
+			ssize_t ret = read(WRITER_IN, buffer + len, WRITER_BLOCK - len);
+			if (ret < 0 && errno == EINTR) {
+				continue;
+			}
+			if (ret <= 0) {
+				eof = true;
+				break;
+			}
+			len += ret;
+		}
+		std::lock_guard<std::mutex> lock(WRITER_MUTEX);
+		if (len > 0) {
+			WRITER_LEN[WRITER_HEAD] = len;
+			WRITER_HEAD = (WRITER_HEAD + 1) % WRITER_BUFFERS;
+			WRITER_COUNT += 1;
+			if (WRITER_COUNT > WRITER_HIGH) {
+				WRITER_HIGH = WRITER_COUNT;
+			}
+		}
+		if (eof) {
+			WRITER_EOF = true;
+		}
+		WRITER_CV.notify_all();
+		if (eof) {
+			return;
+		}
+	}
+}
+
+/**
+ * This function runs on the writer thread.  It writes each full buffer to the segment in one large
+ * sequential write and records how long it took.  Data is synced at most every WRITER_SYNC_TIME
+ * seconds so the drive receives steady large flushes rather than one huge flush from the kernel, and
+ * synced video is dropped from the page cache since it will not be read back.  If a write fails, the
+ * segment ends there: the rest of the video is read from raspivid and discarded, so the file has no
+ * hole, and the camera thread is asked for a new segment, which moves to the next drive if this one
+ * is full.  A segment which could not be written at all ends the run.
+ *
+ */
+void writer_write_loop() {
+	auto last_sync = std::chrono::steady_clock::now();
+	unsigned long long synced = 0;
+	while (true) {
+		{
+			std::unique_lock<std::mutex> lock(WRITER_MUTEX);
+			WRITER_CV.wait(lock, []{ return (WRITER_COUNT > 0) || WRITER_EOF; });
+			if ((WRITER_COUNT == 0) && WRITER_EOF) {
+				return;
+			}
+		}
+		// The reader never touches the tail buffer while it is counted in the ring
+		char *buffer = WRITER_RING[WRITER_TAIL];
+		size_t len = WRITER_FAILED ? 0 : WRITER_LEN[WRITER_TAIL];
+		auto t0 = std::chrono::steady_clock::now();
+		size_t done = 0;
+		while (done < len) {
+			ssize_t ret = write(WRITER_OUT, buffer + done, len - done);
+			if (ret < 0 && errno == EINTR) {
+				continue;
+			}
+			if (ret <= 0) {
+				int err = (ret < 0) ? errno : ENOSPC;
+				LOG_ERROR("ERROR: write to " << WRITER_PATH << " failed after " << (WRITER_WRITTEN + done)
+					<< " bytes: " << strerror(err) << ", discarding the rest of the segment");
+				telem_error(TELEM_ERR_WRITE, "write failed");
+				WRITER_FAILED = true;
+				if (WRITER_WRITTEN + done == 0) {
+					abort_code();
+				} else {
+					CAMERA_QUEUE.push(CAM_REQ_ROTATE);
+				}
+				break;
+			}
+			done += ret;
+		}
+		WRITER_WRITTEN += done;
+		metric_add(METRICS.bytes_written, done);
+		auto now = std::chrono::steady_clock::now();
+		if (!WRITER_FAILED && (now - last_sync >= std::chrono::seconds(WRITER_SYNC_TIME))) {
+			fdatasync(WRITER_OUT);
+			posix_fadvise(WRITER_OUT, synced, WRITER_WRITTEN - synced, POSIX_FADV_DONTNEED);
+			synced = WRITER_WRITTEN;
+			last_sync = now;
+			now = std::chrono::steady_clock::now();
+		}
+		std::chrono::duration<double, std::milli> dt = now - t0;
+		if (len > 0) {
+			WRITER_LATENCY.push_back(dt.count());
+		}
+		if (WRITER_PREALLOC > WRITER_WRITTEN) {
+			*val_ptr.PREALLOC_MBaddr = (WRITER_PREALLOC - WRITER_WRITTEN) / WRITER_BLOCK;
+		} else {
+			*val_ptr.PREALLOC_MBaddr = 0;
+		}
+		
+		std::lock_guard<std::mutex> lock(WRITER_MUTEX);
+		WRITER_TAIL = (WRITER_TAIL + 1) % WRITER_BUFFERS;
+		WRITER_COUNT -= 1;
+		WRITER_CV.notify_all();
+	}
+}
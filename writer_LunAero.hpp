@@ -0,0 +1,94 @@
+/*
+ * C_LunAero/writer_LunAero.hpp - Video segment writer headers for LunAero_C
+ * Copyright (C) <2020>  <Wesley T. Honeycutt>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef WRITER_LUNAERO_H
+#define WRITER_LUNAERO_H
+
+// Standard C++ includes
+#include <string>
+#include <iostream>
+#include <chrono>          // provides C++ chrono
+#include <thread>          // provides std::thread
+#include <mutex>           // provides std::mutex
+#include <condition_variable> // provides std::condition_variable
+#include <cstring>         // provides strerror
+
+// Module specific includes
+#include <fcntl.h>         // provides open, fallocate, and posix_fadvise
+#include <unistd.h>        // provides read, write, and fdatasync
+
+// User Includes
+#include "LunAero.hpp"
+
+// Global Defined Constants
+/**
+ * Size in bytes of each buffer in the writer ring, and so of each write to the drive (1 MiB).
+ */
+#define WRITER_BLOCK 1048576
+/**
+ * Alignment in bytes of the writer buffers.  Page aligned buffers are copied to the page cache in whole
+ * pages.
+ */
+#define WRITER_ALIGN 4096
+
+/**
+ * Number of WRITER_BLOCK buffers in the writer ring.  This bounds the memory used and sets how long a
+ * drive stall can be absorbed before raspivid is blocked.  Customizable from settings.cfg.
+ */
+inline int WRITER_BUFFERS = 16;
+/**
+ * Maximum number of seconds of video held in the page cache before it is synced to the drive.
+ * Customizable from settings.cfg.
+ */
+inline int WRITER_SYNC_TIME = 2;
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+
+// Global Variables - Not "private" but not necessary to define for Doxygen
+inline vector <char *> WRITER_RING;
+inline vector <size_t> WRITER_LEN;
+inline int WRITER_HEAD = 0;
+inline int WRITER_TAIL = 0;
+inline int WRITER_COUNT = 0;
+inline int WRITER_HIGH = 0;
+inline int WRITER_STALLS = 0;
+inline bool WRITER_EOF = false;
+// Set by the writer thread when a write to the segment fails, after which the rest is discarded
+inline bool WRITER_FAILED = false;
+inline bool WRITER_ACTIVE = false;
+inline int WRITER_IN = -1;
+inline int WRITER_OUT = -1;
+inline FILE *WRITER_PIPE = NULL;
+inline std::string WRITER_PATH = "";
+inline unsigned long long WRITER_WRITTEN = 0;
+inline unsigned long long WRITER_PREALLOC = 0;
+inline vector <double> WRITER_LATENCY;
+inline std::mutex WRITER_MUTEX;
+inline std::condition_variable WRITER_CV;
+inline std::thread WRITER_READ_THREAD;
+inline std::thread WRITER_WRITE_THREAD;
+
+#endif /* DOXYGEN_SHOULD_SKIP_THIS */
+
+// Function Prototypes
+int writer_start(FILE *pipe, std::string path);
+void writer_finish();
+void writer_read_loop();
+void writer_write_loop();
+
+#endif